@@ -0,0 +1,861 @@
+/************************************************
+ *
+ *  Benchmark harness for Shafa's modules and kernels
+ *
+ *  Generates deterministic corpora, times every hot kernel in isolation
+ *  and then each module (F, T, C, D) end-to-end over a temporary file.
+ *
+ ***********************************************/
+
+#include <math.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kernels.h"
+#include "../src/modules/f.h"
+#include "../src/modules/t.h"
+#include "../src/modules/c.h"
+#include "../src/modules/d.h"
+#include "../src/modules/utils/file.h"
+#include "../src/modules/utils/rans.h"
+#include "../src/modules/utils/bwt.h"
+#include "../src/modules/utils/bufpool.h"
+#include "../src/modules/utils/extensions.h"
+#include "../src/modules/utils/multithread.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_TSC
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define CAN_MUTE_STDOUT
+#endif
+
+#define NUM_SYMBOLS 256
+#define MIN_BENCH_TIME 0.2 // Seconds each kernel is repeated for
+#define MAX_CODES_SIZE 33152
+#define AUTO_CODES_LIMIT 0.015 // .cod / .shaf size allowed with auto_block_size's blocks (It aims at about 1%)
+
+/**
+ Every corpus generated by the harness
+*/
+typedef enum {
+    CORPUS_UNIFORM,
+    CORPUS_ZIPF,
+    CORPUS_RUNS,
+    CORPUS_SPARSE,
+    CORPUS_TEXT,
+    NUM_CORPORA
+} Corpus;
+
+static const char * const CORPUS_NAMES[NUM_CORPORA] = {"uniform", "zipf", "runs", "sparse", "text"};
+
+/**
+ Result of timing a kernel or module
+*/
+typedef struct {
+    double seconds;  // Per iteration
+    double cycles;   // Per iteration (0 if unavailable)
+} Timing;
+
+
+/*
+    Deterministic generator (xorshift64*) so every run benchmarks exactly the same bytes
+*/
+static uint64_t SEED;
+
+static inline uint64_t rng(void)
+{
+    SEED ^= SEED >> 12;
+    SEED ^= SEED << 25;
+    SEED ^= SEED >> 27;
+    return SEED * 0x2545F4914F6CDD1DULL;
+}
+
+static inline double rng_unit(void)
+{
+    return (rng() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+/**
+\brief Picks an index between [0, n[ following the cumulative distribution `cdf`
+*/
+static int sample_cdf(const double * const cdf, const int n)
+{
+    double u = rng_unit();
+    int lo = 0, hi = n - 1, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+
+/**
+\brief Fills a buffer with the given corpus
+ @param corpus Kind of data
+ @param buffer Buffer to be filled
+ @param size Size of the buffer
+*/
+static void generate_corpus(const Corpus corpus, uint8_t * const buffer, const unsigned long size)
+{
+    static const char * const LEVELS[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"};
+    static const char * const PATHS[] = {"/", "/index.html", "/api/v1/items", "/login", "/static/app.js", "/favicon.ico"};
+    static char words[1024][12];
+    static double cdf[1024];
+    unsigned long i = 0, len;
+    double sum = 0;
+    char line[160];
+
+    SEED = 0x9E3779B97F4A7C15ULL ^ (corpus + 1);
+
+    switch (corpus) {
+        case CORPUS_UNIFORM:
+            for ( ; i < size; ++i)
+                buffer[i] = rng();
+            break;
+
+        case CORPUS_ZIPF: // Pseudo-words drawn with Zipf's law (s = 1.1) separated by spaces
+            for (int w = 0; w < 1024; ++w) {
+                len = 2 + rng() % 9;
+                for (unsigned long c = 0; c < len; ++c)
+                    words[w][c] = 'a' + rng() % 26;
+                words[w][len] = '\0';
+                sum += 1.0 / pow(w + 1, 1.1);
+                cdf[w] = sum;
+            }
+            for (int w = 0; w < 1024; ++w)
+                cdf[w] /= sum;
+
+            while (i < size) {
+                const char * word = words[sample_cdf(cdf, 1024)];
+                for ( ; *word && i < size; ++word)
+                    buffer[i++] = *word;
+                if (i < size)
+                    buffer[i++] = ' ';
+            }
+            break;
+
+        case CORPUS_RUNS: // Few symbols repeated with long geometric-like runs
+            while (i < size) {
+                uint8_t symbol = rng() % 8;
+                len = 1 + (unsigned long) (-64.0 * log(1.0 - rng_unit()));
+                for ( ; len && i < size; --len)
+                    buffer[i++] = symbol;
+            }
+            break;
+
+        case CORPUS_SPARSE: // ~95% zeros
+            for ( ; i < size; ++i)
+                buffer[i] = (rng() % 100 < 5) ? 1 + rng() % 255 : 0;
+            break;
+
+        case CORPUS_TEXT: // Looks like a web server's log
+            while (i < size) {
+                len = sprintf(
+                    line,
+                    "2021-01-%02d %02d:%02d:%02d %s GET %s 10.0.%d.%d %d %lu\n",
+                    (int) (1 + rng() % 28), (int) (rng() % 24), (int) (rng() % 60), (int) (rng() % 60),
+                    LEVELS[rng() % 6], PATHS[rng() % 6],
+                    (int) (rng() % 4), (int) (rng() % 256),
+                    rng() % 10 ? 200 : 404, (unsigned long) (rng() % 100000)
+                );
+                for (unsigned long c = 0; c < len && i < size; ++c)
+                    buffer[i++] = line[c];
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+/**
+\brief Monotonic wall clock in seconds
+*/
+static double now(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+    return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static inline uint64_t cycles(void)
+{
+#ifdef HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+/*
+    Every kernel is a closure over this context so it can be repeated by `time_kernel`
+*/
+typedef struct {
+    const uint8_t * input;
+    unsigned long input_size;
+    uint8_t * scratch;
+    unsigned long freq[NUM_SYMBOLS];
+    char * codes;
+    void * table;
+    void * tree;
+    const uint8_t * shafa;
+    unsigned long shafa_size;
+    const uint8_t * rle;
+    unsigned long rle_size;
+    void * rle_tree;
+    const uint8_t * shafa_rle;
+    unsigned long shafa_rle_size;
+    RansTable * rans_table;
+    const uint8_t * rans;
+    unsigned long rans_size;
+    const uint8_t * bwt;
+    unsigned long bwt_primary;
+    unsigned long output_size;
+    bool failed;
+} Context;
+
+static void run_block_compression(Context * const ctx)
+{
+    ctx->output_size = bench_block_compression(ctx->input, ctx->scratch, ctx->input_size);
+}
+
+static void run_make_freq(Context * const ctx)
+{
+    bench_make_freq(ctx->input, ctx->freq, ctx->input_size);
+    ctx->output_size = 0;
+}
+
+static void run_sf_codes(Context * const ctx)
+{
+    bench_sf_codes(ctx->freq, ctx->codes);
+    ctx->output_size = 0;
+}
+
+static void run_binary_coding(Context * const ctx)
+{
+    uint8_t * output = bench_binary_coding(ctx->table, ctx->input, ctx->input_size, &ctx->output_size);
+
+    if (!output)
+        ctx->failed = true;
+    bufpool_free(output);
+}
+
+static void run_shafa_block_decompressor(Context * const ctx)
+{
+    uint8_t * output = NULL;
+
+    if (bench_shafa_block_decompressor((uint8_t *) ctx->shafa, ctx->shafa_size, ctx->input_size, ctx->tree, &output))
+        ctx->failed = true;
+    ctx->output_size = ctx->shafa_size;
+    bufpool_free(output);
+}
+
+static void run_rans_encode(Context * const ctx)
+{
+    if (rans_encode(ctx->rans_table, ctx->input, ctx->input_size, ctx->scratch, ctx->input_size * 2 + 3, &ctx->output_size) || !ctx->output_size)
+        ctx->failed = true;
+}
+
+static void run_rans_decode(Context * const ctx)
+{
+    if (rans_decode(ctx->rans_table, ctx->rans, ctx->rans_size, ctx->scratch, ctx->input_size))
+        ctx->failed = true;
+    ctx->output_size = ctx->rans_size;
+}
+
+static void run_bwt_encode(Context * const ctx)
+{
+    if (bwt_encode(ctx->input, ctx->scratch, ctx->input_size, &ctx->bwt_primary))
+        ctx->failed = true;
+    ctx->output_size = ctx->input_size;
+}
+
+static void run_bwt_decode(Context * const ctx)
+{
+    // The kernel works in place
+    memcpy(ctx->scratch, ctx->bwt, ctx->input_size);
+    if (bwt_decode(ctx->scratch, ctx->input_size, ctx->bwt_primary))
+        ctx->failed = true;
+    ctx->output_size = ctx->input_size;
+}
+
+static void run_rle_block_decompressor(Context * const ctx)
+{
+    uint8_t * rle, * output = NULL;
+    unsigned long size = 0;
+
+    // The kernel takes ownership of its input
+    rle = bufpool_alloc(ctx->rle_size);
+    if (!rle) {
+        ctx->failed = true;
+        return;
+    }
+    memcpy(rle, ctx->rle, ctx->rle_size);
+
+    if (bench_rle_block_decompressor(rle, ctx->rle_size, ctx->input_size, &output, &size) || size != ctx->input_size)
+        ctx->failed = true;
+    ctx->output_size = ctx->rle_size;
+    bufpool_free(output);
+}
+
+static void run_shafa_then_rle(Context * const ctx)
+{
+    uint8_t * rle = NULL, * output = NULL;
+    unsigned long size = 0;
+
+    // What module D did before both decoders were fused (The RLE block is freed by its kernel)
+    if (bench_shafa_block_decompressor((uint8_t *) ctx->shafa_rle, ctx->shafa_rle_size, ctx->rle_size, ctx->rle_tree, &rle)
+        || bench_rle_block_decompressor(rle, ctx->rle_size, ctx->input_size, &output, &size) || size != ctx->input_size)
+        ctx->failed = true;
+    ctx->output_size = ctx->shafa_rle_size;
+    bufpool_free(output);
+}
+
+static void run_shafa_rle_block_decompressor(Context * const ctx)
+{
+    uint8_t * output = NULL;
+    unsigned long size = 0;
+
+    if (bench_shafa_rle_block_decompressor(ctx->shafa_rle, ctx->shafa_rle_size, ctx->rle_size, ctx->input_size, ctx->rle_tree, &output, &size) || size != ctx->input_size)
+        ctx->failed = true;
+    ctx->output_size = ctx->shafa_rle_size;
+    bufpool_free(output);
+}
+
+
+/**
+\brief Repeats a kernel until MIN_BENCH_TIME has elapsed (at least 3 times)
+ @param kernel Kernel to be timed
+ @param ctx Kernel's context
+ @returns Time per iteration
+*/
+static Timing time_kernel(void (* const kernel)(Context *), Context * const ctx)
+{
+    unsigned long iters = 0;
+    double start, elapsed;
+    uint64_t start_cycles;
+
+    kernel(ctx); // Warm up caches and page in buffers
+
+    start_cycles = cycles();
+    start = now();
+    do {
+        kernel(ctx);
+        ++iters;
+        elapsed = now() - start;
+    } while (elapsed < MIN_BENCH_TIME || iters < 3);
+
+    return (Timing) {
+        .seconds = elapsed / iters,
+        .cycles = (double) (cycles() - start_cycles) / iters
+    };
+}
+
+
+/**
+\brief Prints a row of the report
+ @param corpus Corpus' name
+ @param size Bytes processed per iteration
+ @param name Kernel's or module's name
+ @param timing Time taken per iteration
+ @param ratio Output/input size (negative when it doesn't apply)
+*/
+static void report(const char * const corpus, const unsigned long size, const char * const name, const Timing timing, const double ratio)
+{
+    printf("%-8s %10lu  %-28s %10.2f", corpus, size, name, size / timing.seconds / 1e6);
+
+    if (ratio >= 0)
+        printf(" %8.3f", ratio);
+    else
+        printf(" %8s", "-");
+
+    if (timing.cycles > 0)
+        printf(" %10.2f\n", timing.cycles / size);
+    else
+        printf(" %10s\n", "-");
+}
+
+
+/**
+\brief Times every kernel over a single block holding the whole corpus
+ @returns false if any kernel failed
+*/
+static bool bench_kernels(const char * const corpus, const uint8_t * const input, const unsigned long size)
+{
+    Context ctx = {.input = input, .input_size = size};
+    uint8_t * shafa = NULL, * rle = NULL, * shafa_rle = NULL, * rans = NULL, * bwt = NULL;
+    void * rle_table = NULL;
+    Timing timing;
+    bool ok = false;
+
+    ctx.scratch = malloc(size * 2 + 3);
+    ctx.codes = malloc(MAX_CODES_SIZE);
+
+    if (!ctx.scratch || !ctx.codes)
+        goto cleanup;
+
+    timing = time_kernel(run_block_compression, &ctx);
+    report(corpus, size, "block_compression", timing, (double) ctx.output_size / size);
+
+    rle = malloc(ctx.output_size);
+    if (!rle)
+        goto cleanup;
+    memcpy(rle, ctx.scratch, ctx.output_size);
+    ctx.rle = rle;
+    ctx.rle_size = ctx.output_size;
+
+    timing = time_kernel(run_make_freq, &ctx);
+    report(corpus, size, "make_freq", timing, -1);
+
+    timing = time_kernel(run_sf_codes, &ctx);
+    report(corpus, size, "sf_codes", timing, -1);
+
+    ctx.table = bench_build_table(ctx.codes);
+    ctx.tree = bench_create_tree(ctx.codes);
+    if (!ctx.table || !ctx.tree)
+        goto cleanup;
+
+    timing = time_kernel(run_binary_coding, &ctx);
+    report(corpus, size, "binary_coding", timing, (double) ctx.output_size / size);
+
+    shafa = bench_binary_coding(ctx.table, input, size, &ctx.shafa_size);
+    if (!shafa)
+        goto cleanup;
+    ctx.shafa = shafa;
+
+    timing = time_kernel(run_shafa_block_decompressor, &ctx);
+    report(corpus, size, "shafa_block_decompressor", timing, (double) ctx.output_size / size);
+
+    timing = time_kernel(run_rle_block_decompressor, &ctx);
+    report(corpus, size, "rle_block_decompressor", timing, (double) ctx.output_size / size);
+
+    // rANS from the same frequencies (Its coded block is kept apart from the scratch buffer the decoder writes to)
+    ctx.rans_table = malloc(sizeof(RansTable));
+    if (!ctx.rans_table || ans_block_freq(ctx.freq, ctx.codes) || rans_read_table(ctx.codes, ctx.rans_table))
+        goto cleanup;
+
+    timing = time_kernel(run_rans_encode, &ctx);
+    report(corpus, size, "rans_encode", timing, (double) ctx.output_size / size);
+
+    rans = malloc(ctx.output_size);
+    if (!rans)
+        goto cleanup;
+    memcpy(rans, ctx.scratch, ctx.output_size);
+    ctx.rans = rans;
+    ctx.rans_size = ctx.output_size;
+
+    timing = time_kernel(run_rans_decode, &ctx);
+    report(corpus, size, "rans_decode", timing, (double) ctx.output_size / size);
+
+    timing = time_kernel(run_bwt_encode, &ctx);
+    report(corpus, size, "bwt_encode", timing, -1);
+
+    bwt = malloc(size);
+    if (!bwt)
+        goto cleanup;
+    memcpy(bwt, ctx.scratch, size);
+    ctx.bwt = bwt;
+
+    timing = time_kernel(run_bwt_decode, &ctx);
+    report(corpus, size, "bwt_decode", timing, -1);
+    if (memcmp(ctx.scratch, input, size))
+        ctx.failed = true;
+
+    // Both decoders of module D need the RLE block coded with its own codes
+    bench_make_freq(rle, ctx.freq, ctx.rle_size);
+    bench_sf_codes(ctx.freq, ctx.codes);
+    rle_table = bench_build_table(ctx.codes);
+    ctx.rle_tree = bench_create_tree(ctx.codes);
+    if (!rle_table || !ctx.rle_tree)
+        goto cleanup;
+
+    shafa_rle = bench_binary_coding(rle_table, rle, ctx.rle_size, &ctx.shafa_rle_size);
+    if (!shafa_rle)
+        goto cleanup;
+    ctx.shafa_rle = shafa_rle;
+
+    timing = time_kernel(run_shafa_then_rle, &ctx);
+    report(corpus, size, "shafa_then_rle", timing, (double) ctx.output_size / size);
+
+    timing = time_kernel(run_shafa_rle_block_decompressor, &ctx);
+    report(corpus, size, "shafa_rle_block_decompressor", timing, (double) ctx.output_size / size);
+
+    ok = !ctx.failed;
+
+cleanup:
+    if (ctx.tree)
+        bench_free_tree(ctx.tree);
+    if (ctx.rle_tree)
+        bench_free_tree(ctx.rle_tree);
+    free(ctx.table);
+    free(rle_table);
+    free(ctx.rans_table);
+    free(rans);
+    free(bwt);
+    bufpool_free(shafa_rle);
+    free(ctx.scratch);
+    free(ctx.codes);
+    bufpool_free(shafa);
+    free(rle);
+
+    return ok;
+}
+
+
+/*
+    Modules print their own summary to stdout, which would drown the report
+*/
+static int mute_stdout(void)
+{
+#ifdef CAN_MUTE_STDOUT
+    int saved, null;
+
+    fflush(stdout);
+    saved = dup(STDOUT_FILENO);
+    null = open("/dev/null", O_WRONLY);
+    if (null >= 0) {
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+    return saved;
+#else
+    return -1;
+#endif
+}
+
+static void unmute_stdout(const int saved)
+{
+#ifdef CAN_MUTE_STDOUT
+    fflush(stdout);
+    if (saved >= 0) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+#else
+    (void) saved;
+#endif
+}
+
+/**
+\brief Runs modules F, T, C and D one at a time over a temporary copy of the corpus
+ @returns false if any module failed or the round trip didn't match
+*/
+static bool bench_modules(const char * const corpus, const uint8_t * const input, const unsigned long size, const unsigned long block_size)
+{
+    char * path, * path_shafa;
+    _modules_error error;
+    double start;
+    Timing timing = {0};
+    long shafa_size;
+    int saved;
+    bool ok = false;
+    uint8_t * check;
+    FILE * fd;
+    char name[64];
+
+    sprintf(name, "shafa_bench_%s_%lu", corpus, size);
+
+    fd = fopen(name, "wb");
+    if (!fd)
+        return false;
+    ok = fwrite(input, 1, size, fd) == size;
+    fclose(fd);
+    if (!ok)
+        return false;
+    ok = false;
+
+    path = add_ext(name, "");
+    if (!path)
+        return false;
+
+    saved = mute_stdout();
+
+    start = now();
+    error = freq_rle_compress(&path, false, false, false, false, false, block_size);
+    timing.seconds = now() - start;
+    unmute_stdout(saved);
+    if (error)
+        goto cleanup;
+    report(corpus, size, check_ext(path, RLE_EXT) ? "module F (rle)" : "module F", timing, (double) file_size(path) / size);
+
+    saved = mute_stdout();
+    start = now();
+    error = get_shafa_codes(path, false);
+    timing.seconds = now() - start;
+    unmute_stdout(saved);
+    if (error)
+        goto cleanup;
+    report(corpus, size, "module T", timing, -1);
+
+    saved = mute_stdout();
+    start = now();
+    error = shafa_compress(&path, 0);
+    timing.seconds = now() - start;
+    unmute_stdout(saved);
+    if (error)
+        goto cleanup;
+    shafa_size = file_size(path);
+    report(corpus, size, "module C", timing, (double) shafa_size / size);
+
+    path_shafa = add_ext(path, "");
+    if (!path_shafa)
+        goto cleanup;
+
+    saved = mute_stdout();
+    start = now();
+    error = shafa_decompress(&path, check_ext(path, RLE_EXT SHAFA_EXT));
+    timing.seconds = now() - start;
+    unmute_stdout(saved);
+    if (error) {
+        free(path_shafa);
+        goto cleanup;
+    }
+    report(corpus, size, "module D", timing, (double) shafa_size / size);
+
+    // Round trip check
+    check = malloc(size);
+    fd = fopen(path, "rb");
+    if (check && fd)
+        ok = fread(check, 1, size, fd) == size && !memcmp(check, input, size);
+    if (fd)
+        fclose(fd);
+    free(check);
+
+    // Remove every intermediate file
+    path_shafa[strlen(path_shafa) - strlen(SHAFA_EXT)] = '\0';
+    for (int rle = 0; rle < 2; ++rle) {
+        static const char * const EXTS[] = {FREQ_EXT, CODES_EXT, SHAFA_EXT, ""};
+        char buffer[128];
+
+        for (int e = 0; e < 4; ++e) {
+            sprintf(buffer, "%s%s%s", name, rle ? RLE_EXT : "", EXTS[e]);
+            remove(buffer);
+        }
+    }
+    free(path_shafa);
+
+cleanup:
+    free(path);
+    return ok;
+}
+
+
+/**
+\brief Compresses a temporary copy of the corpus with auto_block_size's blocks (modules F, T and C)
+ @returns false if any module failed or the codes cost more than AUTO_CODES_LIMIT of the compressed file
+*/
+static bool check_auto_block_size(const char * const corpus, const uint8_t * const input, const unsigned long size)
+{
+    char * path, * path_codes = NULL;
+    unsigned long block_size;
+    long shafa_size = 0, codes_size = 0;
+    int saved;
+    bool ok;
+    FILE * fd;
+    char name[64];
+
+    sprintf(name, "shafa_bench_auto_%s_%lu", corpus, size);
+
+    fd = fopen(name, "wb");
+    if (!fd)
+        return false;
+    ok = fwrite(input, 1, size, fd) == size;
+    fclose(fd);
+
+    path = add_ext(name, "");
+    if (!ok || !path) {
+        remove(name);
+        free(path);
+        return false;
+    }
+    ok = false;
+
+    block_size = auto_block_size(name);
+
+    saved = mute_stdout();
+    if (!freq_rle_compress(&path, false, false, false, false, false, block_size) && !get_shafa_codes(path, false)) {
+        path_codes = add_ext(path, CODES_EXT);
+        if (path_codes && !shafa_compress(&path, 0)) {
+            shafa_size = file_size(path);
+            codes_size = file_size(path_codes);
+            ok = shafa_size > 0 && codes_size > 0 && codes_size <= shafa_size * AUTO_CODES_LIMIT;
+        }
+    }
+    unmute_stdout(saved);
+
+    if (shafa_size > 0)
+        printf("%-8s %10lu  auto block size %lu: .cod is %.2f%% of .shaf\n", corpus, size, block_size, 100.0 * codes_size / shafa_size);
+
+    for (int rle = 0; rle < 2; ++rle) {
+        static const char * const EXTS[] = {FREQ_EXT, CODES_EXT, SHAFA_EXT, ""};
+        char buffer[128];
+
+        for (int e = 0; e < 4; ++e) {
+            sprintf(buffer, "%s%s%s", name, rle ? RLE_EXT : "", EXTS[e]);
+            remove(buffer);
+        }
+    }
+    free(path_codes);
+    free(path);
+
+    return ok;
+}
+
+
+/**
+\brief Module D must refuse a .cod file whose number of blocks isn't the .shaf file's (Both more and fewer of them)
+ @returns false if module D decompressed either of them
+*/
+static bool check_block_count_mismatch(const char * const corpus, const uint8_t * const input, const unsigned long size)
+{
+    char * path = NULL, * path_codes = NULL, * codes = NULL;
+    unsigned long long num_blocks;
+    long codes_size;
+    int saved, start;
+    bool ok = false;
+    FILE * fd;
+    char name[64], mode[8];
+
+    sprintf(name, "shafa_bench_blocks_%s_%lu", corpus, size);
+
+    fd = fopen(name, "wb");
+    if (!fd)
+        return false;
+    ok = fwrite(input, 1, size, fd) == size;
+    fclose(fd);
+
+    path = ok ? add_ext(name, "") : NULL;
+    ok = false;
+
+    saved = mute_stdout();
+    if (path && !freq_rle_compress(&path, false, false, false, false, false, _64KiB) && !get_shafa_codes(path, false)
+        && (path_codes = add_ext(path, CODES_EXT)) && !shafa_compress(&path, 0)
+        && (codes_size = file_size(path_codes)) > 0 && (codes = malloc(codes_size + 1))) {
+
+        fd = fopen(path_codes, "rb");
+        ok = fd && fread(codes, 1, codes_size, fd) == (size_t) codes_size;
+        if (fd)
+            fclose(fd);
+        codes[ok ? codes_size : 0] = '\0';
+
+        ok = ok && sscanf(codes, "@%7[^@]@%llu%n", mode, &num_blocks, &start) == 2 && num_blocks > 1;
+
+        // The .cod file is written back with one block more and then one less than the .shaf file
+        for (int delta = 1; ok && delta >= -1; delta -= 2) {
+            fd = fopen(path_codes, "wb");
+            if (!fd || fprintf(fd, "@%s@%llu%s", mode, num_blocks + delta, codes + start) < 0)
+                ok = false;
+            if (fd)
+                fclose(fd);
+
+            ok = ok && shafa_decompress(&path, check_ext(path, RLE_EXT SHAFA_EXT)) == _FILE_UNRECOGNIZABLE;
+        }
+    }
+    unmute_stdout(saved);
+
+    for (int rle = 0; rle < 2; ++rle) {
+        static const char * const EXTS[] = {FREQ_EXT, CODES_EXT, SHAFA_EXT, ""};
+        char buffer[128];
+
+        for (int e = 0; e < 4; ++e) {
+            sprintf(buffer, "%s%s%s", name, rle ? RLE_EXT : "", EXTS[e]);
+            remove(buffer);
+        }
+    }
+    free(codes);
+    free(path_codes);
+    free(path);
+
+    return ok;
+}
+
+
+int main(const int argc, char * const argv[])
+{
+    static const unsigned long SIZES[] = {_64KiB, _640KiB, _8MiB, _64MiB};
+    unsigned long max_size = _8MiB;
+    uint8_t * input;
+    bool ok = true;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--no-multithread"))
+            NO_MULTITHREAD = true;
+        else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            switch (argv[++i][0]) {
+                case 'K': max_size = _640KiB; break;
+                case 'm': max_size = _8MiB; break;
+                case 'M': max_size = _64MiB; break;
+                default:
+                    fputs("Wrong Options' syntax\n", stderr);
+                    return 1;
+            }
+        }
+        else {
+            fputs("Usage: shafa_bench [-b <K/m/M>] [--no-multithread]\n", stderr);
+            return 1;
+        }
+    }
+
+    input = malloc(max_size);
+    if (!input) {
+        fputs("Not enough memory\n", stderr);
+        return 1;
+    }
+
+    printf("%-8s %10s  %-28s %10s %8s %10s\n", "corpus", "bytes", "kernel", "MB/s", "ratio", "cycles/B");
+
+    for (int corpus = 0; corpus < NUM_CORPORA; ++corpus) {
+        for (int s = 0; s < 4 && SIZES[s] <= max_size; ++s) {
+
+            generate_corpus(corpus, input, SIZES[s]);
+
+            if (!bench_kernels(CORPUS_NAMES[corpus], input, SIZES[s])) {
+                fprintf(stderr, "Kernels failed on %s (%lu bytes)\n", CORPUS_NAMES[corpus], SIZES[s]);
+                ok = false;
+            }
+
+            if (!bench_modules(CORPUS_NAMES[corpus], input, SIZES[s], _64KiB)) {
+                fprintf(stderr, "Modules failed on %s (%lu bytes)\n", CORPUS_NAMES[corpus], SIZES[s]);
+                ok = false;
+            }
+
+            // Runs leave few symbols behind RLE so their codes are the ones auto_block_size underestimates the most
+            if (corpus == CORPUS_RUNS && SIZES[s] >= _8MiB && !check_auto_block_size(CORPUS_NAMES[corpus], input, SIZES[s])) {
+                fprintf(stderr, "Codes cost too much with auto_block_size on %s (%lu bytes)\n", CORPUS_NAMES[corpus], SIZES[s]);
+                ok = false;
+            }
+
+            if (SIZES[s] == _640KiB && !check_block_count_mismatch(CORPUS_NAMES[corpus], input, SIZES[s])) {
+                fprintf(stderr, "Module D didn't refuse a .cod file with a different number of blocks on %s (%lu bytes)\n", CORPUS_NAMES[corpus], SIZES[s]);
+                ok = false;
+            }
+        }
+    }
+
+    free(input);
+
+    return !ok;
+}
@@ -0,0 +1,30 @@
+#ifndef BENCH_KERNELS_H
+#define BENCH_KERNELS_H
+
+#include <stdint.h>
+
+/*
+    Thin non-static wrappers around each module's hot kernels.
+    Every kernels_<module>.c includes the respective module's translation unit
+    so the static functions can be timed in isolation without changing their linkage.
+*/
+
+// Module F
+unsigned long bench_block_compression(const uint8_t * buffer, uint8_t * block, unsigned long size);
+void bench_make_freq(const uint8_t * block, unsigned long * freq, unsigned long size);
+
+// Module T
+void bench_sf_codes(const unsigned long * freq, char * block_codes);
+
+// Module C
+void * bench_build_table(const char * block_codes);
+uint8_t * bench_binary_coding(void * table, const uint8_t * block_input, unsigned long block_size, unsigned long * new_block_size);
+
+// Module D
+void * bench_create_tree(const char * block_codes);
+void bench_free_tree(void * tree);
+int bench_shafa_block_decompressor(uint8_t * shafa, unsigned long shafa_size, unsigned long block_size, void * tree, uint8_t ** decomp);
+int bench_rle_block_decompressor(uint8_t * rle, unsigned long rle_size, unsigned long original_size, uint8_t ** decomp, unsigned long * decomp_size);
+int bench_shafa_rle_block_decompressor(const uint8_t * shafa, unsigned long shafa_size, unsigned long rle_size, unsigned long original_size, void * tree, uint8_t ** decomp, unsigned long * decomp_size);
+
+#endif //BENCH_KERNELS_H
@@ -0,0 +1,21 @@
+#include "../src/modules/c.c"
+#include "kernels.h"
+
+
+void * bench_build_table(const char * const block_codes)
+{
+    CodesIndex (* table)[NUM_SYMBOLS] = calloc(1, sizeof(CodesIndex[NUM_OFFSETS][NUM_SYMBOLS]));
+
+    if (table && build_table(block_codes, table)) {
+        free(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+
+uint8_t * bench_binary_coding(void * const table, const uint8_t * const block_input, const unsigned long block_size, unsigned long * const new_block_size)
+{
+    return binary_coding(table, block_input, block_size, coded_size(table, block_input, block_size), 0, NULL, new_block_size);
+}
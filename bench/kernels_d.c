@@ -0,0 +1,54 @@
+#include "../src/modules/d.c"
+#include "kernels.h"
+
+
+void * bench_create_tree(const char * const block_codes)
+{
+    BTree decoder;
+    _modules_error error;
+
+    error = create_tree(block_codes, &decoder);
+
+    if (error) {
+        free_tree(decoder);
+        return NULL;
+    }
+
+    return decoder;
+}
+
+
+void bench_free_tree(void * const tree)
+{
+    free_tree(tree);
+}
+
+
+int bench_shafa_block_decompressor(uint8_t * const shafa, const unsigned long shafa_size, const unsigned long block_size, void * const tree, uint8_t ** const decomp)
+{
+    return shafa_block_decompressor(shafa, shafa_size, block_size, tree, decomp);
+}
+
+
+int bench_rle_block_decompressor(uint8_t * const rle, const unsigned long rle_size, const unsigned long original_size, uint8_t ** const decomp, unsigned long * const decomp_size)
+{
+    int error;
+    ArgumentsRLE args = {
+        .buffer = rle, // Freed by the kernel
+        .rle_block_size = rle_size,
+        .original_size = original_size,
+        .rle_v2 = true, // Module F only writes version 2
+        .final_sizes = decomp_size
+    };
+
+    error = rle_block_decompressor(&args);
+    *decomp = args.sequence;
+
+    return error;
+}
+
+
+int bench_shafa_rle_block_decompressor(const uint8_t * const shafa, const unsigned long shafa_size, const unsigned long rle_size, const unsigned long original_size, void * const tree, uint8_t ** const decomp, unsigned long * const decomp_size)
+{
+    return shafa_rle_block_decompressor(shafa, shafa_size, rle_size, original_size, true, tree, decomp, decomp_size);
+}
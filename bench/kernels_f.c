@@ -0,0 +1,14 @@
+#include "../src/modules/f.c"
+#include "kernels.h"
+
+
+unsigned long bench_block_compression(const uint8_t * const buffer, uint8_t * const block, const unsigned long size)
+{
+    return block_compression(buffer, block, size, size);
+}
+
+
+void bench_make_freq(const uint8_t * const block, unsigned long * const freq, const unsigned long size)
+{
+    make_freq(block, freq, size);
+}
@@ -0,0 +1,23 @@
+#include "../src/modules/t.c"
+#include "kernels.h"
+
+
+void bench_sf_codes(const unsigned long * const freq, char * block_codes)
+{
+    unsigned long frequencies[NUM_SYMBOLS];
+    int positions[NUM_SYMBOLS];
+    static char codes[NUM_SYMBOLS][NUM_SYMBOLS];
+
+    memcpy(frequencies, freq, sizeof(frequencies));
+    memset(codes, 0, sizeof(codes));
+
+    for (int i = 0; i < NUM_SYMBOLS; ++i)
+        positions[i] = i;
+
+    insert_sort(frequencies, positions, 0, NUM_SYMBOLS - 1);
+    sf_codes(frequencies, codes, 0, not_null(frequencies));
+
+    // Same layout as a block of the .cod file
+    for (int i = 0; i < NUM_SYMBOLS; ++i)
+        block_codes += sprintf(block_codes, i < NUM_SYMBOLS - 1 ? "%s;" : "%s", codes[positions[i]]);
+}
@@ -0,0 +1,754 @@
+/************************************************
+ *
+ *  Author(s): agent
+ *  Created Date: 19 Oct 2026
+ *  Updated Date: 19 Oct 2026
+ *
+ ***********************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "f.h"
+#include "t.h"
+#include "c.h"
+#include "d.h"
+#include "utils/file.h"
+#include "utils/stats.h"
+#include "utils/errors.h"
+#include "utils/header.h"
+#include "utils/extensions.h"
+#include "utils/multithread.h"
+
+#define ARCHIVE_MAGIC "@SFA"
+#define TRAILER_SIZE 21 // '@' + 20 digits with the central directory's offset
+#define COPY_BUFFER_SIZE _64KiB
+
+/*
+                                                Archive's layout
+
+    @SFA                                                          Magic
+    <.cod><.shaf> | <original content>                            Every member (in the order they were packed)
+    @<num_members>                                                Central directory
+        @<len_name>@<name>@<mode>@<size>@<cod_offset>@<cod_size>@<shaf_offset>@<shaf_size>@<num_blocks>(@<block_offset>)*
+    @<directory_offset>                                           Trailer (Zero padded to TRAILER_SIZE)
+
+    Modes: 'R' (RLE & Shannon-Fano), 'N' (Shannon-Fano) or 'S' (Stored, too small to be compressed: only shaf_* are used)
+    Blocks' offsets point to each block's header (see utils/header.h) of the member's .shaf content so a block can be read without the previous ones
+*/
+
+/*
+    Central directory's entry
+*/
+typedef struct {
+    char * name;
+    char mode;
+    unsigned long long size;
+    unsigned long long cod_offset;
+    unsigned long long cod_size;
+    unsigned long long shaf_offset;
+    unsigned long long shaf_size;
+    unsigned long long num_blocks;
+    unsigned long long * block_offsets;
+    bool selected;
+} Member;
+
+/*
+    Everything shared by the threads creating/extracting an archive
+*/
+typedef struct {
+    const char * path;
+    FILE * fd_archive;
+    char * const * files;
+    Member * members;
+    size_t num_members;
+    size_t next;
+    unsigned long block_size;
+    bool force_rle;
+    bool failed;
+} Archive;
+
+
+/**
+\brief Copies bytes from a stream to another
+ @param fd_src Source's stream
+ @param fd_dst Destination's stream
+ @param size Number of bytes
+ @returns Error status
+*/
+static _modules_error copy_bytes(FILE * const fd_src, FILE * const fd_dst, unsigned long long size)
+{
+    _modules_error error = _SUCCESS;
+    uint8_t * buffer = malloc(COPY_BUFFER_SIZE);
+    size_t chunk;
+
+    if (!buffer)
+        return _LACK_OF_MEMORY;
+
+    for ( ; size && !error; size -= chunk) {
+        chunk = size < COPY_BUFFER_SIZE ? size : COPY_BUFFER_SIZE;
+
+        if (fread(buffer, sizeof(uint8_t), chunk, fd_src) != chunk || fwrite(buffer, sizeof(uint8_t), chunk, fd_dst) != chunk)
+            error = _FILE_STREAM_FAILED;
+    }
+
+    free(buffer);
+
+    return error;
+}
+
+
+/**
+\brief Appends a whole file to the archive
+ @param fd_archive Archive's stream
+ @param path File's path
+ @param offset Where to save the offset where it starts
+ @param size Where to save its size
+ @returns Error status
+*/
+static _modules_error append_file(FILE * const fd_archive, const char * const path, unsigned long long * const offset, unsigned long long * const size)
+{
+    _modules_error error;
+    long long file_bytes = file_size(path);
+    FILE * fd;
+
+    if (file_bytes < 0)
+        return _FILE_INACCESSIBLE;
+
+    fd = fopen(path, "rb");
+    if (!fd)
+        return _FILE_INACCESSIBLE;
+
+    *offset = ftell(fd_archive);
+    *size = file_bytes;
+    error = copy_bytes(fd, fd_archive, file_bytes);
+
+    fclose(fd);
+
+    return error;
+}
+
+
+/**
+\brief Appends a .shaf file to the archive saving where each block starts
+ @param fd_archive Archive's stream
+ @param path .shaf file's path
+ @param member Member to be filled with the offsets
+ @returns Error status
+*/
+static _modules_error append_shafa(FILE * const fd_archive, const char * const path, Member * const member)
+{
+    _modules_error error = _SUCCESS;
+    BlockHeader header;
+    FILE * fd_shafa;
+
+    fd_shafa = fopen(path, "rb");
+    if (!fd_shafa)
+        return _FILE_INACCESSIBLE;
+
+    member->shaf_offset = ftell(fd_archive);
+
+    if (fscanf(fd_shafa, "@%llu", &member->num_blocks) == 1) {
+
+        member->block_offsets = malloc(member->num_blocks * sizeof(unsigned long long));
+
+        if (member->block_offsets) {
+
+            if (fprintf(fd_archive, "@%llu", member->num_blocks) < 2)
+                error = _FILE_STREAM_FAILED;
+
+            for (unsigned long long i = 0; i < member->num_blocks && !error; ++i) {
+
+                member->block_offsets[i] = ftell(fd_archive);
+
+                error = read_block_header(fd_shafa, &header);
+
+                if (!error)
+                    error = write_block_header(fd_archive, &header);
+
+                if (!error)
+                    error = copy_bytes(fd_shafa, fd_archive, header.size);
+
+                free(header.restarts);
+            }
+        }
+        else
+            error = _LACK_OF_MEMORY;
+    }
+    else
+        error = _FILE_UNRECOGNIZABLE;
+
+    member->shaf_size = ftell(fd_archive) - member->shaf_offset;
+
+    fclose(fd_shafa);
+
+    return error;
+}
+
+
+/**
+\brief Removes a file whose path is the given one with an extension (if there's a path)
+*/
+static void remove_with_ext(const char * const path, const char * const ext)
+{
+    char * tmp_path;
+
+    if (path && (tmp_path = add_ext(path, ext))) {
+        remove(tmp_path);
+        free(tmp_path);
+    }
+}
+
+
+/**
+\brief Name under which a file is saved: relative and with '/' as separator
+ @param path File's path
+ @returns Allocated name or NULL if there's no memory
+*/
+static char * member_name(const char * path)
+{
+    char * name;
+
+    for (;;) {
+        if (*path == '/' || *path == '\\')
+            ++path;
+        else if (path[0] == '.' && (path[1] == '/' || path[1] == '\\'))
+            path += 2;
+        else
+            break;
+    }
+
+    name = add_ext(path, "");
+
+    for (char * c = name; c && *c; ++c)
+        if (*c == '\\')
+            *c = '/';
+
+    return name;
+}
+
+
+/**
+\brief Checks whether a member's name stays inside the current directory (No absolute paths, drives or "..")
+*/
+static bool safe_name(const char * const name)
+{
+    const char * component = name;
+
+    if (!*name || *name == '/' || strchr(name, ':') || strchr(name, '\\'))
+        return false;
+
+    for (const char * c = name; ; ++c) {
+        if (*c == '/' || !*c) {
+            if (c - component == 2 && component[0] == '.' && component[1] == '.')
+                return false;
+            if (!*c)
+                break;
+            component = c + 1;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+\brief Compresses a file with modules F, T and C and appends it to the archive
+ @param archive Archive being created
+ @param file File's path
+ @param member Member to be filled
+ @returns Error status
+*/
+static _modules_error pack_member(Archive * const archive, const char * const file, Member * const member)
+{
+    _modules_error error = _SUCCESS;
+    long long size = file_size(file);
+    char * path, * path_base = NULL, * path_codes;
+    bool stored;
+
+    if (size < 0)
+        return _FILE_INACCESSIBLE;
+
+    member->size = size;
+
+    path = add_ext(file, "");
+    if (!path)
+        return _LACK_OF_MEMORY;
+
+    // Module F refuses files this small so they are kept as they are
+    stored = size < _1KiB;
+
+    if (!stored) {
+        stats_stage_start();
+        error = freq_rle_compress(&path, archive->force_rle, false, false, false, false, archive->block_size ? archive->block_size : auto_block_size(file));
+    }
+
+    if (!error && !stored) {
+
+        // Every other intermediate file is named after F's output
+        path_base = add_ext(path, "");
+
+        if (path_base) {
+            member->mode = check_ext(path_base, RLE_EXT) ? 'R' : 'N';
+
+            stats_stage_start();
+            error = get_shafa_codes(path, false);
+
+            if (!error) {
+                stats_stage_start();
+                error = shafa_compress(&path, 0);
+            }
+        }
+        else
+            error = _LACK_OF_MEMORY;
+    }
+
+    if (!error) {
+
+        // Every member shares the archive's stream
+        multithread_lock();
+
+        if (stored) {
+            member->mode = 'S';
+            error = append_file(archive->fd_archive, file, &member->shaf_offset, &member->shaf_size);
+        }
+        else {
+            path_codes = add_ext(path_base, CODES_EXT);
+
+            if (path_codes) {
+                error = append_file(archive->fd_archive, path_codes, &member->cod_offset, &member->cod_size);
+                free(path_codes);
+            }
+            else
+                error = _LACK_OF_MEMORY;
+
+            if (!error)
+                error = append_shafa(archive->fd_archive, path, member);
+        }
+
+        if (ferror(archive->fd_archive) && !error)
+            error = _FILE_STREAM_FAILED;
+
+        multithread_unlock();
+    }
+
+    // Intermediate files are removed even when something failed (The original is never touched)
+    if (path_base) {
+        remove_with_ext(path_base, FREQ_EXT);
+        remove_with_ext(path_base, CODES_EXT);
+        remove_with_ext(path_base, SHAFA_EXT);
+        if (member->mode == 'R')
+            remove(path_base);
+        free(path_base);
+    }
+
+    free(path);
+
+    if (!error) {
+        member->name = member_name(file);
+        if (!member->name)
+            error = _LACK_OF_MEMORY;
+    }
+
+    return error;
+}
+
+
+/**
+\brief Thread which keeps packing the next file until there are none left
+ @param _archive Archive being created
+*/
+static void pack_driver(void * const _archive)
+{
+    Archive * const archive = (Archive *) _archive;
+    _modules_error error;
+    size_t index;
+
+    for (;;) {
+        multithread_lock();
+        index = archive->next++;
+        multithread_unlock();
+
+        if (index >= archive->num_members)
+            break;
+
+        error = pack_member(archive, archive->files[index], &archive->members[index]);
+
+        if (error) {
+            multithread_lock();
+            archive->failed = true;
+            if (error != _OUTSIDE_MODULE)
+                fprintf(stderr, "%s: %s", archive->files[index], error_msg(error));
+            multithread_unlock();
+        }
+    }
+}
+
+
+/**
+\brief Writes the central directory and the trailer
+ @param archive Archive being created
+ @param num_packed Where to save the number of members which were packed
+ @returns Error status
+*/
+static _modules_error write_directory(Archive * const archive, size_t * const num_packed)
+{
+    FILE * const fd_archive = archive->fd_archive;
+    const unsigned long long directory_offset = ftell(fd_archive);
+    Member * member;
+
+    *num_packed = 0;
+    for (size_t i = 0; i < archive->num_members; ++i)
+        if (archive->members[i].name)
+            ++*num_packed;
+
+    fprintf(fd_archive, "@%zu", *num_packed);
+
+    for (size_t i = 0; i < archive->num_members; ++i) {
+        member = &archive->members[i];
+
+        if (!member->name)
+            continue;
+
+        fprintf(
+            fd_archive, "@%zu@%s@%c@%llu@%llu@%llu@%llu@%llu@%llu",
+            strlen(member->name), member->name, member->mode, member->size,
+            member->cod_offset, member->cod_size, member->shaf_offset, member->shaf_size, member->num_blocks
+        );
+
+        for (unsigned long long j = 0; j < member->num_blocks; ++j)
+            fprintf(fd_archive, "@%llu", member->block_offsets[j]);
+    }
+
+    fprintf(fd_archive, "@%020llu", directory_offset);
+
+    return ferror(fd_archive) ? _FILE_STREAM_FAILED : _SUCCESS;
+}
+
+
+/**
+\brief Frees every member's allocated fields and the array itself
+*/
+static void free_members(Member * const members, const size_t num_members)
+{
+    for (size_t i = 0; members && i < num_members; ++i) {
+        free(members[i].name);
+        free(members[i].block_offsets);
+    }
+
+    free(members);
+}
+
+
+/**
+\brief Prints the results of the program execution
+ @param operation What was done to the archive
+ @param num_members Number of members
+ @param input_size Sum of the members' sizes before
+ @param output_size Sum of the members' sizes after
+ @param total_time Time that the module took to execute
+ @param path The path to the archive
+*/
+static inline void print_summary(const char * const operation, const size_t num_members, const unsigned long long input_size, const unsigned long long output_size, const double total_time, const char * const path)
+{
+    printf(
+        "Module: A (%s)\n"
+        "Number of members: %zu\n"
+        "Size before/after: %llu/%llu\n"
+        "Module runtime (milliseconds): %f\n"
+        "Archive %s\n",
+        operation, num_members, input_size, output_size, total_time, path
+    );
+}
+
+
+_modules_error archive_create(const char * const path, char * const files[], const size_t num_files, const unsigned long block_size, const bool force_rle)
+{
+    _modules_error error;
+    double start_time = clock_wall_ms();
+    unsigned long long input_size = 0;
+    size_t num_packed;
+    int num_drivers = multithread_num_cores();
+    Archive archive = {
+        .path = path,
+        .files = files,
+        .num_members = num_files,
+        .block_size = block_size,
+        .force_rle = force_rle
+    };
+
+    archive.members = calloc(num_files ? num_files : 1, sizeof(Member));
+    if (!archive.members)
+        return _LACK_OF_MEMORY;
+
+    archive.fd_archive = fopen(path, "wb");
+
+    if (archive.fd_archive) {
+
+        if (fputs(ARCHIVE_MAGIC, archive.fd_archive) >= 0) {
+
+            if ((size_t) num_drivers > num_files)
+                num_drivers = (int) num_files;
+
+            error = multithread_spawn(num_drivers, pack_driver, &archive);
+
+            if (!error)
+                error = write_directory(&archive, &num_packed);
+        }
+        else
+            error = _FILE_STREAM_FAILED;
+
+        if (fclose(archive.fd_archive) && !error)
+            error = _FILE_STREAM_FAILED;
+
+        if (!error && archive.failed)
+            error = _OUTSIDE_MODULE;
+
+        if (!error && STATS != STATS_NONE && STATS != STATS_JSON) {
+            for (size_t i = 0; i < num_files; ++i)
+                input_size += archive.members[i].size;
+
+            print_summary("Archive creation", num_packed, input_size, file_size(path), clock_wall_ms() - start_time, path);
+        }
+    }
+    else
+        error = _FILE_INACCESSIBLE;
+
+    free_members(archive.members, num_files);
+
+    return error;
+}
+
+
+/**
+\brief Loads the central directory of an archive
+ @param fd_archive Archive's stream
+ @param members Where to save the allocated members
+ @param num_members Where to save the number of members
+ @returns Error status
+*/
+static _modules_error read_directory(FILE * const fd_archive, Member ** const members, size_t * const num_members)
+{
+    _modules_error error = _SUCCESS;
+    unsigned long long directory_offset;
+    char magic[sizeof(ARCHIVE_MAGIC)] = {0};
+    size_t len_name;
+    Member * member;
+
+    *members = NULL;
+    *num_members = 0;
+
+    if (fread(magic, sizeof(char), sizeof(ARCHIVE_MAGIC) - 1, fd_archive) != sizeof(ARCHIVE_MAGIC) - 1 || strcmp(magic, ARCHIVE_MAGIC))
+        return _FILE_UNRECOGNIZABLE;
+
+    if (fseek(fd_archive, -TRAILER_SIZE, SEEK_END) || fscanf(fd_archive, "@%llu", &directory_offset) != 1 || fseek(fd_archive, directory_offset, SEEK_SET))
+        return _FILE_UNRECOGNIZABLE;
+
+    if (fscanf(fd_archive, "@%zu", num_members) != 1)
+        return _FILE_UNRECOGNIZABLE;
+
+    *members = calloc(*num_members ? *num_members : 1, sizeof(Member));
+    if (!*members)
+        return _LACK_OF_MEMORY;
+
+    for (size_t i = 0; i < *num_members && !error; ++i) {
+        member = &(*members)[i];
+
+        if (fscanf(fd_archive, "@%zu@", &len_name) != 1) {
+            error = _FILE_UNRECOGNIZABLE;
+            break;
+        }
+
+        member->name = malloc(len_name + 1);
+        if (!member->name) {
+            error = _LACK_OF_MEMORY;
+            break;
+        }
+
+        member->name[len_name] = '\0';
+
+        if (
+            fread(member->name, sizeof(char), len_name, fd_archive) != len_name ||
+            fscanf(
+                fd_archive, "@%c@%llu@%llu@%llu@%llu@%llu@%llu",
+                &member->mode, &member->size, &member->cod_offset, &member->cod_size,
+                &member->shaf_offset, &member->shaf_size, &member->num_blocks
+            ) != 7 ||
+            (member->mode != 'R' && member->mode != 'N' && member->mode != 'S')
+        ) {
+            error = _FILE_UNRECOGNIZABLE;
+            break;
+        }
+
+        member->block_offsets = malloc((member->num_blocks ? member->num_blocks : 1) * sizeof(unsigned long long));
+        if (!member->block_offsets) {
+            error = _LACK_OF_MEMORY;
+            break;
+        }
+
+        for (unsigned long long j = 0; j < member->num_blocks && !error; ++j)
+            if (fscanf(fd_archive, "@%llu", &member->block_offsets[j]) != 1)
+                error = _FILE_UNRECOGNIZABLE;
+    }
+
+    return error;
+}
+
+
+/**
+\brief Extracts a single member
+ @param fd_shafa Archive's stream for the .shaf content (or the stored one)
+ @param fd_codes Archive's stream for the .cod content
+ @param member Member to be extracted
+ @returns Error status
+*/
+static _modules_error unpack_member(FILE * const fd_shafa, FILE * const fd_codes, const Member * const member)
+{
+    _modules_error error;
+    FILE * fd_file;
+
+    if (!safe_name(member->name))
+        return _FILE_UNRECOGNIZABLE;
+
+    error = make_parent_dirs(member->name);
+    if (error)
+        return error;
+
+    if (fseek(fd_shafa, member->shaf_offset, SEEK_SET))
+        return _FILE_STREAM_FAILED;
+
+    if (member->mode == 'S') {
+
+        fd_file = fopen(member->name, "wb");
+        if (!fd_file)
+            return _FILE_INACCESSIBLE;
+
+        error = copy_bytes(fd_shafa, fd_file, member->size);
+
+        if (fclose(fd_file) && !error)
+            error = _FILE_STREAM_FAILED;
+
+        return error;
+    }
+
+    if (fseek(fd_codes, member->cod_offset, SEEK_SET))
+        return _FILE_STREAM_FAILED;
+
+    stats_stage_start();
+
+    return shafa_decompress_member(fd_shafa, fd_codes, member->mode == 'R', member->name, member->block_offsets, member->num_blocks);
+}
+
+
+/**
+\brief Thread which keeps extracting the next selected member until there are none left (Each one has its own streams)
+ @param _archive Archive being extracted
+*/
+static void unpack_driver(void * const _archive)
+{
+    Archive * const archive = (Archive *) _archive;
+    _modules_error error = _SUCCESS;
+    FILE * fd_shafa, * fd_codes = NULL;
+    size_t index;
+    Member * member;
+
+    fd_shafa = fopen(archive->path, "rb");
+    if (fd_shafa)
+        fd_codes = fopen(archive->path, "rb");
+
+    for (;;) {
+        multithread_lock();
+        index = archive->next++;
+        multithread_unlock();
+
+        if (index >= archive->num_members)
+            break;
+
+        member = &archive->members[index];
+        if (!member->selected)
+            continue;
+
+        error = fd_codes ? unpack_member(fd_shafa, fd_codes, member) : _FILE_INACCESSIBLE;
+
+        if (error) {
+            multithread_lock();
+            archive->failed = true;
+            fprintf(stderr, "%s: %s", member->name, error_msg(error));
+            multithread_unlock();
+        }
+    }
+
+    if (fd_shafa)
+        fclose(fd_shafa);
+    if (fd_codes)
+        fclose(fd_codes);
+}
+
+
+_modules_error archive_extract(const char * const path, char * const members[], const size_t num_members)
+{
+    _modules_error error;
+    double start_time = clock_wall_ms();
+    unsigned long long input_size = 0, output_size = 0;
+    size_t num_selected = 0;
+    int num_drivers = multithread_num_cores();
+    bool found;
+    Archive archive = {.path = path};
+    FILE * fd_archive;
+
+    fd_archive = fopen(path, "rb");
+    if (!fd_archive)
+        return _FILE_INACCESSIBLE;
+
+    error = read_directory(fd_archive, &archive.members, &archive.num_members);
+    fclose(fd_archive);
+
+    // Every member or only the ones asked for
+    for (size_t i = 0; i < archive.num_members && !error; ++i)
+        archive.members[i].selected = !num_members;
+
+    for (size_t i = 0; i < num_members && !error; ++i) {
+        found = false;
+
+        for (size_t j = 0; j < archive.num_members; ++j) {
+            if (!strcmp(members[i], archive.members[j].name)) {
+                archive.members[j].selected = found = true;
+                break;
+            }
+        }
+
+        if (!found) {
+            fprintf(stderr, "%s: Not in the archive\n", members[i]);
+            archive.failed = true;
+        }
+    }
+
+    if (!error) {
+
+        for (size_t i = 0; i < archive.num_members; ++i) {
+            if (archive.members[i].selected) {
+                ++num_selected;
+                input_size += archive.members[i].cod_size + archive.members[i].shaf_size;
+                output_size += archive.members[i].size;
+            }
+        }
+
+        if ((size_t) num_drivers > num_selected)
+            num_drivers = num_selected ? (int) num_selected : 1;
+
+        error = multithread_spawn(num_drivers, unpack_driver, &archive);
+
+        if (!error && archive.failed)
+            error = _OUTSIDE_MODULE;
+
+        if (!error && STATS != STATS_NONE && STATS != STATS_JSON)
+            print_summary("Archive extraction", num_selected, input_size, output_size, clock_wall_ms() - start_time, path);
+    }
+
+    free_members(archive.members, archive.num_members);
+
+    return error;
+}
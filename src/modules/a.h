@@ -0,0 +1,31 @@
+#ifndef MODULE_A_H
+#define MODULE_A_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "utils/errors.h"
+
+/**
+\brief Compresses many files (modules F, T and C) into a single archive with a central directory of names, sizes and blocks' offsets.
+       Every intermediate file (.rle, .freq, .cod and .shaf) is removed once its member is packed
+ @param path Archive's path
+ @param files Files' paths (Largest first packs faster)
+ @param num_files Number of files
+ @param block_size Blocks size for compression (0 -> Chosen for each file with auto_block_size)
+ @param force_rle Force execution of RLE's algorithm even if % of compression <= 5%
+ @returns Error status (_OUTSIDE_MODULE if some file failed since each one was already reported)
+*/
+_modules_error archive_create(const char * path, char * const files[], size_t num_files, unsigned long block_size, bool force_rle);
+
+
+/**
+\brief Extracts members of an archive (in parallel) into the current directory without reading the other members
+ @param path Archive's path
+ @param members Members' names to be extracted
+ @param num_members Number of members' names (0 extracts every member)
+ @returns Error status (_OUTSIDE_MODULE if some member failed since each one was already reported)
+*/
+_modules_error archive_extract(const char * path, char * const members[], size_t num_members);
+
+#endif //MODULE_A_H
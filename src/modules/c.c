@@ -10,14 +10,25 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
 
+#include "utils/perf.h"
+#include "utils/stats.h"
+#include "utils/trace.h"
 #include "utils/errors.h"
+#include "utils/header.h"
+#include "utils/rans.h"
+#include "utils/blockio.h"
+#include "utils/bufpool.h"
 #include "utils/extensions.h"
 #include "utils/multithread.h"
 
 #define MAX_CODE_INT 32
 #define NUM_SYMBOLS 256
 #define NUM_OFFSETS 8
+#define STORED_MIN_GAIN_SHIFT 5 // Blocks are stored unless Shannon-Fano saves at least 1/2^5 (~3%) of their size
+#define MAX_ACC_CODE 56 // Longest code added to the bits' accumulator at once (Which still has up to 7 bits not written)
 
 /**
  Struct with the symbol code, next and index which represent each row of the table for compression
@@ -28,84 +39,140 @@ typedef struct {
     uint8_t code[MAX_CODE_INT + 1];
 } CodesIndex;
 
+/**
+ Struct with a symbol's code after a given context (Order-1 blocks)
+*/
+typedef struct {
+    uint64_t value; // The code's bits (Only if it isn't longer than MAX_ACC_CODE)
+    int length;
+    uint8_t code[MAX_CODE_INT + 1]; // The code's bits from the most significant one of the first byte
+} ContextCode;
+
 /**
  Struct containing parameters passed to the functions which run in multithread
 */
 typedef struct {
     unsigned long block_size;
-    FILE * fd_shafa;
+    BlockWriter * writer;
     char * block_codes;
     uint8_t * block_input;
     uint8_t * block_output;
     unsigned long * new_block_size;
+    double * entropy;
+    unsigned long original_size;
+    unsigned long bwt_index; // Primary index of a block transformed with Burrows-Wheeler before RLE (0 -> None)
+    unsigned long long * block_offset; // Where the block's header is written (For the table of blocks' offsets)
+    unsigned long restart_interval; // Symbols between restart points (0 -> None)
+    unsigned long long * restarts;  // Bit where each restart point starts
+    unsigned long num_restarts;
+    bool ans; // Coded with rANS (block_codes has the normalized frequencies)
+    bool order1; // Coded with the codes of each context (block_codes has them before the block's own ones)
+    bool rle;
+    bool stored;
+    bool hole;
 } Arguments;
 
 
+/**
+\brief Exact size of a block once coded (Counting each symbol is much cheaper than coding it)
+ @param table Table of codes
+ @param block_input Block with original file's bytes
+ @param block_size Block size
+ @returns Size in bytes
+*/
+static unsigned long coded_size(const CodesIndex * const table, const uint8_t * const block_input, const unsigned long block_size)
+{
+    unsigned long freq[NUM_SYMBOLS] = {0};
+    unsigned long long num_bits = 0;
+
+    for (unsigned long idx = 0; idx < block_size; ++idx)
+        ++freq[block_input[idx]];
+
+    // Each code has `index` full bytes plus `next / NUM_SYMBOLS` bits
+    for (int idx = 0; idx < NUM_SYMBOLS; ++idx)
+        num_bits += (unsigned long long) freq[idx] * (table[idx].index * 8 + table[idx].next / NUM_SYMBOLS);
+
+    return (num_bits + 7) / 8;
+}
+
+
 /**
 \brief Aplies algorithm to make the symbols' codification
  @param table Table of codes
  @param block_input Block with original file's bytes
  @param block_size Block size 
+ @param output_size Block size after codification given by coded_size
+ @param restart_interval Symbols between restart points (0 -> None)
+ @param restarts Where to save the bit where each restart point starts ((block_size - 1) / restart_interval of them)
  @param new_block_size Block size after codification
  @returns Allocated string of compressed binary
  */
-static uint8_t * binary_coding(CodesIndex * const table, const uint8_t * restrict block_input, const unsigned long block_size, unsigned long * const new_block_size)
+static uint8_t * binary_coding(CodesIndex * const table, const uint8_t * restrict block_input, const unsigned long block_size, const unsigned long output_size, const unsigned long restart_interval, unsigned long long * restarts, unsigned long * const new_block_size)
 {
     CodesIndex * symbol;
     int next = 0, num_bytes_code;
-    uint8_t * code, * output;
+    uint8_t * code, * output, partial = 0; // Bits of the byte not finished yet
 
-    uint8_t * const block_output = calloc(block_size * 1.05, sizeof(uint8_t)); // Uncompressed Block Size + 5% which is a big margin for the new compressed block size
+    // Every byte is written once it's finished so the buffer doesn't need to be zeroed
+    uint8_t * const block_output = bufpool_alloc(output_size);
 
     if (!block_output)
         return NULL;
 
     output = block_output;
     
-    for (unsigned long idx = 0; idx < block_size; ++idx) {
-        symbol = &table[next + *block_input++];
+    // Symbols are coded a segment (Between restart points) at a time
+    for (unsigned long idx = 0, segment_end; idx < block_size; idx = segment_end) {
+
+        if (idx)
+            *restarts++ = (unsigned long long) (output - block_output) * 8 + next / NUM_SYMBOLS;
+
+        segment_end = restart_interval && block_size - idx > restart_interval ? idx + restart_interval : block_size;
+
+        for (unsigned long sym = idx; sym < segment_end; ++sym) {
+            symbol = &table[next + *block_input++];
 
-        num_bytes_code = symbol->index;
-        code = symbol->code;
+            num_bytes_code = symbol->index;
+            code = symbol->code;
 
-        for (int i = 0; i < num_bytes_code; ++i)
-            *output++ |= *code++;
-        
-        // Even if the compiler won't store it in a registry it will be cached
-        *output |= *code;
+            // The first byte finishes the one being built and the code's last one starts the next
+            if (num_bytes_code) {
+                *output++ = partial | *code++;
 
-        next = symbol->next;
+                for (int i = 1; i < num_bytes_code; ++i)
+                    *output++ = *code++;
+
+                partial = *code;
+            }
+            else
+                partial |= *code;
+
+            next = symbol->next;
+        }
     }
 
-    *new_block_size = output - block_output + (next ? 1 : 0);
+    if (next)
+        *output++ = partial;
+
+    *new_block_size = output - block_output;
 
     return block_output;
 }
 
 
 /**
-\brief Generates table of codes
- @param _args Pointer to a structure with all arguments needed to this function
+\brief Generates table of codes from a block of the .cod file
+ @param block_codes String with every symbol's code separated by ';'
+ @param table Zero-initialized table to be filled (NUM_OFFSETS rows of NUM_SYMBOLS)
  @returns Error status
 */
-static _modules_error compress_to_buffer(void * const _args)
+static _modules_error build_table(const char * block_codes, CodesIndex (* const table)[NUM_SYMBOLS])
 {
-    Arguments * args = (Arguments *) _args;
-    const char * block_codes = args->block_codes;
-    const uint8_t * block_input = args->block_input;
-    const unsigned long block_size = args->block_size;
-    unsigned long * const new_block_size = args->new_block_size;
-
     CodesIndex header_symbol_row, *symbol_row;
     char cur_char, next_char;
     int bit_idx, code_idx;
     uint8_t byte, next_byte_prefix = 0, mask;
 
-    CodesIndex (* table)[NUM_SYMBOLS] = calloc(1, sizeof(CodesIndex[NUM_OFFSETS][NUM_SYMBOLS]));
- 
-    if (!table)
-        return _LACK_OF_MEMORY;
-
     /*
     /
     /    Table's header initialization
@@ -124,11 +191,8 @@ static _modules_error compress_to_buffer(void * const _args)
 
                 if (cur_char == '1')
                     ++byte;
-                else if (cur_char != '0') {
-                    free(args->block_codes);
-                    free(table);
+                else if (cur_char != '0')
                     return _FILE_UNRECOGNIZABLE;
-                }
 
                 if (bit_idx < 7) {
                     if (next_char == ';') {
@@ -162,19 +226,13 @@ static _modules_error compress_to_buffer(void * const _args)
             cur_char = next_char;
             next_char = *block_codes++;
         }
-        else if (syb_idx < NUM_SYMBOLS - 1) { // if end of codes' block but still hasn't iterated over 256 symbols
-            free(args->block_codes);
-            free(table);
+        else if (syb_idx < NUM_SYMBOLS - 1) // if end of codes' block but still hasn't iterated over 256 symbols
             return _FILE_UNRECOGNIZABLE;
-        }
 
     }
-    free(args->block_codes);
 
-    if (cur_char != '\0') { // Check whether file is actually correct (Not required but it is an assert)
-        free(table);
+    if (cur_char != '\0') // Check whether file is actually correct (Not required but it is an assert)
         return _FILE_UNRECOGNIZABLE;
-    }
 
 
     /*
@@ -218,25 +276,335 @@ static _modules_error compress_to_buffer(void * const _args)
         }
     }
 
+    return _SUCCESS;
+}
+
+
+_modules_error shafa_block_compress(const char * const block_codes, const uint8_t * const block_input, const unsigned long block_size, const unsigned long restart_interval, uint8_t ** const block_output, unsigned long * const new_block_size, unsigned long long ** const restarts, unsigned long * const num_restarts)
+{
+    _modules_error error;
+    unsigned long output_size;
+    double span = TRACE_BEGIN();
+    PerfSample sample;
+
+    *block_output = NULL;
+    *restarts = NULL;
+    *num_restarts = 0;
+
+    CodesIndex (* table)[NUM_SYMBOLS] = bufpool_calloc(sizeof(CodesIndex[NUM_OFFSETS][NUM_SYMBOLS]));
+ 
+    if (!table)
+        return _LACK_OF_MEMORY;
+
+    error = build_table(block_codes, table);
+    TRACE_END("build table", span);
+
+    if (error) {
+        bufpool_free(table);
+        return error;
+    }
+
     
     /*
     /
-    /    Write compressed code to buffer
+    /    Write compressed code to buffer (unless it isn't worth it)
     /
     */
 
+    output_size = coded_size((CodesIndex *) table, block_input, block_size);
+
+    if (output_size > block_size - (block_size >> STORED_MIN_GAIN_SHIFT)) {
+        bufpool_free(table);
+        *new_block_size = block_size;
+        return _SUCCESS;
+    }
     
-    args->block_output = binary_coding((CodesIndex *) table, block_input, block_size, new_block_size);
+    // Restart points are only worth it when there's more than one segment
+    if (restart_interval && block_size > restart_interval) {
+        *num_restarts = (block_size - 1) / restart_interval;
+        *restarts = malloc(*num_restarts * sizeof(unsigned long long));
+
+        if (!*restarts) {
+            bufpool_free(table);
+            return _LACK_OF_MEMORY;
+        }
+    }
+
+    span = TRACE_BEGIN();
+    PERF_BEGIN(sample);
+    *block_output = binary_coding((CodesIndex *) table, block_input, block_size, output_size, *restarts ? restart_interval : 0, *restarts, new_block_size);
+    PERF_END(sample, PERF_BINARY_CODING, block_size);
+    TRACE_END("encode", span);
 
-    free(table);    
+    bufpool_free(table);    
 
-    if (!args->block_output)
+    if (!*block_output) {
+        free(*restarts);
+        *restarts = NULL;
         return _LACK_OF_MEMORY;
+    }
 
     return _SUCCESS;
 }
 
 
+_modules_error ans_block_compress(const char * const block_freq, const uint8_t * const block_input, const unsigned long block_size, uint8_t ** const block_output, unsigned long * const new_block_size)
+{
+    _modules_error error;
+    double span = TRACE_BEGIN();
+    PerfSample sample;
+
+    *block_output = NULL;
+    *new_block_size = block_size;
+
+    RansTable * table = bufpool_alloc(sizeof(RansTable));
+
+    if (!table)
+        return _LACK_OF_MEMORY;
+
+    error = rans_read_table(block_freq, table);
+    TRACE_END("build table", span);
+
+    // The coded block has to fit where it would save enough (Otherwise it's stored)
+    uint8_t * const output = error ? NULL : bufpool_alloc(block_size - (block_size >> STORED_MIN_GAIN_SHIFT));
+
+    if (!error && !output)
+        error = _LACK_OF_MEMORY;
+
+    if (!error) {
+        span = TRACE_BEGIN();
+        PERF_BEGIN(sample);
+        error = rans_encode(table, block_input, block_size, output, block_size - (block_size >> STORED_MIN_GAIN_SHIFT), new_block_size);
+        PERF_END(sample, PERF_RANS_ENCODE, block_size);
+        TRACE_END("encode", span);
+
+        if (!error && *new_block_size)
+            *block_output = output;
+        else {
+            bufpool_free(output);
+            *new_block_size = block_size;
+        }
+    }
+
+    bufpool_free(table);
+
+    return error;
+}
+
+
+/**
+\brief Reads the codes of a context (Or the block's own ones) from a block of the .cod file
+ @param block_codes Every symbol's code separated by ';'
+ @param end Character which ends them
+ @param table Where to save each symbol's code
+ @returns Where the next codes start (NULL if they're unrecognizable)
+*/
+static const char * read_context_codes(const char * block_codes, const char end, ContextCode * const table)
+{
+    for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol, ++block_codes) {
+
+        ContextCode * const code = &table[symbol];
+
+        *code = (ContextCode) {.length = 0};
+
+        for ( ; *block_codes == '0' || *block_codes == '1'; ++block_codes, ++code->length) {
+
+            if (code->length == MAX_CODE_INT * 8)
+                return NULL;
+
+            if (*block_codes == '1')
+                code->code[code->length / 8] |= 128 >> (code->length % 8);
+
+            if (code->length < MAX_ACC_CODE)
+                code->value = code->value << 1 | (*block_codes == '1');
+        }
+
+        if (*block_codes != (symbol < NUM_SYMBOLS - 1 ? ';' : end))
+            return NULL;
+    }
+
+    return block_codes;
+}
+
+
+_modules_error context_block_compress(const char * block_codes, const uint8_t * const block_input, const unsigned long block_size, uint8_t ** const block_output, unsigned long * const new_block_size)
+{
+    _modules_error error = _SUCCESS;
+    ContextCode * tables[NUM_SYMBOLS] = {NULL}, * own, * code;
+    unsigned long long num_bits = 0;
+    unsigned long context, output_size;
+    uint64_t acc = 0; // Bits not written yet (The last `pending` ones)
+    int pending = 0, bits;
+    uint8_t * output, prev = 0;
+    char * end;
+    double span = TRACE_BEGIN();
+    PerfSample sample;
+
+    *block_output = NULL;
+    *new_block_size = block_size;
+
+    // Codes of each context with its own ones come first: <context>:<codes>|
+    while (!error && strchr(block_codes, '|')) {
+        context = strtoul(block_codes, &end, 10);
+
+        if (end == block_codes || *end != ':' || context >= NUM_SYMBOLS || tables[context])
+            error = _FILE_UNRECOGNIZABLE;
+        else if (!(tables[context] = bufpool_alloc(sizeof(ContextCode[NUM_SYMBOLS]))))
+            error = _LACK_OF_MEMORY;
+        else if (!(block_codes = read_context_codes(end + 1, '|', tables[context])))
+            error = _FILE_UNRECOGNIZABLE;
+    }
+
+    own = error ? NULL : bufpool_alloc(sizeof(ContextCode[NUM_SYMBOLS]));
+
+    if (!error && !own)
+        error = _LACK_OF_MEMORY;
+    else if (!error && !read_context_codes(block_codes, '\0', own))
+        error = _FILE_UNRECOGNIZABLE;
+
+    // The other contexts use the block's own codes
+    for (int idx = 0; idx < NUM_SYMBOLS && !error; ++idx)
+        if (!tables[idx])
+            tables[idx] = own;
+
+    TRACE_END("build table", span);
+
+    // Exact size of the coded block (Every symbol must have a code after its context)
+    for (unsigned long idx = 0; idx < block_size && !error; prev = block_input[idx++]) {
+        bits = tables[prev][block_input[idx]].length;
+        if (!bits)
+            error = _FILE_UNRECOGNIZABLE;
+        num_bits += bits;
+    }
+
+    output_size = (num_bits + 7) / 8;
+
+    if (!error && output_size <= block_size - (block_size >> STORED_MIN_GAIN_SHIFT)) {
+
+        output = *block_output = bufpool_alloc(output_size);
+
+        if (!output)
+            error = _LACK_OF_MEMORY;
+        else {
+            span = TRACE_BEGIN();
+            PERF_BEGIN(sample);
+
+            prev = 0;
+            for (unsigned long idx = 0; idx < block_size; prev = block_input[idx++]) {
+                code = &tables[prev][block_input[idx]];
+
+                if (code->length <= MAX_ACC_CODE) {
+                    acc = acc << code->length | code->value;
+                    pending += code->length;
+                }
+                else
+                    for (int byte = 0; byte * 8 < code->length; ++byte) {
+                        bits = code->length - byte * 8 < 8 ? code->length - byte * 8 : 8;
+                        acc = acc << bits | code->code[byte] >> (8 - bits);
+                        pending += bits;
+
+                        while (pending >= 8)
+                            *output++ = acc >> (pending -= 8);
+                    }
+
+                while (pending >= 8)
+                    *output++ = acc >> (pending -= 8);
+            }
+
+            if (pending)
+                *output = acc << (8 - pending);
+
+            *new_block_size = output_size;
+
+            PERF_END(sample, PERF_BINARY_CODING, block_size);
+            TRACE_END("encode", span);
+        }
+    }
+
+    for (int idx = 0; idx < NUM_SYMBOLS; ++idx)
+        if (tables[idx] != own)
+            bufpool_free(tables[idx]);
+    bufpool_free(own);
+
+    if (error) {
+        bufpool_free(*block_output);
+        *block_output = NULL;
+        *new_block_size = block_size;
+    }
+
+    return error;
+}
+
+
+/**
+\brief Generates table of codes and compresses the block with it
+ @param _args Pointer to a structure with all arguments needed to this function
+ @returns Error status
+*/
+static _modules_error compress_to_buffer(void * const _args)
+{
+    Arguments * args = (Arguments *) _args;
+    _modules_error error;
+
+    // Holes have nothing to be coded
+    if (args->hole) {
+        bufpool_free(args->block_codes);
+        *args->new_block_size = 0;
+        if (args->entropy)
+            *args->entropy = 0;
+        return _SUCCESS;
+    }
+
+    if (args->entropy)
+        *args->entropy = stats_block_entropy(args->block_input, args->block_size);
+
+    if (args->ans)
+        error = ans_block_compress(args->block_codes, args->block_input, args->block_size, &args->block_output, args->new_block_size);
+    else if (args->order1)
+        error = context_block_compress(args->block_codes, args->block_input, args->block_size, &args->block_output, args->new_block_size);
+    else
+        error = shafa_block_compress(args->block_codes, args->block_input, args->block_size, args->restart_interval, &args->block_output, args->new_block_size, &args->restarts, &args->num_restarts);
+    bufpool_free(args->block_codes);
+
+    // Stored when Shannon-Fano (or rANS) wouldn't save enough
+    args->stored = !error && !args->block_output;
+
+    return error;
+}
+
+
+/**
+\brief Queues the next blocks of the file to be read ahead (Holes are only in the original file, where they're skipped)
+ @param fd_ahead Codes' file at the header of the next block to be queued
+ @param reader Reader of the file
+ @param mode File's mode
+ @param next_block Next block to be queued
+ @param queued Number of blocks queued and not taken yet
+ @param num_blocks Number of blocks
+ @returns Error status
+*/
+static _modules_error queue_blocks(FILE * const fd_ahead, BlockReader * const reader, const char mode, unsigned long long * const next_block, unsigned * const queued, const unsigned long long num_blocks)
+{
+    BlockHeader header;
+    _modules_error error = _SUCCESS;
+
+    for (; !error && *queued < READ_AHEAD && *next_block < num_blocks; ++*next_block) {
+        error = read_block_header(fd_ahead, &header);
+
+        if (!error && fscanf(fd_ahead, "%*[^@]") == EOF)
+            error = _FILE_STREAM_FAILED;
+
+        if (!error && (!header.hole || mode == 'N'))
+            error = block_reader_queue(reader, header.hole ? header.original_size : header.size, header.hole);
+
+        if (!error && !header.hole)
+            ++*queued;
+    }
+
+    return error;
+}
+
+
 /**
 \brief Writes codification to file
  @param _args Pointer to a structure with all arguments needed to this function 
@@ -247,25 +615,35 @@ static _modules_error compress_to_buffer(void * const _args)
 static _modules_error write_shafa(void * const _args, _modules_error prev_error, _modules_error error)
 {
     Arguments * args = (Arguments *) _args;
-    FILE * const fd_shafa = args->fd_shafa;
-    uint8_t * const block_output = args->block_output;
-    const unsigned long new_block_size = *args->new_block_size;
+    uint8_t * const block_output = args->stored ? args->block_input : args->block_output;
+    const BlockHeader header = {
+        .size = *args->new_block_size,
+        .original_size = args->original_size,
+        .bwt_index = args->bwt_index,
+        .restart_interval = args->restarts ? args->restart_interval : 0,
+        .num_restarts = args->restarts ? args->num_restarts : 0,
+        .restarts = args->restarts,
+        .rle = args->rle,
+        .stored = args->stored,
+        .hole = args->hole
+    };
 
     if (!error) {
         if (!prev_error) {
-            if (fprintf(fd_shafa, "@%lu@", new_block_size) >= 2) {
+            error = block_writer_header(args->writer, &header, args->block_offset);
 
-                if (fwrite(block_output, sizeof(uint8_t), new_block_size, fd_shafa) != new_block_size)
-                    error = _FILE_STREAM_FAILED;
+            // The block is freed by the writer once it's written
+            if (!error && header.size) {
+                error = block_writer_write(args->writer, block_output, header.size);
+                *(args->stored ? &args->block_input : &args->block_output) = NULL;
             }
-            else
-                error = _FILE_STREAM_FAILED;
-
         }
 
-        free(block_output); 
+        bufpool_free(args->block_output); 
     }
 
+    bufpool_free(args->block_input);
+    free(args->restarts);
     free(_args);
     return error;
 }
@@ -289,10 +667,10 @@ static inline void print_summary(const unsigned long long num_blocks, const unsi
         "Module: C (Symbol codes' codification)\n"
         "Number of blocks: %lu\n", num_blocks
     );
-    for (unsigned long long i = 0; i < num_blocks; ++i) {
+    for (unsigned long long i = 0; i < num_blocks && STATS == STATS_TEXT; ++i) {
         block_input_size = blocks_input_size[i];
         block_output_size = blocks_output_size[i];
-        printf("Size before/after & compression rate (Block %lu): %lu/%lu -> %d%%\n", i, block_input_size, block_output_size, (int) (((float) block_output_size / block_input_size) * 100));
+        printf("Size before/after & compression rate (Block %lu): %lu/%lu -> %d%%\n", i, block_input_size, block_output_size, block_input_size ? (int) (((float) block_output_size / block_input_size) * 100) : 0); // Holes are empty
     }
     
     printf(
@@ -303,20 +681,28 @@ static inline void print_summary(const unsigned long long num_blocks, const unsi
 }
 
 
-_modules_error shafa_compress(char ** const path)
+_modules_error shafa_compress(char ** const path, const unsigned long restart_interval)
 {
-    FILE * fd_file, * fd_codes, * fd_shafa;
+    FILE * fd_file, * fd_codes, * fd_shafa, * fd_ahead = NULL;
+    BlockReader * reader = NULL;
+    BlockWriter * writer = NULL;
     Arguments * args;
     float total_time;
+    double span;
     char * path_file = *path;
     char * path_codes;
     char * path_shafa;
     char * block_codes;
-    unsigned long long num_blocks;
+    unsigned long long num_blocks, next_block = 0;
     unsigned long block_size;
-    int error = _SUCCESS;
+    unsigned queued = 0;
+    FileHeader file_header;
+    BlockHeader header;
+    int error = _SUCCESS, wait_error;
     uint8_t * block_input;
     unsigned long * blocks_size = NULL, * blocks_input_size, * blocks_output_size;
+    unsigned long long * block_offsets = NULL;
+    double * entropies = NULL;
 
     clock_main_thread(START_CLOCK);
     
@@ -330,7 +716,9 @@ _modules_error shafa_compress(char ** const path)
 
         if (fd_codes) {
 
-            if (fscanf(fd_codes, "@%*c@%lu", &num_blocks) == 1) {
+            if (!(error = read_file_header(fd_codes, &file_header))) {
+
+                num_blocks = file_header.num_blocks;
 
                 // Open File's handle
                 fd_file = fopen(path_file, "rb");
@@ -352,73 +740,137 @@ _modules_error shafa_compress(char ** const path)
 
                                 blocks_size = malloc(2 * num_blocks * sizeof(unsigned long));
 
+                                // Offsets of the blocks' headers for the table at the end of the file
+                                if (blocks_size) {
+                                    block_offsets = malloc(num_blocks * sizeof(unsigned long long));
+
+                                    if (!block_offsets) {
+                                        free(blocks_size);
+                                        blocks_size = NULL;
+                                    }
+                                }
+
+                                // Entropy of each block is only needed for the JSON statistics
+                                if (blocks_size && STATS == STATS_JSON) {
+                                    entropies = malloc(num_blocks * sizeof(double));
+
+                                    if (!entropies) {
+                                        free(blocks_size);
+                                        blocks_size = NULL;
+                                    }
+                                }
+
                                 if (blocks_size) {
                                     
                                     blocks_input_size = blocks_size;
                                     blocks_output_size = blocks_input_size + num_blocks; // Acts as a "virtual" array
 
-                                    for (unsigned long long thread_idx = 0; thread_idx < num_blocks; ++thread_idx) {
+                                    // Blocks are read ahead while the previous ones are coded (Their headers are found with a second handle of Codes)
+                                    fd_ahead = fopen(path_codes, "rb");
+
+                                    if (!fd_ahead || fseek(fd_ahead, ftell(fd_codes), SEEK_SET))
+                                        error = _FILE_INACCESSIBLE;
+                                    else if (!(error = block_reader_open(fd_file, &reader)) && !(error = block_writer_open(fd_shafa, &writer)))
+                                        error = queue_blocks(fd_ahead, reader, file_header.mode, &next_block, &queued, num_blocks);
+
+                                    for (unsigned long long thread_idx = 0; !error && thread_idx < num_blocks; ++thread_idx) {
 
-                                        block_codes = malloc((33151 + 1 + 1) * sizeof(char)); //sum 1 to 256 (worst case shannon fano) + 255 semicolons + 1 byte NULL + 1 algorithm efficiency (exchange 2 * 256 + 2 compares for +1 byte in heap and +1 memory access)
+                                        span = TRACE_BEGIN();
 
-                                        if (!block_codes) {
+                                        // Blocks with the codes of each context are allocated while they're read
+                                        block_codes = file_header.order1 ? NULL : bufpool_alloc((33151 + 1 + 1) * sizeof(char)); //sum 1 to 256 (worst case shannon fano) + 255 semicolons + 1 byte NULL + 1 algorithm efficiency (exchange 2 * 256 + 2 compares for +1 byte in heap and +1 memory access)
+
+                                        if (!block_codes && !file_header.order1) {
                                             error = _LACK_OF_MEMORY;
                                             break;
                                         }
 
-                                        if (fscanf(fd_codes,"@%lu@%33151[^@]", &block_size, block_codes) != 2) {
-                                            free(block_codes);
+                                        error = read_block_header(fd_codes, &header);
+
+                                        if (!error && file_header.order1)
+                                            error = read_block_content(fd_codes, &block_codes);
+                                        else if (!error && fscanf(fd_codes, "%33151[^@]", block_codes) != 1)
                                             error = _FILE_STREAM_FAILED;
+
+                                        if (error) {
+                                            bufpool_free(block_codes);
                                             break;
                                         }
 
+                                        block_size = header.size;
+
                                         args = malloc(sizeof(Arguments));
 
                                         if (!args) {
-                                            free(block_codes);
+                                            bufpool_free(block_codes);
                                             error = _LACK_OF_MEMORY;
                                             break;
                                         }
                                             
-                                        block_input = malloc(block_size * sizeof(uint8_t));
+                                        // Holes aren't in module C's input (Unless it's the original file, where the reader skips them)
+                                        block_input = NULL;
 
-                                        if (!block_input) {
-                                            free(block_codes);
-                                            free(args);
-                                            error = _LACK_OF_MEMORY;
-                                            break;
+                                        if (!header.hole && !(error = block_reader_next(reader, &block_input))) {
+                                            --queued;
+                                            error = queue_blocks(fd_ahead, reader, file_header.mode, &next_block, &queued, num_blocks);
                                         }
 
-                                        if (fread(block_input, sizeof(uint8_t), block_size, fd_file) != block_size) {
-                                            free(block_codes);
-                                            free(block_input);
+                                        if (error) {
+                                            bufpool_free(block_codes);
+                                            bufpool_free(block_input);
                                             free(args);
-                                            error = _FILE_STREAM_FAILED;
                                             break;
                                         }
 
                                         *args = (Arguments) {
                                             .block_size = block_size,
-                                            .fd_shafa = fd_shafa,
+                                            .writer = writer,
                                             .block_codes = block_codes,
                                             .block_input = block_input,
                                             .block_output = NULL,
-                                            .new_block_size = &blocks_output_size[thread_idx]
+                                            .new_block_size = &blocks_output_size[thread_idx],
+                                            .entropy = entropies ? &entropies[thread_idx] : NULL,
+                                            .block_offset = &block_offsets[thread_idx],
+                                            .restart_interval = restart_interval,
+                                            .restarts = NULL,
+                                            .ans = file_header.ans,
+                                            .order1 = file_header.order1,
+                                            .original_size = header.original_size,
+                                            .bwt_index = header.bwt_index,
+                                            .rle = header.rle,
+                                            .stored = false,
+                                            .hole = header.hole
                                         };
 
                                         blocks_input_size[thread_idx] = block_size;
+                                        TRACE_END("read block", span);
                                                     
                                         error = multithread_create(compress_to_buffer, write_shafa, args);
 
                                         if (error) {
-                                            free(block_codes);
-                                            free(block_input);
+                                            bufpool_free(block_codes);
+                                            bufpool_free(block_input);
                                             free(args);
                                             break;
                                         }
                                         
                                     }
-                                    multithread_wait();
+                                    wait_error = multithread_wait();
+                                    if (!error)
+                                        error = wait_error;
+
+                                    if (reader)
+                                        block_reader_close(reader);
+
+                                    if (fd_ahead)
+                                        fclose(fd_ahead);
+
+                                    if (writer && (wait_error = block_writer_close(writer)) && !error)
+                                        error = wait_error;
+
+                                    // Lets module D read any block without the previous ones
+                                    if (!error)
+                                        error = write_block_table(fd_shafa, block_offsets, num_blocks);
                                 }
                                 else
                                     error = _LACK_OF_MEMORY;
@@ -443,8 +895,6 @@ _modules_error shafa_compress(char ** const path)
                 else
                     error = _FILE_INACCESSIBLE;    
             }
-            else
-                error = _FILE_UNRECOGNIZABLE;
 
             fclose(fd_codes);
         }
@@ -462,11 +912,19 @@ _modules_error shafa_compress(char ** const path)
 
         total_time = clock_main_thread(STOP_CLOCK);
 
-        print_summary(num_blocks, blocks_input_size, blocks_output_size, total_time, path_shafa);     
+        if (STATS == STATS_JSON)
+            error = stats_add_stage("c", file_header.ans ? "rANS compression" : "Shannon-Fano compression", num_blocks, blocks_input_size, blocks_output_size, entropies, path_shafa);
+        else if (STATS != STATS_NONE) {
+            multithread_lock();
+            print_summary(num_blocks, blocks_input_size, blocks_output_size, total_time, path_shafa);     
+            multithread_unlock();
+        }
     }
 
     if (blocks_size)
         free(blocks_size);
+    free(block_offsets);
+    free(entropies);
 
     return error;
 }
@@ -1,13 +1,57 @@
 #ifndef MODULE_C_H
 #define MODULE_C_H
 
+#include <stdint.h>
+
 #include "utils/errors.h"
 
 /**
 \brief Compresses file with Shannon Fano's algorithm and saves it to disk
  @param path Pointer to the original/RLE file's path
+ @param restart_interval Symbols between the restart points recorded in each block for module D's parallel decoding (0 -> None, ignored by rANS)
+ @returns Error status
+*/
+_modules_error shafa_compress(char ** path, unsigned long restart_interval);
+
+
+/**
+\brief Codes a block with its Shannon-Fano codes (Also used by the pipeline which runs modules F, T and C block by block)
+ @param block_codes Every symbol's code separated by ';' as in a block of the .cod file
+ @param block_input Block's content
+ @param block_size Block's size
+ @param restart_interval Symbols between restart points (0 -> None)
+ @param block_output Where to save the coded block (NULL if it's stored: Shannon-Fano wouldn't save enough)
+ @param new_block_size Where to save the coded block's size (The block's own if it's stored)
+ @param restarts Where to save the bit where each restart point starts (NULL if there are none, otherwise the caller's to be freed)
+ @param num_restarts Where to save the number of restart points
+ @returns Error status
+*/
+_modules_error shafa_block_compress(const char * block_codes, const uint8_t * block_input, unsigned long block_size, unsigned long restart_interval, uint8_t ** block_output, unsigned long * new_block_size, unsigned long long ** restarts, unsigned long * num_restarts);
+
+
+
+/**
+\brief Codes a block with rANS (Also used by the pipeline which runs modules F, T and C block by block)
+ @param block_freq Every symbol's normalized frequency separated by ';' as in a block of a .cod file flagged for rANS
+ @param block_input Block's content
+ @param block_size Block's size
+ @param block_output Where to save the coded block (NULL if it's stored: rANS wouldn't save enough)
+ @param new_block_size Where to save the coded block's size (The block's own if it's stored)
+ @returns Error status
+*/
+_modules_error ans_block_compress(const char * block_freq, const uint8_t * block_input, unsigned long block_size, uint8_t ** block_output, unsigned long * new_block_size);
+
+
+/**
+\brief Codes a block with the Shannon-Fano codes of each symbol's context (the previous symbol, 0 for the first one)
+       (Also used by the pipeline which runs modules F, T and C block by block)
+ @param block_codes Codes as in a block of a .cod file with order-1 contexts: (<context>:<codes>|)* followed by the ones of the contexts without their own
+ @param block_input Block's content
+ @param block_size Block's size
+ @param block_output Where to save the coded block (NULL if it's stored: the codes wouldn't save enough)
+ @param new_block_size Where to save the coded block's size (The block's own if it's stored)
  @returns Error status
 */
-_modules_error shafa_compress(char ** path);
+_modules_error context_block_compress(const char * block_codes, const uint8_t * block_input, unsigned long block_size, uint8_t ** block_output, unsigned long * new_block_size);
 
 #endif //MODULE_C_H
\ No newline at end of file
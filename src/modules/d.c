@@ -6,6 +6,10 @@
  *
  **************************************************/
 
+#ifdef __linux__
+#define _GNU_SOURCE // copy_file_range and fallocate
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,11 +18,45 @@
 
 
 #include "utils/file.h"
+#include "utils/perf.h"
+#include "utils/stats.h"
+#include "utils/trace.h"
 #include "utils/errors.h"
+#include "utils/header.h"
+#include "utils/bwt.h"
+#include "utils/rans.h"
+#include "utils/bufpool.h"
 #include "utils/extensions.h"
 #include "utils/multithread.h"
 
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#include <unistd.h>
+#define COPY_FILE_RANGE // Stored blocks can be copied by the kernel
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define POSITIONAL_IO // Workers read their own blocks and write the ones whose offset in the generated file is known
+#define FIRST_OFFSET 0
+#else
+#define FIRST_OFFSET -1 // Every block is written in order
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#define preallocate(f_wrt, offset, size) ((void) fallocate(fileno(f_wrt), 0, offset, size)) // Not every file system supports it (It's only a hint)
+#else
+#define preallocate(f_wrt, offset, size) ((void) 0)
+#endif
+
+#if defined(__SSE2__) && !defined(NO_SIMD)
+#include <emmintrin.h>
+#define RLE_SIMD // RLE's expansion uses 16 bytes vectors (-DNO_SIMD builds the scalar version)
+#endif
+
 #define NUM_SYMBOLS 256
+#define SPLIT_MIN_SIZE (_1KiB * _1KiB) // Coded bytes of each chunk of a block split among workers (At least 1 MiB)
+#define SYNC_WINDOW 1024 // First symbols of a chunk where the previous one may meet it
 
 /**
  Enumeration of all possible types of decoding
@@ -55,7 +93,7 @@ static inline void print_summary (double time, unsigned long * decomp_sizes, uns
     else 
         printf("Module: D (SHAFA & RLE decoding)\n");
 
-    for (unsigned long long i = 0; i < length; ++i) 
+    for (unsigned long long i = 0; i < length && STATS == STATS_TEXT; ++i) 
         printf("Size before/after generating file (block %lu): %lu/%lu\n", i + 1, decomp_sizes[i], new_sizes[i]);
     printf(
         "Module runtime (in milliseconds): %f\n"
@@ -65,6 +103,37 @@ static inline void print_summary (double time, unsigned long * decomp_sizes, uns
 }
 
 
+/**
+\brief Writes a block in the generated file: at its offset when it's known (Without waiting for the previous blocks) or else where the stream is
+ @param f_wrt Stream of the generated file
+ @param block Block's content (NULL if it's a hole which is skipped)
+ @param size Block's size
+ @param offset Block's offset in the generated file (-1 if the blocks are written in order)
+ @returns Error status
+*/
+static _modules_error write_block (FILE * const f_wrt, const uint8_t * block, unsigned long size, long long offset)
+{
+    if (offset < 0) {
+        if (!block)
+            return fseek(f_wrt, size, SEEK_CUR) ? _FILE_STREAM_FAILED : _SUCCESS;
+
+        return fwrite(block, sizeof(uint8_t), size, f_wrt) == size ? _SUCCESS : _FILE_STREAM_FAILED;
+    }
+
+#ifdef POSITIONAL_IO
+    for (ssize_t written; block && size; size -= written, block += written, offset += written) {
+        written = pwrite(fileno(f_wrt), block, size, offset);
+        if (written <= 0)
+            return _FILE_STREAM_FAILED;
+    }
+
+    return _SUCCESS;
+#else
+    return _FILE_STREAM_FAILED; // Offsets are only given when it can write at them
+#endif
+}
+
+
 /**
 \brief Loads the rle file to a buffer and saves it
  @param f_rle Pointer to the RLE file
@@ -77,12 +146,13 @@ static _modules_error load_rle (FILE* f_rle, unsigned long block_size, uint8_t *
     _modules_error error = _SUCCESS;
 
     // Memory allocation for the buffer that will contain the contents of one block of symbols
-    *buffer = malloc(block_size);
+    *buffer = bufpool_alloc(block_size);
     if (*buffer) {
         // The function fread loads the said contents into the buffer
         // For the correct execution, the amount read by fread has to match the amount that was supposed to be read: block_size
         if (fread(*buffer, sizeof(uint8_t), block_size, f_rle) != block_size) {
             error = _FILE_STREAM_FAILED;
+            bufpool_free(*buffer);
             *buffer = NULL; 
         }
 
@@ -102,12 +172,187 @@ typedef struct {
     FILE * f_rle;
     FILE * f_wrt;
     unsigned long rle_block_size;
+    unsigned long original_size; // 0 if the block's header doesn't have it (Files written before it was recorded)
+    unsigned long bwt_index; // Primary index which undoes Burrows-Wheeler once RLE is decompressed (0 -> Not transformed)
+    bool rle_v2;
+    long long offset; // Where the block goes in the generated file (-1 if it's written in order)
+    _modules_error (* decompress)(void *); // Only needed by blocks written at their offset
     unsigned long * final_sizes;
     uint8_t * buffer;
     uint8_t * sequence;
+    double * entropy;
     
 } ArgumentsRLE;
 
+/**
+\brief Undoes the Burrows-Wheeler and move-to-front transform of a block once RLE is decompressed
+ @param block Block (Transformed in place)
+ @param size Block's size
+ @param bwt_index Primary index
+ @returns Error status
+*/
+static _modules_error undo_bwt (uint8_t * block, unsigned long size, unsigned long bwt_index)
+{
+    _modules_error error;
+    double span = TRACE_BEGIN();
+    PerfSample sample;
+
+    PERF_BEGIN(sample);
+    error = bwt_decode(block, size, bwt_index);
+    PERF_END(sample, PERF_BWT_DECODE, size);
+    TRACE_END("bwt decode", span);
+
+    return error;
+}
+
+/**
+\brief Size guessed for a RLE block's decompressed content when its header doesn't have it: the smallest of a ladder that fits it
+ @param size Bytes needed
+ @returns Size to be allocated (0 if it's bigger than any block)
+*/
+static unsigned long sequence_size (unsigned long size)
+{
+    if (size <= _64KiB + _1KiB)
+        return _64KiB + _1KiB;
+    if (size <= _640KiB + _1KiB)
+        return _640KiB + _1KiB;
+    if (size <= _8MiB + _1KiB)
+        return _8MiB + _1KiB;
+    if (size <= _64MiB + _1KiB)
+        return _64MiB + _1KiB;
+
+    return 0;
+}
+
+/**
+\brief Makes room for `size` bytes in a RLE block's decompressed content (Only when its original size is unknown)
+ @param sequence Address of the decompressed content (Freed if it can't grow)
+ @param orig_size Address of its current size
+ @param exact Whether the current size is the block's original size
+ @param size Bytes needed
+ @returns Error status
+*/
+static _modules_error grow_sequence (uint8_t ** sequence, unsigned long * orig_size, bool exact, unsigned long size)
+{
+    uint8_t * tmp;
+
+    *orig_size = exact ? 0 : sequence_size(size);
+    tmp = *orig_size ? bufpool_realloc(*sequence, *orig_size) : NULL;
+
+    if (!tmp) {
+        bufpool_free(*sequence);
+        *sequence = NULL;
+        return *orig_size ? _LACK_OF_MEMORY : _FILE_UNRECOGNIZABLE;
+    }
+
+    *sequence = tmp;
+
+    return _SUCCESS;
+}
+
+/**
+\brief Copies the literals at the start of a RLE block up to its next pattern ({0}char{n_rep}) while looking for it
+ @param src First literal
+ @param src_size Bytes left in the RLE block
+ @param dst Where to copy them
+ @param dst_room Bytes left in the decompressed content
+ @returns Number of literals copied (Stops earlier if there's no room left)
+*/
+static inline unsigned long copy_literals (const uint8_t * src, unsigned long src_size, uint8_t * dst, unsigned long dst_room)
+{
+    unsigned long n = 0;
+
+#ifdef RLE_SIMD
+    const __m128i zero = _mm_setzero_si128();
+    __m128i chunk;
+    int mask;
+
+    // Whole vectors are stored even when a pattern starts inside them (What's after it gets overwritten)
+    while (n + 16 <= src_size && n + 16 <= dst_room) {
+        chunk = _mm_loadu_si128((const __m128i *) (src + n));
+        _mm_storeu_si128((__m128i *) (dst + n), chunk);
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero));
+        if (mask)
+            return n + __builtin_ctz(mask);
+        n += 16;
+    }
+
+    for ( ; n < src_size && n < dst_room && src[n]; ++n)
+        dst[n] = src[n];
+#else
+    const uint8_t * pattern;
+
+    n = src_size < dst_room ? src_size : dst_room;
+    pattern = memchr(src, 0, n);
+    if (pattern)
+        n = pattern - src;
+
+    memcpy(dst, src, n);
+#endif
+
+    return n;
+}
+
+/**
+\brief Writes a symbol's repetitions
+ @param dst Where to write them (With room for all of them)
+ @param simb Symbol
+ @param n_reps Number of repetitions
+*/
+static inline void fill_run (uint8_t * dst, uint8_t simb, unsigned long n_reps)
+{
+#ifdef RLE_SIMD
+    const __m128i run = _mm_set1_epi8((char) simb);
+    unsigned long k;
+
+    if (n_reps >= 16) {
+        for (k = 0; k + 16 <= n_reps; k += 16)
+            _mm_storeu_si128((__m128i *) (dst + k), run);
+        // Last vector overlaps the previous one instead of a byte by byte tail
+        _mm_storeu_si128((__m128i *) (dst + n_reps - 16), run);
+        return;
+    }
+#endif
+
+    memset(dst, simb, n_reps);
+}
+
+/**
+\brief Reads a RLE pattern of version 2: {0}{varint n_rep}char or {0}{0} for a single NUL
+ @param pattern Pattern's first byte (Always 0)
+ @param size Bytes left in the RLE block
+ @param simb Where to save the repeated symbol
+ @param n_reps Where to save the number of repetitions
+ @returns Pattern's size (0 if it's truncated or its varint is too long)
+*/
+static inline unsigned long read_pattern_v2 (const uint8_t * pattern, unsigned long size, uint8_t * simb, unsigned long * n_reps)
+{
+    unsigned long k = 1, reps = 0;
+    int shift = 0;
+
+    // Little-endian groups of 7 bits, the last one without the high bit
+    do {
+        if (k >= size || shift > 28)
+            return 0;
+        reps |= (unsigned long) (pattern[k] & 127) << shift;
+        shift += 7;
+    } while (pattern[k++] & 128);
+
+    if (!reps) {
+        *simb = 0;
+        *n_reps = 1;
+        return k;
+    }
+
+    if (k >= size)
+        return 0;
+
+    *simb = pattern[k];
+    *n_reps = reps;
+
+    return k + 1;
+}
+
 /**
 \brief Decompresses a RLE block
  @param args Arguments necessary to the function
@@ -120,82 +365,125 @@ static _modules_error rle_block_decompressor (void * _args)
     unsigned long block_size = args->rle_block_size;
     unsigned long * final_sizes = args->final_sizes;
     uint8_t * buffer = args->buffer;
-    uint8_t * sequence;
-    unsigned long orig_size, l;
-    char simb;
-    uint8_t n_reps;
-
-    // Assumption of the smallest size possible for the decompressed file
-    if (block_size <= _64KiB) 
-        orig_size = _64KiB + _1KiB;
-    else if (block_size <= _640KiB) 
-        orig_size = _640KiB + _1KiB;
-    else if (block_size <= _8MiB)
-        orig_size = _8MiB + _1KiB;
-    else 
-        orig_size = _64MiB + _1KiB;
+    uint8_t * sequence, simb;
+    unsigned long orig_size, l, i, n, n_reps;
+    bool exact = args->original_size;
+    double span = TRACE_BEGIN();
+    PerfSample sample;
+
+    // Exact size when the header has it (Otherwise the smallest size possible for the decompressed block is assumed)
+    orig_size = exact ? args->original_size : sequence_size(block_size);
 
     // Allocation of the corresponding memory 
-    sequence = malloc(orig_size);
+    sequence = bufpool_alloc(orig_size);
     if (sequence) {
 
-        // Loop to decompress block by block
+        PERF_BEGIN(sample);
+
+        // Each iteration writes a whole run: every symbol up to the next RLE pattern or the pattern itself
         l = 0; // Variable to be used to go through the sequence string 
-        for (unsigned long i = 0; i < block_size; ++i) {
-            
-            simb = buffer[i];
-            n_reps = 0;
-            // Case of RLE pattern {0}char{n_rep} 
-            if (!simb) {
-                simb = buffer[++i];
-                n_reps = buffer[++i];
-            } 
-            // Re-allocation of memory in the string
-            if (l + n_reps > orig_size) {
-                switch (orig_size) {
-                    case _64KiB + _1KiB:
-                        orig_size = _640KiB + _1KiB;
-                        break;
-                    case _640KiB + _1KiB:
-                        orig_size = _8MiB + _1KiB;
-                        break;
-                    case _8MiB + _1KiB:
-                        orig_size = _64MiB + _1KiB;
-                        break;
-                    default: // Invalid size
-                        error = _FILE_UNRECOGNIZABLE;
-                        free(sequence);
-                        return error;
+        for (i = 0; i < block_size && !error; i += n) {
+
+            // Case of RLE pattern: {0}char{n_rep} (Version 1, 0 repetitions still write the symbol once) or version 2's
+            if (!buffer[i]) {
+                if (args->rle_v2)
+                    n = read_pattern_v2(buffer + i, block_size - i, &simb, &n_reps);
+                else if (i + 2 < block_size) {
+                    simb = buffer[i + 1];
+                    n_reps = buffer[i + 2] ? buffer[i + 2] : 1;
+                    n = 3;
                 }
-                sequence = realloc(sequence, orig_size);
-                // In case of realloc failure, we free the previous memory allocation
-                if (!sequence) {
-                    error = _LACK_OF_MEMORY;
-                    free(sequence); // Frees the previously allocated memory
+                else
+                    n = 0;
+
+                if (!n) {
+                    error = _FILE_UNRECOGNIZABLE;
                     break;
                 }
-
+                if (l + n_reps > orig_size)
+                    error = grow_sequence(&sequence, &orig_size, exact, l + n_reps);
+                if (!error) {
+                    fill_run(sequence + l, simb, n_reps);
+                    l += n_reps;
+                }
             }
-            if (n_reps) {
-                memset(sequence + l, simb, n_reps);
-                l += n_reps;
+            else {
+                // Literals are copied while looking for the next pattern so they're only read once
+                n = copy_literals(buffer + i, block_size - i, sequence + l, orig_size - l);
+                l += n;
+
+                // Stopped before the next pattern (or the block's end) because there was no room left
+                if (i + n < block_size && buffer[i + n])
+                    error = grow_sequence(&sequence, &orig_size, exact, l + 1);
             }
-            else 
-                sequence[l++] = simb;
-            
         }
+
+        // A block shorter than its header says is as broken as a longer one
+        if (!error && exact && l != orig_size)
+            error = _FILE_UNRECOGNIZABLE;
+
         *final_sizes = l; 
 
+        PERF_END(sample, PERF_RLE_BLOCK_DECOMPRESSOR, l);
+
+        if (!error && args->bwt_index)
+            error = undo_bwt(sequence, l, args->bwt_index);
+
+        if (error) {
+            bufpool_free(sequence);
+            sequence = NULL;
+        }
+
         args->sequence = sequence;
+
+        if (!error && args->entropy)
+            *args->entropy = stats_block_entropy(sequence, l);
     }
     else 
         error = _LACK_OF_MEMORY;
     
-    free(buffer);
+    bufpool_free(buffer);
+    TRACE_END("rle decode", span);
 
     return error;
 }
 
+/**
+\brief Passes along a block which wasn't compressed with RLE (Only in files whose mode is 'A')
+ @param args Arguments necessary to the function
+ @returns Error status
+*/
+static _modules_error raw_block (void * _args)
+{
+    ArgumentsRLE * args = (ArgumentsRLE *) _args;
+
+    args->sequence = args->buffer;
+    *args->final_sizes = args->rle_block_size;
+
+    if (args->entropy)
+        *args->entropy = stats_block_entropy(args->sequence, args->rle_block_size);
+
+    return _SUCCESS;
+}
+
+/**
+\brief Passes along a hole of a sparse file (Nothing of it is in the RLE file)
+ @param args Arguments necessary to the function
+ @returns Error status
+*/
+static _modules_error hole_block (void * _args)
+{
+    ArgumentsRLE * args = (ArgumentsRLE *) _args;
+
+    args->sequence = NULL;
+    *args->final_sizes = args->original_size;
+
+    if (args->entropy)
+        *args->entropy = 0;
+
+    return _SUCCESS;
+}
+
 /**
  \brief Writes the contents resulting of the decompression of the RLE file
  @param _args Arguments to the function
@@ -214,13 +502,12 @@ static _modules_error write_decompressed_rle (void * const _args, _modules_error
 
         if (!prev_error) {
 
-            // Writing the decompressed block in ORIGINAL file
-            if (fwrite(sequence, sizeof(uint8_t), new_block_size, f_wrt) != new_block_size) 
-                error = _FILE_STREAM_FAILED; 
+            // Writing the decompressed block in ORIGINAL file (Holes are skipped so it keeps them and the last block is never one so its size is right)
+            error = write_block(f_wrt, sequence, new_block_size, args->offset);
 
         }
 
-        free(sequence); 
+        bufpool_free(sequence); 
     }
 
     free(_args);
@@ -228,10 +515,22 @@ static _modules_error write_decompressed_rle (void * const _args, _modules_error
     return error;
 }
 
+/**
+ \brief Decompresses a block whose offset in the ORIGINAL file is known and writes it right away
+ @param _args Arguments to the function
+ @returns Error status
+*/
+static _modules_error decompress_rle_at (void * const _args)
+{
+    ArgumentsRLE * args = (ArgumentsRLE *) _args;
+
+    return write_decompressed_rle(_args, _SUCCESS, args->decompress(_args));
+}
+
 
 _modules_error rle_decompress (char ** path) 
 {
-    _modules_error error = _SUCCESS;
+    _modules_error error = _SUCCESS, wait_error;
     FILE *f_rle, *f_freq, *f_wrt;
     char *path_freq, *path_wrt, *path_rle;
     uint8_t * buffer;
@@ -239,7 +538,13 @@ _modules_error rle_decompress (char ** path)
     unsigned long *rle_sizes, *final_sizes;
     unsigned long long length;
     float total_time;
+    double * entropies = NULL, span;
+    long long offset;
+    unsigned long new_size;
+    BlockHeader * headers = NULL;
+    FileHeader file_header;
     ArgumentsRLE * args;
+    _modules_error (* decompress)(void *);
     
     clock_main_thread(START_CLOCK);
 
@@ -265,19 +570,34 @@ _modules_error rle_decompress (char ** path)
                     if (f_freq) {
 
                         // Reads the header of the FREQ file
-                        if (fscanf(f_freq, "@%c@%lu", &mode, &length) == 2) {   
+                        if (!(error = read_file_header(f_freq, &file_header))) {   
+
+                            mode = file_header.mode;
+                            length = file_header.num_blocks;
 
-                            if (mode == 'R') {
+                            if (mode == 'R' || mode == 'A') {
 
                                 // Allocates memory for an array to contain the sizes of all the blocks of the RLE file
                                 rle_sizes = malloc(sizeof(unsigned long) * length);       
+
+                                // Blocks' headers tell which ones were compressed with RLE (Mode 'A') and their original size
+                                if (rle_sizes) {
+                                    headers = malloc(sizeof(BlockHeader) * length);
+                                    if (!headers) {
+                                        free(rle_sizes);
+                                        rle_sizes = NULL;
+                                    }
+                                }
+
                                 if (rle_sizes) {
 
                                     // Loads the sizes to the array
                                     for (unsigned long long i = 0; i < length && !error; ++i) {
-                                        if (fscanf(f_freq, "@%lu@%*[^@]", rle_sizes + i) != 1)                                          
-                                            error = _FILE_STREAM_FAILED;       
-                                                                                                                   
+                                        error = read_block_header(f_freq, &headers[i]);
+                                        if (!error && fscanf(f_freq, "%*[^@]") == EOF)
+                                            error = _FILE_STREAM_FAILED;
+
+                                        rle_sizes[i] = headers[i].size;
                                     }
 
                                     if (error) 
@@ -292,9 +612,6 @@ _modules_error rle_decompress (char ** path)
                                 error = _FILE_UNRECOGNIZABLE;
 
                         }
-                        else
-                            error = _FILE_STREAM_FAILED;  
-                            
 
                         fclose(f_freq);                   
 
@@ -313,43 +630,90 @@ _modules_error rle_decompress (char ** path)
 
                     // Allocates memory for an array that will contain the final size of the blocks after decompression
                     final_sizes = malloc(sizeof(unsigned long) * length);
+
+                    // Entropy of each block is only needed for the JSON statistics
+                    if (final_sizes && STATS == STATS_JSON) {
+                        entropies = malloc(sizeof(double) * length);
+                        if (!entropies) {
+                            free(final_sizes);
+                            final_sizes = NULL;
+                        }
+                    }
+
                     if (final_sizes) {
 
+                        // Blocks are written at their offset (Preallocated) while their decompressed sizes are known
+                        offset = FIRST_OFFSET;
+
                         // Loop to execute block by block
                         for (unsigned long long thread_idx = 0; thread_idx < length; ++thread_idx) {
+
+                            decompress = headers[thread_idx].hole ? hole_block : mode == 'R' || headers[thread_idx].rle ? rle_block_decompressor : raw_block;
+                            new_size = decompress == raw_block ? rle_sizes[thread_idx] : headers[thread_idx].original_size;
+
+                            // Files written before RLE blocks recorded their original size are written in order from the first one of those
+                            if (offset >= 0 && !new_size) {
+                                if (fseek(f_wrt, offset, SEEK_SET)) {
+                                    error = _FILE_STREAM_FAILED;
+                                    break;
+                                }
+                                offset = -1;
+                            }
                                 
                             // Loading rle block
-                            error = load_rle(f_rle, rle_sizes[thread_idx], &buffer);
+                            span = TRACE_BEGIN();
+                            buffer = NULL;
+                            if (!headers[thread_idx].hole)
+                                error = load_rle(f_rle, rle_sizes[thread_idx], &buffer);
+                            TRACE_END("read block", span);
                             if (error) break;
 
                             args = malloc(sizeof(ArgumentsRLE)); 
 
                             if (!args) {
-                                free(buffer);
+                                bufpool_free(buffer);
+                                error = _LACK_OF_MEMORY;
                                 break;
                             }
 
                             *args = (ArgumentsRLE) {
                                 .rle_block_size = rle_sizes[thread_idx],
+                                .original_size = headers[thread_idx].original_size,
+                                .bwt_index = headers[thread_idx].bwt_index,
+                                .rle_v2 = file_header.rle_v2,
+                                .offset = offset,
+                                .decompress = decompress,
                                 .buffer = buffer,
                                 .f_rle = f_rle, 
                                 .f_wrt = f_wrt,
-                                .final_sizes = &final_sizes[thread_idx]
+                                .final_sizes = &final_sizes[thread_idx],
+                                .entropy = entropies ? &entropies[thread_idx] : NULL
 
                             };       
 
+                            if (offset >= 0) {
+                                if (!headers[thread_idx].hole)
+                                    preallocate(f_wrt, offset, new_size);
+                                offset += new_size;
+                            }
+
                             // Decompressing the RLE block and loading the final size of the blocks after decompression to the array
-                            error = multithread_create(rle_block_decompressor, write_decompressed_rle, args);
+                            if (args->offset >= 0)
+                                error = multithread_create(decompress_rle_at, NULL, args);
+                            else
+                                error = multithread_create(decompress, write_decompressed_rle, args);
                                 
                             if (error) {
                                 free(args);
-                                free(buffer);
+                                bufpool_free(buffer);
                                 break;
                             }
     
                         }
 
-                        multithread_wait();
+                        wait_error = multithread_wait();
+                        if (!error)
+                            error = wait_error;
 
                                          
                         if (error) 
@@ -378,12 +742,21 @@ _modules_error rle_decompress (char ** path)
         free(path_rle);
         *path = path_wrt;
         total_time = clock_main_thread(STOP_CLOCK);
-        print_summary(total_time, rle_sizes, final_sizes, length, *path, _RLE);
+        if (STATS == STATS_JSON)
+            error = stats_add_stage("d", "RLE decompression", length, rle_sizes, final_sizes, entropies, *path);
+        else if (STATS != STATS_NONE) {
+            multithread_lock();
+            print_summary(total_time, rle_sizes, final_sizes, length, *path, _RLE);
+            multithread_unlock();
+        }
         free(rle_sizes);
         free(final_sizes);
 
     }
 
+    free(entropies);
+    free(headers);
+
     return error;
 }
 
@@ -396,46 +769,50 @@ typedef struct btree{
     struct btree *left,*right;
 } *BTree;
 
+#define MAX_TREE_NODES (2 * 256 - 1) // Full binary tree with a leaf for each symbol
+
 /**
-\brief Frees all the memory used by a BTree
+\brief Frees all the memory used by a BTree (Its nodes were allocated at once, the root first)
  @param tree Binary tree
 */
 static void free_tree(BTree tree) 
 {
-    if (tree) {
-        free_tree(tree->right);
-        free_tree(tree->left);
-        free(tree);
-    }
-
+    bufpool_free(tree);
 }
 
 /**
 \brief Adds a given symbol to the BTree
  @param decoder Tree with saved symbols to help in decoding
+ @param nodes Nodes of the tree
+ @param used Number of nodes already in the tree
  @param code String with the codes from COD file
  @param start Beggining of the code to be added
  @param end Ending of the code to be added
  @param symbol Symbol to be saved in the tree 
  @returns Error status
 */
-static _modules_error add_tree(BTree* decoder, char *code, int start, int end, char symbol) 
+static _modules_error add_tree(BTree* decoder, BTree nodes, int *used, const char *code, int start, int end, char symbol) 
 {
     // Creation of the path to the symbol we are placing
     for (int i = start; i < end; ++i) {
 
+        // Anything else would replace the node it's at (Even the root)
+        if (code[i] != '0' && code[i] != '1') return _FILE_UNRECOGNIZABLE;
+
         if (*decoder && code[i] == '0') decoder = &(*decoder)->left;
         else if (*decoder && code[i] == '1') decoder = &(*decoder)->right;
         else {
-            *decoder = malloc(sizeof(struct btree));
-            if (!(*decoder)) return _LACK_OF_MEMORY;
+            // Codes which aren't prefix free could need more nodes than any valid tree
+            if (*used == MAX_TREE_NODES) return _FILE_UNRECOGNIZABLE;
+            *decoder = &nodes[(*used)++];
             (*decoder)->left = (*decoder)->right = NULL;
             if (code[i] == '0') decoder = &(*decoder)->left;
             else decoder = &(*decoder)->right;
         } 
     }
     // Adding the symbol to the corresponding leaf of the tree
-    *decoder = malloc(sizeof(struct btree));
+    if (*used == MAX_TREE_NODES) return _FILE_UNRECOGNIZABLE;
+    *decoder = &nodes[(*used)++];
     (*decoder)->symbol = symbol;
     (*decoder)->left = (*decoder)->right = NULL;
     return _SUCCESS;
@@ -447,30 +824,43 @@ static _modules_error add_tree(BTree* decoder, char *code, int start, int end, c
 typedef struct {
 
 	FILE * f_wrt;
+    FILE * f_shafa;
+    long shafa_offset; // Where the block's content starts in the SHAFA file (If it isn't loaded by the main thread)
+    unsigned long shafa_size;
+    long long offset; // Where the block goes in the generated file (-1 if it's written in order)
     char * cod_code;
 	unsigned long * rle_sizes;
 	unsigned long * final_sizes;
+    unsigned long original_size; // 0 if the block's header doesn't have it
+    unsigned long bwt_index; // 0 if the block wasn't transformed with Burrows-Wheeler before RLE
+    bool rle_v2;
 	uint8_t * rle_decompressed;
 	uint8_t * shafa_decompressed;
 	uint8_t * shafa_code;
-    bool rle_decompression;
+    double * entropy;
+    bool rle_decompression; // Only for this block (Not every block of a file in mode 'A' was compressed with RLE)
+    bool ans; // Coded with rANS (cod_code has the normalized frequencies)
+    bool order1; // Coded with the codes of each context (cod_code has them before the block's own ones)
+    bool stored;
+    bool hole;
+    bool load; // The worker reads the block's content from the SHAFA file
 		
 } ArgumentsSHAFA;
 
 /**
 \brief Generates a binary tree that contains the symbols acording to the codes
- @param code String with a block of the COD file
+ @param code String with a block of the COD file (Or a context's codes, it's the caller's to be freed)
  @param decoder Pointer to the binary tree
  @returns Error status
 */
-static _modules_error create_tree (char * code, BTree * decoder)
+static _modules_error create_tree (const char * code, BTree * decoder)
 {
     _modules_error error;
-    int j, start, end;
+    int j, start, end, used = 1;
 
     error = _SUCCESS;
-    // Initialize root without meaning 
-    *decoder = malloc(sizeof(struct btree));
+    // Initialize root without meaning (Every node is taken from a single allocation)
+    *decoder = bufpool_alloc(MAX_TREE_NODES * sizeof(struct btree));
     
     if (*decoder) {
         
@@ -490,11 +880,13 @@ static _modules_error create_tree (char * code, BTree * decoder)
 
             if (start != end) 
                 // Adds the code to the tree
-                error = add_tree(decoder, code, start, end, symb);
+                error = add_tree(decoder, *decoder, &used, code, start, end, symb);
            
         }
 
-        free(code);       
+        // Blocks of a single symbol used to get no code at all (Can't be decoded)
+        if (!error && !(*decoder)->left && !(*decoder)->right)
+            error = _FILE_UNRECOGNIZABLE;
     }
     else 
         error = _LACK_OF_MEMORY;
@@ -506,12 +898,13 @@ static _modules_error create_tree (char * code, BTree * decoder)
 /**
 \brief Decompresses a block of shafa code
  @param shafa Content of the file to be descompressed
+ @param shafa_size Size of the content
  @param block_size Block size
  @param decoder Binary tree with the symbols
  @param decomp Address to load a string with the decompressed contents
  @returns Error status
 */
-static _modules_error shafa_block_decompressor (uint8_t * shafa, unsigned long block_size, BTree decoder, uint8_t ** decomp) 
+static _modules_error shafa_block_decompressor (uint8_t * shafa, unsigned long shafa_size, unsigned long block_size, BTree decoder, uint8_t ** decomp) 
 {
     BTree root;
     uint8_t mask;
@@ -519,7 +912,7 @@ static _modules_error shafa_block_decompressor (uint8_t * shafa, unsigned long b
     int bit;
 
     // String for the decompressed contents 
-    *decomp = malloc(block_size);
+    *decomp = bufpool_alloc(block_size);
     if (!(*decomp)) return _LACK_OF_MEMORY;
 
     root = decoder; // Saving the root for multiple crossings in the tree
@@ -528,6 +921,13 @@ static _modules_error shafa_block_decompressor (uint8_t * shafa, unsigned long b
 
     // Loop to check every byte, bit by bit (it's used the final size to control the cycle to avoid padding excess)
     while (l < block_size) {
+
+        // Truncated or corrupt content (Or a code which doesn't exist in the tree)
+        if (i == shafa_size || !decoder) {
+            bufpool_free(*decomp);
+            *decomp = NULL;
+            return _FILE_UNRECOGNIZABLE;
+        }
         
         bit = mask & shafa[i];
         if (!bit) decoder = decoder->left; // bit = 0
@@ -550,235 +950,1250 @@ static _modules_error shafa_block_decompressor (uint8_t * shafa, unsigned long b
     return _SUCCESS;
 }
 
-/** Does the process of the main function: includes the creation of a binary tree, the shafa block decompression and, if needed, the rle block decompression
- \brief 
- @param _args Arguments of the function
+/**
+\brief Decompresses a block of shafa code expanding its RLE patterns as soon as their symbols are decoded (No intermediate RLE block)
+ @param shafa Content of the file to be descompressed
+ @param shafa_size Size of the content
+ @param rle_size Number of symbols coded (RLE block size)
+ @param original_size Size of the decompressed contents (0 if unknown)
+ @param rle_v2 Whether RLE's patterns are of version 2
+ @param decoder Binary tree with the symbols
+ @param decomp Address to load a string with the decompressed contents
+ @param final_size Address to load the size of the decompressed contents
  @returns Error status
 */
-static _modules_error process_shafa_decomp (void * _args) {
-
+static _modules_error shafa_rle_block_decompressor (const uint8_t * shafa, unsigned long shafa_size, unsigned long rle_size, unsigned long original_size, bool rle_v2, BTree decoder, uint8_t ** decomp, unsigned long * final_size)
+{
     _modules_error error;
-    ArgumentsSHAFA * args_shafa = (ArgumentsSHAFA *) _args; 
-    BTree decoder; 
-    ArgumentsRLE args_rle;
+    BTree root;
+    uint8_t mask, symbol, simb = 0, * sequence;
+    unsigned long i, l, n, decoded, orig_size, n_reps = 0;
+    bool exact = original_size;
+    int shift = 0;
+    int state = 0; // 0 -> Any symbol | 1 -> Version 1: symbol of a RLE pattern, version 2: its repetitions | 2 -> Version 1: its repetitions, version 2: its symbol
 
-    error = create_tree(args_shafa->cod_code, &decoder);
+    orig_size = exact ? original_size : sequence_size(rle_size);
+    sequence = bufpool_alloc(orig_size);
+    if (!sequence) return _LACK_OF_MEMORY;
 
-    if (!error) {
+    root = decoder;
+    mask = 128;
+    i = l = decoded = 0;
 
-        error = shafa_block_decompressor(args_shafa->shafa_code, *args_shafa->rle_sizes, decoder, &args_shafa->shafa_decompressed);
+    while (decoded < rle_size) {
 
-        free(args_shafa->shafa_code);
-        free_tree(decoder);
+        if (i == shafa_size) {
+            bufpool_free(sequence);
+            return _FILE_UNRECOGNIZABLE;
+        }
 
-        if (!error && args_shafa->rle_decompression) {
+        decoder = (mask & shafa[i]) ? decoder->right : decoder->left;
 
-            args_rle = (ArgumentsRLE) {
-                .buffer = args_shafa->shafa_decompressed,
-                .rle_block_size = *args_shafa->rle_sizes,
-                .final_sizes = args_shafa->final_sizes
-            };
+        mask >>= 1;
+        if (!mask) {
+            ++i;
+            mask = 128;
+        }
 
-            error = rle_block_decompressor(&args_rle);
-            if (!error) {
-                args_shafa->rle_decompressed = args_rle.sequence;
+        // Code that doesn't exist in the tree
+        if (!decoder) {
+            bufpool_free(sequence);
+            return _FILE_UNRECOGNIZABLE;
+        }
+
+        if (decoder->left || decoder->right)
+            continue;
+
+        symbol = decoder->symbol;
+        decoder = root;
+        ++decoded;
+
+        // Case of RLE pattern: {0}char{n_rep} (Version 1) or {0}{varint n_rep}char and {0}{0} for a single NUL (Version 2)
+        if (state == 0 && !symbol) {
+            state = 1;
+            n_reps = shift = 0;
+            continue;
+        }
+        if (state == 1 && rle_v2) {
+            if (shift > 28) {
+                bufpool_free(sequence);
+                return _FILE_UNRECOGNIZABLE;
             }
+            n_reps |= (unsigned long) (symbol & 127) << shift;
+            shift += 7;
+            if (symbol & 128)
+                continue;
+            state = n_reps ? 2 : 0;
+            if (state)
+                continue;
+            symbol = 0; // Single NUL
+        }
+        else if (state == 1) {
+            simb = symbol;
+            state = 2;
+            continue;
+        }
+
+        // Either a pattern's repetitions (0 still writes it once as rle_block_decompressor does) or a plain symbol
+        if (state == 2) {
+            if (rle_v2)
+                simb = symbol;
+            else
+                n_reps = symbol ? symbol : 1;
+            n = n_reps;
+            state = 0;
+        }
+        else {
+            simb = symbol;
+            n = 1;
+        }
+
+        if (l + n > orig_size && (error = grow_sequence(&sequence, &orig_size, exact, l + n)))
+            return error;
+
+        if (n == 1)
+            sequence[l++] = simb;
+        else {
+            fill_run(sequence + l, simb, n);
+            l += n;
         }
     }
 
-    return error;
+    // A block shorter than its header says is as broken as a longer one
+    if (exact && l != orig_size) {
+        bufpool_free(sequence);
+        return _FILE_UNRECOGNIZABLE;
+    }
+
+    *decomp = sequence;
+    *final_size = l;
+
+    return _SUCCESS;
 }
 
 /**
- \brief Writes the decompressed shafa in the destined file
- @param _args Arguments of the function
- @param prev_error Previous thread error status
- @param error Process error status
+\brief Decompresses a block coded with rANS
+ @param cod_code Normalized frequencies of the block (Freed once its table is built)
+ @param ans Content of the block to be decompressed
+ @param ans_size Size of the content
+ @param block_size Number of symbols of the block
+ @param decomp Address to load a string with the decompressed contents
  @returns Error status
 */
-static _modules_error write_decompressed_shafa (void * _args, _modules_error prev_error, _modules_error error) {
+static _modules_error ans_block_decompressor (char * cod_code, const uint8_t * ans, unsigned long ans_size, unsigned long block_size, uint8_t ** decomp)
+{
+    _modules_error error;
+    RansTable * table;
+    double span = TRACE_BEGIN();
+    PerfSample sample;
 
-    ArgumentsSHAFA * args_shafa = (ArgumentsSHAFA *) _args; 
-    unsigned long size_wrt;
-    uint8_t * decomp;
-    FILE * f_wrt = args_shafa->f_wrt;
-    bool rle_decompression = args_shafa->rle_decompression;
+    table = bufpool_alloc(sizeof(RansTable));
+    error = table ? rans_read_table(cod_code, table) : _LACK_OF_MEMORY;
+    bufpool_free(cod_code);
+    TRACE_END("build table", span);
 
     if (!error) {
+        *decomp = bufpool_alloc(block_size);
+        if (!*decomp)
+            error = _LACK_OF_MEMORY;
+    }
 
-        if (!prev_error) {
-
-            size_wrt = (rle_decompression) ? (*args_shafa->final_sizes) : (*args_shafa->rle_sizes);
-            decomp = (rle_decompression) ? (args_shafa->rle_decompressed) : (args_shafa->shafa_decompressed);
-            if (fwrite(decomp, sizeof(uint8_t), size_wrt, f_wrt) != size_wrt) 
-                error = _FILE_STREAM_FAILED;
-
+    if (!error) {
+        span = TRACE_BEGIN();
+        PERF_BEGIN(sample);
+        error = rans_decode(table, ans, ans_size, *decomp, block_size);
+        PERF_END(sample, PERF_RANS_DECODE, block_size);
+        TRACE_END("decode", span);
+
+        if (error) {
+            bufpool_free(*decomp);
+            *decomp = NULL;
         }
+    }
 
-        if (rle_decompression) 
-            free(args_shafa->rle_decompressed);    
-    } 
-
-    free(_args);
+    bufpool_free(table);
 
     return error;
 }
 
-
-_modules_error shafa_decompress (char ** const path, bool rle_decompression) 
+/**
+\brief Decompresses a block coded with the codes of each context (The previous symbol, 0 for the first one)
+ @param cod_code Codes of the block: (<context>:<codes>|)* followed by the ones of the other contexts (Freed once its trees are built)
+ @param shafa Content of the block to be decompressed
+ @param shafa_size Size of the content
+ @param block_size Number of symbols of the block
+ @param decomp Address to load a string with the decompressed contents
+ @returns Error status
+*/
+static _modules_error context_block_decompressor (char * cod_code, const uint8_t * shafa, unsigned long shafa_size, unsigned long block_size, uint8_t ** decomp)
 {
-    _modules_error error;
-    FILE *f_shafa, *f_cod, *f_wrt;
-    char *path_cod, *path_wrt, *path_shafa, *path_tmp;
-    uint8_t * shafa_code; 
-    char * cod_code;
-    char mode;
-    float total_time;
-    unsigned long long length;
-    unsigned long *sizes, *sf_sizes, *final_sizes;
-    unsigned long sf_bsize;
-    ArgumentsSHAFA * args;
+    _modules_error error = _SUCCESS;
+    BTree trees[256] = {NULL}, own = NULL, decoder;
+    char * code = cod_code, * separator, * end;
+    unsigned long context, i, l;
+    uint8_t mask;
+    double span = TRACE_BEGIN();
+    PerfSample sample;
 
-    sizes = sf_sizes = final_sizes = NULL;
-    path_shafa = *path;
-    error = _SUCCESS;
-    clock_main_thread(START_CLOCK);
+    // Trees of the contexts with their own codes first
+    while (!error && (separator = strchr(code, '|'))) {
+        *separator = '\0';
+        context = strtoul(code, &end, 10);
 
-    // Opening the shafa file
-    f_shafa = fopen(path_shafa, "rb");
-    if (f_shafa) {
+        if (end == code || *end != ':' || context >= 256 || trees[context])
+            error = _FILE_UNRECOGNIZABLE;
+        else
+            error = create_tree(end + 1, &trees[context]);
 
-        // Creates path to the .cod file
-        path_tmp = rm_ext(path_shafa);
-        if (path_tmp) { // free this somehow
+        code = separator + 1;
+    }
 
-            if (rle_decompression) {
-                path_wrt = rm_ext(path_tmp);
-                if (!path_wrt) 
-                    error = _LACK_OF_MEMORY;
-            }
-            else 
-                path_wrt = path_tmp;
+    if (!error)
+        error = create_tree(code, &own);
+    bufpool_free(cod_code);
+    TRACE_END("build tree", span);
 
-            f_wrt = fopen(path_wrt, "wb");
-            if (f_wrt) {
-                
-                path_cod = add_ext(path_tmp, CODES_EXT);
-                if (path_cod) {
+    if (!error) {
+        *decomp = bufpool_alloc(block_size);
+        if (!*decomp)
+            error = _LACK_OF_MEMORY;
+    }
 
-                    f_cod = fopen(path_cod, "rb");
-                    if (f_cod) {
+    if (!error) {
+        span = TRACE_BEGIN();
+        PERF_BEGIN(sample);
+
+        // The other contexts use the block's own tree
+        for (int idx = 0; idx < 256; ++idx)
+            if (!trees[idx])
+                trees[idx] = own;
+
+        decoder = trees[0];
+        mask = 128;
+        i = l = 0;
+
+        while (l < block_size) {
+
+            if (i == shafa_size) {
+                error = _FILE_UNRECOGNIZABLE;
+                break;
+            }
+
+            decoder = mask & shafa[i] ? decoder->right : decoder->left;
+
+            // A code which doesn't exist in the context's tree
+            if (!decoder) {
+                error = _FILE_UNRECOGNIZABLE;
+                break;
+            }
+
+            // Finds a leaf of the tree and the next symbol is decoded with its context's tree
+            if (!decoder->left && !decoder->right) {
+                (*decomp)[l++] = decoder->symbol;
+                decoder = trees[(uint8_t) decoder->symbol];
+            }
+
+            mask >>= 1;
+            if (!mask) {
+                ++i;
+                mask = 128;
+            }
+        }
+
+        PERF_END(sample, PERF_SHAFA_BLOCK_DECOMPRESSOR, error ? 0 : block_size);
+        TRACE_END("decode", span);
+
+        if (error) {
+            bufpool_free(*decomp);
+            *decomp = NULL;
+        }
+    }
+
+    for (int idx = 0; idx < 256; ++idx)
+        if (trees[idx] != own)
+            free_tree(trees[idx]);
+    free_tree(own);
+
+    return error;
+}
+
+/**
+\brief Reads a block of the SHAFA file without using (or moving) its stream so workers read their blocks at the same time
+ @param f_shafa SHAFA stream
+ @param offset Where the block's content starts
+ @param size Block's size
+ @param shafa_code Where to save the allocated block
+ @returns Error status
+*/
+static _modules_error load_shafa (FILE * const f_shafa, long offset, unsigned long size, uint8_t ** shafa_code)
+{
+#ifdef POSITIONAL_IO
+    ssize_t read;
+
+    *shafa_code = bufpool_alloc(size);
+    if (!*shafa_code)
+        return _LACK_OF_MEMORY;
+
+    for (unsigned long done = 0; done < size; done += read) {
+        read = pread(fileno(f_shafa), *shafa_code + done, size - done, offset + done);
+        if (read <= 0) {
+            bufpool_free(*shafa_code);
+            *shafa_code = NULL;
+            return _FILE_STREAM_FAILED;
+        }
+    }
+
+    return _SUCCESS;
+#else
+    // The main thread loads every block when it can't be read at an offset
+    (void) f_shafa; (void) offset; (void) size; (void) shafa_code;
+    return _FILE_STREAM_FAILED;
+#endif
+}
+
+/** Does the process of the main function: includes the creation of a binary tree, the shafa block decompression and, if needed, the rle block decompression
+ \brief 
+ @param _args Arguments of the function
+ @returns Error status
+*/
+static _modules_error process_shafa_decomp (void * _args) {
+
+    _modules_error error;
+    ArgumentsSHAFA * args_shafa = (ArgumentsSHAFA *) _args; 
+    BTree decoder; 
+    ArgumentsRLE args_rle;
+    double span = TRACE_BEGIN();
+    PerfSample sample;
+
+    if (args_shafa->hole) {
+        // Holes have neither codes nor content (Their size is already known)
+        bufpool_free(args_shafa->cod_code);
+        if (args_shafa->final_sizes)
+            *args_shafa->final_sizes = args_shafa->original_size;
+        if (args_shafa->entropy)
+            *args_shafa->entropy = 0;
+        return _SUCCESS;
+    }
+
+    if (args_shafa->load) {
+        span = TRACE_BEGIN();
+        error = load_shafa(args_shafa->f_shafa, args_shafa->shafa_offset, args_shafa->shafa_size, &args_shafa->shafa_code);
+        TRACE_END("read block", span);
+
+        if (error) {
+            bufpool_free(args_shafa->cod_code);
+            return error;
+        }
+    }
+
+    if (args_shafa->stored) {
+        // Nothing to decode (NULL if it will be copied straight from the file)
+        bufpool_free(args_shafa->cod_code);
+        args_shafa->shafa_decompressed = args_shafa->shafa_code;
+        error = _SUCCESS;
+    }
+    else if (args_shafa->ans) {
+        error = ans_block_decompressor(args_shafa->cod_code, args_shafa->shafa_code, args_shafa->shafa_size, *args_shafa->rle_sizes, &args_shafa->shafa_decompressed);
+        bufpool_free(args_shafa->shafa_code);
+    }
+    else if (args_shafa->order1) {
+        error = context_block_decompressor(args_shafa->cod_code, args_shafa->shafa_code, args_shafa->shafa_size, *args_shafa->rle_sizes, &args_shafa->shafa_decompressed);
+        bufpool_free(args_shafa->shafa_code);
+    }
+    else {
+        error = create_tree(args_shafa->cod_code, &decoder);
+        bufpool_free(args_shafa->cod_code);
+        TRACE_END("build tree", span);
+
+        if (!error && args_shafa->rle_decompression) {
+            // RLE patterns are expanded while decoding so the RLE block is never built
+            span = TRACE_BEGIN();
+            PERF_BEGIN(sample);
+            error = shafa_rle_block_decompressor(args_shafa->shafa_code, args_shafa->shafa_size, *args_shafa->rle_sizes, args_shafa->original_size, args_shafa->rle_v2, decoder, &args_shafa->rle_decompressed, args_shafa->final_sizes);
+            PERF_END(sample, PERF_SHAFA_RLE_BLOCK_DECOMPRESSOR, error ? 0 : *args_shafa->final_sizes);
+            TRACE_END("decode + rle decode", span);
+
+            if (!error && args_shafa->bwt_index)
+                error = undo_bwt(args_shafa->rle_decompressed, *args_shafa->final_sizes, args_shafa->bwt_index);
+        }
+        else if (!error) {
+            span = TRACE_BEGIN();
+            PERF_BEGIN(sample);
+            error = shafa_block_decompressor(args_shafa->shafa_code, args_shafa->shafa_size, *args_shafa->rle_sizes, decoder, &args_shafa->shafa_decompressed);
+            PERF_END(sample, PERF_SHAFA_BLOCK_DECOMPRESSOR, *args_shafa->rle_sizes);
+            TRACE_END("decode", span);
+        }
+
+        bufpool_free(args_shafa->shafa_code);
+        free_tree(decoder);
+    }
+
+    if (!error) {
+
+        // Only stored blocks (and the ones decoded with rANS or contexts) still need RLE's decompression on its own
+        if (args_shafa->rle_decompression && (args_shafa->stored || args_shafa->ans || args_shafa->order1)) {
+
+            args_rle = (ArgumentsRLE) {
+                .buffer = args_shafa->shafa_decompressed,
+                .rle_block_size = *args_shafa->rle_sizes,
+                .original_size = args_shafa->original_size,
+                .bwt_index = args_shafa->bwt_index,
+                .rle_v2 = args_shafa->rle_v2,
+                .final_sizes = args_shafa->final_sizes
+            };
+
+            error = rle_block_decompressor(&args_rle);
+            if (!error) {
+                args_shafa->rle_decompressed = args_rle.sequence;
+            }
+        }
+
+        // Blocks left as they were still count for the RLE decompression's statistics
+        else if (!args_shafa->rle_decompression && args_shafa->final_sizes)
+            *args_shafa->final_sizes = *args_shafa->rle_sizes;
+
+        if (!error && args_shafa->entropy) {
+            if (args_shafa->rle_decompression)
+                *args_shafa->entropy = stats_block_entropy(args_shafa->rle_decompressed, *args_shafa->final_sizes);
+            else
+                *args_shafa->entropy = stats_block_entropy(args_shafa->shafa_decompressed, *args_shafa->rle_sizes);
+        }
+    }
+
+    return error;
+}
+
+/**
+\brief Copies a stored block straight from the SHAFA file to the generated one (Without going through user space when the kernel can)
+ @param f_shafa SHAFA stream (Only its descriptor is used so its position doesn't change)
+ @param offset Where the block starts in the SHAFA file
+ @param f_wrt Stream where to write the block
+ @param size Block size
+ @param offset_wrt Block's offset in the generated file (-1 if the blocks are written in order)
+ @returns Error status
+*/
+static _modules_error copy_stored (FILE * const f_shafa, long offset, FILE * const f_wrt, unsigned long size, long long offset_wrt)
+{
+#ifdef COPY_FILE_RANGE
+    _modules_error error = _SUCCESS;
+    loff_t offset_in = offset, offset_out = offset_wrt;
+    ssize_t copied;
+    uint8_t * buffer;
+
+    // Everything written by stdio must reach the descriptor first
+    if (offset_wrt < 0 && fflush(f_wrt))
+        return _FILE_STREAM_FAILED;
+
+    for ( ; size; size -= copied) {
+        copied = copy_file_range(fileno(f_shafa), &offset_in, fileno(f_wrt), offset_wrt < 0 ? NULL : &offset_out, size, 0);
+        if (copied <= 0)
+            break; // Not supported between these files (e.g. older kernels across file systems)
+    }
+
+    if (!size)
+        return _SUCCESS;
 
-                        // Reading header of shafa file
-                        if (fscanf(f_shafa, "@%lu", &length) == 1) {
-
-                            // Reading header of cod file
-                            if (fscanf(f_cod, "@%c@%lu", &mode, &length) == 2) {
-                                // Checking the mode of the file
-                                if ((mode == 'N' && !rle_decompression) || (mode == 'R')) {   
-
-                                    // Allocates memory to an array with the purpose of saving the size of each SHAF block
-                                    sf_sizes = malloc(sizeof(unsigned long) * length);
-                                    if (sf_sizes) {
-
-                                        // Allocates memory to an array with the purpose of saving the sizes of each RLE/ORIGINAL block
-                                        sizes = malloc(sizeof(unsigned long) * length);
-                                        if (sizes) {
-
-                                            if (rle_decompression) {
-                                                final_sizes = malloc(sizeof(unsigned long) * length);
-                                                if (!final_sizes)
-                                                    error = _LACK_OF_MEMORY;
-                                            }  
-
-                                            for (unsigned long long thread_idx = 0; thread_idx < length && !error; ++thread_idx) {
-
-                                                // Reads the size of the shafa blockss
-                                                if (fscanf(f_shafa, "@%lu@", &sf_bsize) == 1) {
-
-                                                    sf_sizes[thread_idx] = sf_bsize;
-
-                                                    // Allocates memory to a buffer in which will be loaded one block of shafa code                                                         
-                                                    shafa_code = malloc(sf_bsize); 
-                                                    if (shafa_code) {
-
-                                                        // Reads a block of shafa code
-                                                        if (fread(shafa_code, sizeof(uint8_t), sf_bsize, f_shafa) == sf_bsize) { 
-
-                                                            // Reads the size of the decompressed shafa code and saves it
-                                                            if (fscanf(f_cod, "@%lu", &sizes[thread_idx]) == 1) {
-
-                                                                // Allocates memory for a block of COD code
-                                                                cod_code = malloc(33152); //sum 1 to 256 (worst case shannon fano) + 255 semicolons + 1 byte NULL
-                                                                if (cod_code) {
-
-                                                                    // Loads the block of COD code
-                                                                    if (fscanf(f_cod,"@%33151[^@]", cod_code) == 1) {
-
-                                                                        // Allocates memory for the arguments
-                                                                        args = malloc(sizeof(ArgumentsSHAFA)); 
-                                                                        if (!args) {
-                                                                            error = _LACK_OF_MEMORY;
-                                                                            free(shafa_code);
-                                                                            break;
-                                                                        }
-                                                                            
-                                                                        // Arguments for the SHAFA multithread
-                                                                        *args = (ArgumentsSHAFA) {
-                                                                            .f_wrt = f_wrt,
-                                                                            .shafa_code = shafa_code,
-                                                                            .rle_decompression = rle_decompression,
-                                                                            .rle_sizes = &sizes[thread_idx],
-                                                                            .final_sizes = &final_sizes[thread_idx],
-                                                                            .cod_code = cod_code
-                                                                        };
-                                                                        error = multithread_create(process_shafa_decomp, write_decompressed_shafa, args); 
-                                                                            
-                                                                        if (error) {
-                                                                            free(cod_code);
-                                                                            break;
-                                                                        }
-                                                                    }
-                                                                    else 
-                                                                        error = _FILE_STREAM_FAILED;
-                                                                            
-                                                                }
-                                                                else 
-                                                                    error = _LACK_OF_MEMORY;
-                                                            }
-                                                            else 
-                                                                error = _FILE_STREAM_FAILED;
-                                                                   
+    // Whatever is left goes through user space
+    buffer = bufpool_alloc(size);
+    if (!buffer)
+        return _LACK_OF_MEMORY;
+
+    for (unsigned long done = 0; done < size && !error; done += copied) {
+        copied = pread(fileno(f_shafa), buffer + done, size - done, offset_in + done);
+        if (copied <= 0)
+            error = _FILE_STREAM_FAILED;
+    }
+
+    if (!error)
+        error = write_block(f_wrt, buffer, size, offset_wrt < 0 ? -1 : offset_out);
+
+    bufpool_free(buffer);
+
+    return error;
+#else
+    // Stored blocks are always loaded when the kernel can't copy them
+    (void) f_shafa; (void) offset; (void) f_wrt; (void) size; (void) offset_wrt;
+    return _FILE_UNRECOGNIZABLE;
+#endif
+}
+
+
+/**
+ \brief Writes the decompressed shafa in the destined file
+ @param _args Arguments of the function
+ @param prev_error Previous thread error status
+ @param error Process error status
+ @returns Error status
+*/
+static _modules_error write_decompressed_shafa (void * _args, _modules_error prev_error, _modules_error error) {
+
+    ArgumentsSHAFA * args_shafa = (ArgumentsSHAFA *) _args; 
+    unsigned long size_wrt;
+    uint8_t * decomp;
+    FILE * f_wrt = args_shafa->f_wrt;
+    bool rle_decompression = args_shafa->rle_decompression;
+
+    if (!error) {
+
+        if (!prev_error) {
+
+            size_wrt = (rle_decompression) ? (*args_shafa->final_sizes) : (*args_shafa->rle_sizes);
+            decomp = (rle_decompression) ? (args_shafa->rle_decompressed) : (args_shafa->shafa_decompressed);
+
+            if (!decomp && !args_shafa->hole) // Stored block left in the SHAFA file
+                error = copy_stored(args_shafa->f_shafa, args_shafa->shafa_offset, f_wrt, size_wrt, args_shafa->offset);
+            else // Holes are skipped so the generated file keeps them (The last block is never one so its size is right)
+                error = write_block(f_wrt, args_shafa->hole ? NULL : decomp, size_wrt, args_shafa->offset);
+
+        }
+    } 
+
+    // RLE's decompression already freed the SHAFA decompressed block
+    if (rle_decompression) 
+        bufpool_free(args_shafa->rle_decompressed);    
+    else
+        bufpool_free(args_shafa->shafa_decompressed);
+
+    free(_args);
+
+    return error;
+}
+
+
+/**
+ \brief Decompresses a block whose offset in the generated file is known and writes it right away
+ @param _args Arguments of the function
+ @returns Error status
+*/
+static _modules_error process_shafa_decomp_at (void * _args) {
+
+    return write_decompressed_shafa(_args, _SUCCESS, process_shafa_decomp(_args));
+}
+
+
+/**
+\brief Decodes the symbols of a Shannon-Fano bitstream which start in a range of bits
+ @param code Bitstream
+ @param position Address of the bit where a symbol starts (Left where the last symbol decoded ends or at the first bit of a code which doesn't exist)
+ @param end Symbols starting at or after this bit aren't decoded
+ @param limit Bits in the bitstream (A symbol which would end after it is padding and is left out)
+ @param root Binary tree with the symbols
+ @param output Where to write the symbols
+ @param room Number of symbols which fit in output
+ @param decoded Address to load the number of symbols decoded
+ @returns Error status (_FILE_UNRECOGNIZABLE if a code doesn't exist)
+*/
+static _modules_error decode_range (const uint8_t * code, unsigned long long * position, unsigned long long end, unsigned long long limit, BTree root, uint8_t * output, unsigned long room, unsigned long * decoded)
+{
+    unsigned long long bit = *position;
+    unsigned long n = 0;
+    BTree node;
+
+    while (n < room && bit < end) {
+
+        node = root;
+        do {
+            if (bit == limit) {
+                *position = limit;
+                *decoded = n;
+                return _SUCCESS;
+            }
+
+            node = (code[bit >> 3] & (128 >> (bit & 7))) ? node->right : node->left;
+            ++bit;
+
+            if (!node) {
+                *decoded = n;
+                return _FILE_UNRECOGNIZABLE;
+            }
+        } while (node->left || node->right);
+
+        output[n++] = node->symbol;
+        *position = bit;
+    }
+
+    *decoded = n;
+    return _SUCCESS;
+}
+
+/*
+ Big block whose bitstream is split in chunks decoded by different workers
+*/
+typedef struct SplitBlock SplitBlock;
+
+/*
+ Chunk of a split block: its symbols are decoded as if one started at its first bit
+*/
+typedef struct {
+    SplitBlock * block;
+    unsigned index;
+    unsigned long long start, end;  // Bits where its symbols start
+    unsigned long long stop;        // Bit where its last symbol ends
+    unsigned long long invalid;     // Bit after the last code which didn't exist (0 if none)
+    unsigned long first_symbol;     // Where its symbols go in the block (Only if it starts at a restart point)
+    uint8_t * symbols;
+    unsigned long num_symbols;
+    unsigned long long boundaries[SYNC_WINDOW]; // Where its first symbols start
+    unsigned num_boundaries;
+} Chunk;
+
+struct SplitBlock {
+    ArgumentsSHAFA * args;
+    BTree decoder;
+    uint8_t * decoded;          // Every symbol of the block
+    unsigned long num_decoded;  // Symbols stitched so far
+    unsigned long long position; // Bit where the next of them starts
+    bool restarts;              // Chunks start at restart points: their symbols are decoded straight into the block (Nothing to stitch)
+    unsigned num_chunks;
+    Chunk chunks[];
+};
+
+/**
+\brief Number of chunks a block is split in to be decoded
+ @param header Block's header in the SHAFA stream
+ @param num_blocks Number of blocks of the file
+ @returns Number of chunks (1 if it isn't split)
+*/
+static unsigned split_chunks (const BlockHeader * header, unsigned long long num_blocks)
+{
+    // Each chunk has at least a segment between restart points when there are some and 1 MiB of coded content otherwise
+    const unsigned long chunks = header->restarts ? header->num_restarts + 1 : header->size / SPLIT_MIN_SIZE;
+    const unsigned long cores = NO_MULTITHREAD ? 1 : multithread_num_cores();
+
+    // Whole blocks already keep every core busy (And are read by their own workers instead of the main thread)
+    if (num_blocks >= cores)
+        return 1;
+
+    if (header->stored || header->hole)
+        return 1;
+
+    if (chunks < 2)
+        return 1;
+
+    return chunks < cores ? chunks : cores;
+}
+
+/**
+\brief Decodes a chunk of a split block from its first bit (A code which doesn't exist only means that no symbol really started there)
+ @param _chunk Chunk
+ @returns Error status
+*/
+static _modules_error decode_chunk (void * _chunk)
+{
+    Chunk * chunk = (Chunk *) _chunk;
+    SplitBlock * block = chunk->block;
+    const unsigned long long limit = block->args->shafa_size * 8ULL;
+    const unsigned long block_symbols = *block->args->rle_sizes;
+    unsigned long long position = chunk->start, start;
+    unsigned long capacity, decoded, room;
+    uint8_t * symbols;
+    _modules_error error;
+    double span = TRACE_BEGIN();
+
+    // The chunk's symbols are known to start at its first bit and to end where the next chunk's start
+    if (block->restarts) {
+        error = decode_range(block->args->shafa_code, &position, chunk->end, limit, block->decoder, block->decoded + chunk->first_symbol, chunk->num_symbols, &decoded);
+
+        if (!error && (decoded != chunk->num_symbols || (chunk->index != block->num_chunks - 1 && position != chunk->end)))
+            error = _FILE_UNRECOGNIZABLE;
+
+        TRACE_END("decode chunk", span);
+        return error;
+    }
+
+    // Room for as many symbols as its share of the bits would have (Grows if they're more)
+    capacity = (unsigned long) ((chunk->end - chunk->start) * block_symbols / limit) + SYNC_WINDOW;
+    if (capacity > block_symbols)
+        capacity = block_symbols;
+
+    chunk->symbols = bufpool_alloc(capacity);
+    if (!chunk->symbols)
+        return _LACK_OF_MEMORY;
+
+    while (position < chunk->end && chunk->num_symbols < block_symbols) {
+
+        if (chunk->num_symbols == capacity) {
+            capacity = capacity + capacity / 2 < block_symbols ? capacity + capacity / 2 : block_symbols;
+            symbols = bufpool_realloc(chunk->symbols, capacity);
+            if (!symbols)
+                return _LACK_OF_MEMORY;
+            chunk->symbols = symbols;
+        }
+
+        // The first symbols are decoded one at a time to keep where they start
+        start = position;
+        room = chunk->num_boundaries < SYNC_WINDOW ? 1 : capacity - chunk->num_symbols;
+
+        error = decode_range(block->args->shafa_code, &position, chunk->end, limit, block->decoder, chunk->symbols + chunk->num_symbols, room, &decoded);
+
+        if (room == 1 && decoded)
+            chunk->boundaries[chunk->num_boundaries++] = start;
+
+        chunk->num_symbols += decoded;
+
+        if (error)
+            chunk->invalid = ++position;
+    }
+
+    chunk->stop = position;
+    TRACE_END("decode chunk", span);
+
+    return _SUCCESS;
+}
+
+/**
+\brief Appends a chunk's symbols to the ones already stitched: the block is decoded from where the previous chunk ended until it meets a symbol of this one
+        (Every symbol after that one is right) or, if it never does, through the whole chunk
+ @param chunk Chunk
+ @returns Error status
+*/
+static _modules_error stitch_chunk (Chunk * chunk)
+{
+    SplitBlock * block = chunk->block;
+    const unsigned long long limit = block->args->shafa_size * 8ULL;
+    const unsigned long block_symbols = *block->args->rle_sizes;
+    unsigned long decoded, copied;
+    unsigned i = 0;
+    _modules_error error;
+
+    if (block->restarts) {
+        block->num_decoded += chunk->num_symbols;
+        return _SUCCESS;
+    }
+
+    for (;;) {
+        // Symbols after the block's end are its padding
+        if (block->num_decoded == block_symbols || block->position >= chunk->end)
+            return _SUCCESS;
+
+        while (i < chunk->num_boundaries && chunk->boundaries[i] < block->position)
+            ++i;
+
+        if (i == chunk->num_boundaries) {
+            error = decode_range(block->args->shafa_code, &block->position, chunk->end, limit, block->decoder, block->decoded + block->num_decoded, block_symbols - block->num_decoded, &decoded);
+            block->num_decoded += decoded;
+            return error;
+        }
+
+        if (chunk->boundaries[i] == block->position)
+            break;
+
+        if ((error = decode_range(block->args->shafa_code, &block->position, chunk->end, limit, block->decoder, block->decoded + block->num_decoded, 1, &decoded)))
+            return error;
+        block->num_decoded += decoded;
+
+        // The bitstream ended in the middle of a symbol
+        if (!decoded)
+            return _SUCCESS;
+    }
+
+    // A code which doesn't exist after the symbol where they met
+    if (chunk->invalid > block->position)
+        return _FILE_UNRECOGNIZABLE;
+
+    copied = chunk->num_symbols - i;
+    if (copied > block_symbols - block->num_decoded)
+        copied = block_symbols - block->num_decoded;
+
+    memcpy(block->decoded + block->num_decoded, chunk->symbols + i, copied);
+    block->num_decoded += copied;
+    block->position = chunk->stop;
+
+    return _SUCCESS;
+}
+
+/**
+\brief Stitches a chunk in order and, after the last one, finishes its block (RLE's decompression) and writes it
+ @param _chunk Chunk
+ @param prev_error Previous thread error status
+ @param error Process error status
+ @returns Error status
+*/
+static _modules_error write_chunk (void * _chunk, _modules_error prev_error, _modules_error error)
+{
+    Chunk * chunk = (Chunk *) _chunk;
+    SplitBlock * block = chunk->block;
+    ArgumentsSHAFA * args_shafa = block->args;
+    ArgumentsRLE args_rle;
+
+    if (!error && !prev_error)
+        error = stitch_chunk(chunk);
+
+    bufpool_free(chunk->symbols);
+
+    if (chunk->index != block->num_chunks - 1)
+        return error;
+
+    if (!error && !prev_error && block->num_decoded != *args_shafa->rle_sizes)
+        error = _FILE_UNRECOGNIZABLE;
+
+    bufpool_free(args_shafa->shafa_code);
+    free_tree(block->decoder);
+
+    if (!error && !prev_error && args_shafa->rle_decompression) {
+        args_rle = (ArgumentsRLE) {
+            .buffer = block->decoded,
+            .rle_block_size = *args_shafa->rle_sizes,
+            .original_size = args_shafa->original_size,
+            .bwt_index = args_shafa->bwt_index,
+            .rle_v2 = args_shafa->rle_v2,
+            .final_sizes = args_shafa->final_sizes
+        };
+
+        error = rle_block_decompressor(&args_rle);
+        args_shafa->rle_decompressed = args_rle.sequence;
+    }
+    else if (args_shafa->rle_decompression)
+        bufpool_free(block->decoded);
+    else {
+        args_shafa->shafa_decompressed = block->decoded;
+        if (args_shafa->final_sizes)
+            *args_shafa->final_sizes = *args_shafa->rle_sizes;
+    }
+
+    if (!error && !prev_error && args_shafa->entropy) {
+        if (args_shafa->rle_decompression)
+            *args_shafa->entropy = stats_block_entropy(args_shafa->rle_decompressed, *args_shafa->final_sizes);
+        else
+            *args_shafa->entropy = stats_block_entropy(args_shafa->shafa_decompressed, *args_shafa->rle_sizes);
+    }
+
+    free(block);
+
+    return write_decompressed_shafa(args_shafa, prev_error, error);
+}
+
+/**
+\brief Checks a block's restart points: one every interval symbols (After the first one) and each starting after the previous one inside the block
+ @param header Block's header in the SHAFA stream
+ @param num_symbols Block's number of symbols
+ @returns Error status
+*/
+static _modules_error check_restarts (const BlockHeader * header, unsigned long num_symbols)
+{
+    if (header->num_restarts != (num_symbols ? (num_symbols - 1) / header->restart_interval : 0))
+        return _FILE_UNRECOGNIZABLE;
+
+    for (unsigned long i = 0; i < header->num_restarts; ++i)
+        if (header->restarts[i] >= header->size * 8ULL || (i && header->restarts[i] <= header->restarts[i - 1]))
+            return _FILE_UNRECOGNIZABLE;
+
+    return _SUCCESS;
+}
+
+/**
+\brief Decodes a big block with several workers: its bitstream is split in chunks which are decoded at once.
+        With restart points each chunk starts at one of them and its symbols are decoded straight into the block. Otherwise each one is decoded
+        as if a symbol started at its first bit and they're stitched in order (Prefix codes synchronize within a few symbols so almost every symbol
+        speculatively decoded is kept)
+ @param args Arguments of the block with its content loaded (Freed even if it fails)
+ @param num_chunks Number of chunks
+ @param header Block's header in the SHAFA stream
+ @returns Error status
+*/
+static _modules_error decompress_split (ArgumentsSHAFA * args, unsigned num_chunks, const BlockHeader * header)
+{
+    const unsigned long long limit = args->shafa_size * 8ULL;
+    const unsigned long num_segments = header->num_restarts + 1;
+    unsigned long long segment, next_segment;
+    _modules_error error, wait_error;
+    SplitBlock * block;
+    unsigned idx;
+
+    block = malloc(sizeof(SplitBlock) + num_chunks * sizeof(Chunk));
+    if (!block) {
+        bufpool_free(args->cod_code);
+        bufpool_free(args->shafa_code);
+        free(args);
+        return _LACK_OF_MEMORY;
+    }
+
+    *block = (SplitBlock) {.args = args, .restarts = header->restarts != NULL, .num_chunks = num_chunks};
+
+    error = create_tree(args->cod_code, &block->decoder);
+    bufpool_free(args->cod_code);
+    if (!error && block->restarts)
+        error = check_restarts(header, *args->rle_sizes);
+    if (!error) {
+        block->decoded = bufpool_alloc(*args->rle_sizes);
+        if (!block->decoded)
+            error = _LACK_OF_MEMORY;
+    }
+
+    if (error) {
+        free_tree(block->decoder);
+        bufpool_free(args->shafa_code);
+        free(args);
+        free(block);
+        return error;
+    }
+
+    for (idx = 0; idx < num_chunks; ++idx) {
+        block->chunks[idx] = (Chunk) {
+            .block = block,
+            .index = idx,
+            .start = limit * idx / num_chunks,
+            .end = limit * (idx + 1) / num_chunks
+        };
+
+        // Each chunk takes as many segments as the others
+        if (block->restarts) {
+            segment = (unsigned long long) num_segments * idx / num_chunks;
+            next_segment = (unsigned long long) num_segments * (idx + 1) / num_chunks;
+
+            block->chunks[idx].start = segment ? header->restarts[segment - 1] : 0;
+            block->chunks[idx].end = next_segment < num_segments ? header->restarts[next_segment - 1] : limit;
+            block->chunks[idx].first_symbol = segment * header->restart_interval;
+            block->chunks[idx].num_symbols = (next_segment < num_segments ? next_segment * header->restart_interval : *args->rle_sizes) - block->chunks[idx].first_symbol;
+        }
+    }
+
+    for (idx = 0; idx < num_chunks; ++idx)
+        if ((error = multithread_create(decode_chunk, write_chunk, &block->chunks[idx])))
+            break;
+
+    // The chunks which weren't created still have to be written (after every other) so the last one frees the block
+    if (error) {
+        wait_error = multithread_wait();
+        for ( ; idx < num_chunks; ++idx)
+            write_chunk(&block->chunks[idx], wait_error ? wait_error : error, error);
+    }
+
+    return error;
+}
+
+
+/**
+\brief Decompresses every block of a SHAFA stream with the codes of a COD stream (both already positioned at their headers) and reports it
+ @param f_shafa SHAFA stream
+ @param f_cod COD stream
+ @param f_wrt Stream where to write the decompressed content
+ @param rle_decompression Decompresses every block compressed with RLE's algorithm too
+ @param path_wrt Path of the generated file (Only for the summary)
+ @param block_offsets Offset of each block's header in the SHAFA stream (NULL to read them one after the other)
+ @param num_offsets Number of offsets (Every count of blocks must be the same)
+ @returns Error status
+*/
+static _modules_error shafa_decompress_streams (FILE * const f_shafa, FILE * const f_cod, FILE * const f_wrt, const bool rle_decompression, const char * const path_wrt, const unsigned long long * const block_offsets, const unsigned long long num_offsets)
+{
+    _modules_error error = _SUCCESS, wait_error;
+    uint8_t * shafa_code;
+    char * cod_code;
+    char mode;
+    float total_time;
+    unsigned long long length;
+    unsigned long *sizes, *sf_sizes, *final_sizes;
+    unsigned long sf_bsize, new_size;
+    double * entropies = NULL, span;
+    long shafa_offset = 0;
+    long long offset = FIRST_OFFSET; // Blocks are written at their offset (Preallocated) while their decompressed sizes are known
+    bool copy_later, load_later, block_rle;
+    unsigned num_chunks;
+    BlockHeader header = {0}, cod_header;
+    FileHeader file_header;
+    ArgumentsSHAFA * args;
+
+    sizes = sf_sizes = final_sizes = NULL;
+
+    // Reading header of shafa file
+    if (fscanf(f_shafa, "@%llu", &length) == 1) {
+
+        // Reading header of cod file
+        if (!(error = read_file_header(f_cod, &file_header))) {
+
+            mode = file_header.mode;
+
+            // Checking the mode of the file (And that the files, and the table of offsets, have the same blocks)
+            if (file_header.num_blocks == length && (!block_offsets || num_offsets == length)
+                && ((mode == 'N' && !rle_decompression) || (mode == 'R') || (mode == 'A'))) {   
+
+                // Allocates memory to an array with the purpose of saving the size of each SHAF block
+                sf_sizes = malloc(sizeof(unsigned long) * length);
+                if (sf_sizes) {
+
+                    // Allocates memory to an array with the purpose of saving the sizes of each RLE/ORIGINAL block
+                    sizes = malloc(sizeof(unsigned long) * length);
+                    if (sizes) {
+
+                        if (rle_decompression) {
+                            final_sizes = malloc(sizeof(unsigned long) * length);
+                            if (!final_sizes)
+                                error = _LACK_OF_MEMORY;
+                        }  
+
+                        // Entropy of each block is only needed for the JSON statistics
+                        if (!error && STATS == STATS_JSON) {
+                            entropies = malloc(sizeof(double) * length);
+                            if (!entropies)
+                                error = _LACK_OF_MEMORY;
+                        }
+
+                        for (unsigned long long thread_idx = 0; thread_idx < length && !error; ++thread_idx) {
+
+                            span = TRACE_BEGIN();
+
+                            // Restart points of the previous block were only needed to split it
+                            free(header.restarts);
+                            header.restarts = NULL;
+
+                            // Goes straight to the block's header when its offset is known
+                            if (block_offsets && fseek(f_shafa, block_offsets[thread_idx], SEEK_SET))
+                                error = _FILE_STREAM_FAILED;
+
+                            // Reads the size of the shafa blockss
+                            if (!error && !(error = read_block_header(f_shafa, &header))) {
+
+                                sf_bsize = header.size;
+                                sf_sizes[thread_idx] = sf_bsize;
+
+                                // Every block of mode 'R' was compressed with RLE but only the tagged ones of mode 'A'
+                                block_rle = rle_decompression && (mode == 'R' || header.rle);
+
+                                // Stored blocks which won't be changed are copied by the kernel when it's their turn to be written (Statistics need their content)
+#ifdef COPY_FILE_RANGE
+                                copy_later = header.stored && !block_rle && !entropies;
+#else
+                                copy_later = false;
+#endif
+
+                                // Big blocks (or the ones with restart points) are decoded by several workers (Each one a chunk of the block, only with Shannon-Fano)
+                                num_chunks = file_header.ans || file_header.order1 ? 1 : split_chunks(&header, length);
+
+                                // Every other block is read by the worker which decompresses it so the main thread only reads headers
+#ifdef POSITIONAL_IO
+                                load_later = !copy_later && !header.hole && num_chunks == 1;
+#else
+                                load_later = false;
+#endif
+
+                                // Allocates memory to a buffer in which will be loaded one block of shafa code                                                         
+                                shafa_code = copy_later || load_later || header.hole ? NULL : bufpool_alloc(sf_bsize); 
+                                if (shafa_code || copy_later || load_later || header.hole) {
+
+                                    if (copy_later || load_later) {
+                                        shafa_offset = ftell(f_shafa);
+                                        if (shafa_offset < 0 || (!block_offsets && fseek(f_shafa, sf_bsize, SEEK_CUR)))
+                                            error = _FILE_STREAM_FAILED;
+                                    }
+
+                                    // Reads a block of shafa code
+                                    if (copy_later || load_later || header.hole ? !error : fread(shafa_code, sizeof(uint8_t), sf_bsize, f_shafa) == sf_bsize) { 
+
+                                        // Reads the size of the decompressed shafa code and saves it
+                                        if (!(error = read_block_header(f_cod, &cod_header))) {
+
+                                            // Holes are only in the original file (Its RLE version doesn't have them)
+                                            sizes[thread_idx] = header.hole && (mode == 'N' || rle_decompression) ? header.original_size : cod_header.size;
+
+                                            // Files written before RLE blocks recorded their original size are written in order from the first one of those
+                                            if (offset >= 0 && block_rle && !header.original_size) {
+                                                if (fseek(f_wrt, offset, SEEK_SET)) {
+                                                    error = _FILE_STREAM_FAILED;
+                                                    bufpool_free(shafa_code);
+                                                    break;
+                                                }
+                                                offset = -1;
+                                            }
+
+                                            // Allocates memory for a block of COD code (Blocks with the codes of each context are allocated while they're read)
+                                            cod_code = file_header.order1 ? NULL : bufpool_alloc(33152); //sum 1 to 256 (worst case shannon fano) + 255 semicolons + 1 byte NULL
+                                            if (cod_code || file_header.order1) {
+
+                                                // Loads the block of COD code
+                                                if (file_header.order1 ? !read_block_content(f_cod, &cod_code) : fscanf(f_cod,"%33151[^@]", cod_code) == 1) {
+
+                                                    TRACE_END("read block", span);
+
+                                                    // Allocates memory for the arguments
+                                                    args = malloc(sizeof(ArgumentsSHAFA)); 
+                                                    if (!args) {
+                                                        error = _LACK_OF_MEMORY;
+                                                        bufpool_free(cod_code);
+                                                        bufpool_free(shafa_code);
+                                                        break;
+                                                    }
+                                                        
+                                                    // Arguments for the SHAFA multithread
+                                                    *args = (ArgumentsSHAFA) {
+                                                        .f_wrt = f_wrt,
+                                                        .f_shafa = f_shafa,
+                                                        .shafa_offset = shafa_offset,
+                                                        .shafa_size = sf_bsize,
+                                                        .load = load_later,
+                                                        .offset = offset,
+                                                        .stored = header.stored,
+                                                        .hole = header.hole,
+                                                        .shafa_code = shafa_code,
+                                                        .rle_decompression = block_rle,
+                                                        .ans = file_header.ans,
+                                                        .order1 = file_header.order1,
+                                                        .rle_sizes = &sizes[thread_idx],
+                                                        .final_sizes = final_sizes ? &final_sizes[thread_idx] : NULL,
+                                                        .original_size = header.original_size,
+                                                        .bwt_index = header.bwt_index,
+                                                        .rle_v2 = file_header.rle_v2,
+                                                        .entropy = entropies ? &entropies[thread_idx] : NULL,
+                                                        .cod_code = cod_code
+                                                    };
+                                                    if (offset >= 0) {
+                                                        new_size = block_rle ? header.original_size : sizes[thread_idx];
+                                                        if (!header.hole)
+                                                            preallocate(f_wrt, offset, new_size);
+                                                        offset += new_size;
+                                                    }
+
+                                                    if (num_chunks > 1)
+                                                        error = decompress_split(args, num_chunks, &header);
+                                                    else if (args->offset >= 0)
+                                                        error = multithread_create(process_shafa_decomp_at, NULL, args);
+                                                    else
+                                                        error = multithread_create(process_shafa_decomp, write_decompressed_shafa, args); 
+                                                        
+                                                    if (error) {
+                                                        // A split block is already freed
+                                                        if (num_chunks == 1) {
+                                                            bufpool_free(cod_code);
+                                                            bufpool_free(shafa_code);
+                                                            free(args);
                                                         }
-                                                        else 
-                                                            error = _FILE_STREAM_FAILED;
-                                                 
+                                                        break;
                                                     }
-                                                    else 
-                                                        error = _LACK_OF_MEMORY;                                                      
                                                 }
                                                 else 
                                                     error = _FILE_STREAM_FAILED;
-
-                                                } 
-                                                multithread_wait();
-
+                                                        
+                                            }
+                                            else 
+                                                error = _LACK_OF_MEMORY;
                                         }
-                                        else 
-                                            error = _LACK_OF_MEMORY;
+                                               
                                     }
                                     else 
-                                        error = _LACK_OF_MEMORY;                               
-
+                                        error = _FILE_STREAM_FAILED;
+                             
                                 }
                                 else 
-                                    error = _FILE_UNRECOGNIZABLE;                           
+                                    error = _LACK_OF_MEMORY;                                                      
                             }
-                            else 
-                                error = _FILE_STREAM_FAILED;
+
+                        } 
+                        wait_error = multithread_wait();
+                        if (!error)
+                            error = wait_error;
+
+                        free(header.restarts);
+                    }
+                    else 
+                        error = _LACK_OF_MEMORY;
+                }
+                else 
+                    error = _LACK_OF_MEMORY;                               
+
+            }
+            else 
+                error = _FILE_UNRECOGNIZABLE;                           
+        }
+    }
+    else 
+        error = _FILE_STREAM_FAILED;
+
+    if (!error) {
+        total_time = clock_main_thread(STOP_CLOCK);                                
+
+        if (STATS == STATS_JSON)
+            error = stats_add_stage("d", rle_decompression ? "Shannon-Fano & RLE decompression" : "Shannon-Fano decompression", length, sf_sizes, rle_decompression ? final_sizes : sizes, entropies, path_wrt);
+        else if (STATS != STATS_NONE) {
+            multithread_lock();
+            print_summary(total_time, sf_sizes, rle_decompression ? final_sizes : sizes, length, (char *) path_wrt, rle_decompression ? _SHAFA_RLE : _SHAFA); 
+            multithread_unlock();
+        }
+    }
+
+    if (final_sizes)
+        free(final_sizes);
+    free(entropies);
+                                      
+    if (sizes) 
+        free(sizes);
+    if (sf_sizes) 
+        free(sf_sizes);
+    
+    return error;
+}
+
+
+/**
+\brief Loads the table of blocks' offsets at the end of a SHAFA file and leaves the stream at the file's header
+ @param f_shafa SHAFA stream
+ @param block_offsets Where to save the allocated offsets (NULL if the file was written before the table existed)
+ @param num_blocks Where to save the number of offsets (The file's blocks)
+ @returns Error status
+*/
+static _modules_error load_block_table (FILE * const f_shafa, unsigned long long ** const block_offsets, unsigned long long * const num_blocks)
+{
+    _modules_error error;
+    long first_block;
+
+    *block_offsets = NULL;
+
+    if (fscanf(f_shafa, "@%llu", num_blocks) != 1 || (first_block = ftell(f_shafa)) < 0)
+        return _FILE_STREAM_FAILED;
+
+    error = read_block_table(f_shafa, *num_blocks, block_offsets);
+
+    // The first block is right after the file's header
+    if (*block_offsets && (*block_offsets)[0] != (unsigned long long) first_block) {
+        free(*block_offsets);
+        *block_offsets = NULL;
+    }
+
+    if (!error && fseek(f_shafa, 0, SEEK_SET))
+        error = _FILE_STREAM_FAILED;
+
+    return error;
+}
+
+
+_modules_error shafa_decompress (char ** const path, bool rle_decompression) 
+{
+    _modules_error error;
+    FILE *f_shafa, *f_cod, *f_wrt;
+    char *path_cod, *path_wrt, *path_shafa, *path_tmp;
+    unsigned long long * block_offsets, num_blocks;
+
+    path_shafa = *path;
+    error = _SUCCESS;
+    clock_main_thread(START_CLOCK);
+
+    // Opening the shafa file
+    f_shafa = fopen(path_shafa, "rb");
+    if (f_shafa) {
+
+        // Creates path to the .cod file
+        path_tmp = rm_ext(path_shafa);
+        if (path_tmp) { // free this somehow
+
+            if (rle_decompression) {
+                path_wrt = rm_ext(path_tmp);
+                if (!path_wrt) 
+                    error = _LACK_OF_MEMORY;
+            }
+            else 
+                path_wrt = path_tmp;
+
+            f_wrt = fopen(path_wrt, "wb");
+            if (f_wrt) {
+                
+                path_cod = add_ext(path_tmp, CODES_EXT);
+                if (path_cod) {
+
+                    f_cod = fopen(path_cod, "rb");
+                    if (f_cod) {
+
+                        if (!(error = load_block_table(f_shafa, &block_offsets, &num_blocks))) {
+                            error = shafa_decompress_streams(f_shafa, f_cod, f_wrt, rle_decompression, path_wrt, block_offsets, num_blocks);
+                            free(block_offsets);
                         }
-                        else 
-                            error = _FILE_STREAM_FAILED;
 
                         fclose(f_cod);
                         
@@ -810,25 +2225,29 @@ _modules_error shafa_decompress (char ** const path, bool rle_decompression)
         error = _FILE_INACCESSIBLE;
 
     if (!error) {
-        total_time = clock_main_thread(STOP_CLOCK);                                
         *path = path_wrt;
         free(path_shafa);
+    }
+    
+    return error;
+}
 
-        if (rle_decompression) {
 
-            print_summary(total_time, sf_sizes, final_sizes, length, path_wrt, _SHAFA_RLE); 
-            free(final_sizes);
+_modules_error shafa_decompress_member (FILE * const f_shafa, FILE * const f_cod, const bool rle_decompression, const char * const path_wrt, const unsigned long long * const block_offsets, const unsigned long long num_blocks)
+{
+    _modules_error error;
+    FILE * f_wrt;
+
+    clock_main_thread(START_CLOCK);
+
+    f_wrt = fopen(path_wrt, "wb");
+    if (!f_wrt)
+        return _FILE_INACCESSIBLE;
+
+    error = shafa_decompress_streams(f_shafa, f_cod, f_wrt, rle_decompression, path_wrt, block_offsets, num_blocks);
+
+    if (fclose(f_wrt) && !error)
+        error = _FILE_STREAM_FAILED;
 
-        }// If RLE decompression didn't occur
-        else {
-            print_summary(total_time, sf_sizes, sizes, length, path_wrt, _SHAFA);                                               
-        }
-    }
-                                      
-    if (sizes) 
-        free(sizes);
-    if (sf_sizes) 
-        free(sf_sizes);
-    
     return error;
 }
@@ -1,6 +1,7 @@
 #ifndef MODULE_D_H
 #define MODULE_D_H
 
+#include <stdio.h>
 #include <stdbool.h>
 
 #include "utils/errors.h"
@@ -14,6 +15,19 @@
 _modules_error shafa_decompress(char ** path, bool decompress_rle);
 
 
+/**
+\brief Decompresses a file which was compressed with Shannon Fano's algorithm but is stored inside other files (e.g. an archive's member)
+ @param f_shafa Stream positioned at the SHAFA content's header
+ @param f_cod Stream positioned at the COD content's header
+ @param decompress_rle Decompresses file with RLE's algorithm too
+ @param path_wrt Path of the file to be generated
+ @param block_offsets Offset of each block's header in the SHAFA stream (NULL to read them one after the other)
+ @param num_blocks Number of offsets (_FILE_UNRECOGNIZABLE if the streams have a different number of blocks)
+ @returns Error status
+*/
+_modules_error shafa_decompress_member(FILE * f_shafa, FILE * f_cod, bool decompress_rle, const char * path_wrt, const unsigned long long * block_offsets, unsigned long long num_blocks);
+
+
 /**
 \brief Decompresses file which was compressed with RLE's algorithm and saves it to disk.
  @param path Pointer to the RLE->Original file's path
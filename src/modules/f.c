@@ -7,6 +7,7 @@
  **************************************************/
 
 #include <time.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,53 +15,59 @@
 #include <stdbool.h>
 
 
+#include "f.h"
+#include "utils/bwt.h"
 #include "utils/file.h"
+#include "utils/perf.h"
+#include "utils/stats.h"
+#include "utils/trace.h"
 #include "utils/errors.h"
+#include "utils/header.h"
+#include "utils/blockio.h"
+#include "utils/bufpool.h"
 #include "utils/extensions.h"
+#include "utils/multithread.h"
 
-/**
-\brief Compresses a block
- @param buffer Array loaded with the original file content
- @param block Array where to load the compressed content
- @param block_size Size of the current block
- @param size_f Size of the original file
- @returns Size of the compressed block
-*/
-static unsigned long block_compression(const uint8_t buffer[], uint8_t block[], const unsigned long block_size, unsigned long size_f)
+#define SAMPLES 4                   // Evenly spread samples read by auto_block_size
+#define SAMPLE_SIZE (16 * _1KiB)
+#define BLOCKS_PER_CORE 4           // Blocks each core should get from auto_block_size (Same as multithread's backpressure)
+#define CODES_OVERHEAD 100          // Compressed block / codes' size targeted by auto_block_size
+#define BLOCK_ALIGNMENT (4 * _1KiB)
+
+unsigned long block_compression(const uint8_t buffer[], uint8_t block[], const unsigned long block_size, unsigned long size_f)
 {
     //Looping variables(i,j)
-    unsigned long i, j, size_block_rle;
+    unsigned long i, j, size_block_rle, n_reps;
     //Cycle that goes through the block of symbols of the file
     for(i = 0, size_block_rle=0; i < block_size && i < size_f; i = j) {
-        //Number of repetitions of a symbol
-        int n_reps = 0;
-        //Counts the number of repetitions of a symbol
-        for(j = i; buffer[i] == buffer[j] && n_reps <255 && j<block_size; ++j, ++n_reps);
-        //If a symbol repits itself 4 times or more or if the symbol is NULL
-        if(n_reps >= 4 || !buffer[i])
+        //Counts the number of repetitions of a symbol (No limit since it's written as a varint)
+        for(j = i; j<block_size && buffer[i] == buffer[j]; ++j);
+        n_reps = j - i;
+        //If a symbol repeats itself 4 times or more or if NULL repeats itself at least twice
+        if(n_reps >= 4 || (n_reps >= 2 && !buffer[i]))
+        {
+            block[size_block_rle++] = 0;
+            //Little-endian groups of 7 bits, the high bit tells if there's another one
+            for( ; n_reps >= 128; n_reps >>= 7) block[size_block_rle++] = (n_reps & 127) | 128;
+            block[size_block_rle++] = n_reps;
+            block[size_block_rle++] = buffer[i];
+        }
+        //An isolated NULL only needs its escape and a 0 repetitions' varint
+        else if(!buffer[i])
         {
-            block[size_block_rle] = 0;
-            block[size_block_rle+1] = buffer[i];
-            block[size_block_rle+2] = n_reps;
-            size_block_rle +=3;
+            block[size_block_rle++] = 0;
+            block[size_block_rle++] = 0;
         }
         else
         {
-            block[size_block_rle] = buffer[i];
-            size_block_rle++;
-            j = ++i; 
+            //Up to 3 repetitions are cheaper as they are
+            for( ; n_reps; --n_reps) block[size_block_rle++] = buffer[i];
         } 
     }
     return size_block_rle;
 }
 
-/**
-\brief Turns block of content in an array of frequencies (each index matches a symbol from 0 to 255)
- @param block Array with the symbols (current block)
- @param freq Array to put the frequencies
- @param size_block Block size
-*/
-static void make_freq(const unsigned char* block, unsigned long* freq, unsigned long size_block)
+void make_freq(const unsigned char* block, unsigned long* freq, unsigned long size_block)
 {
     int i;
     unsigned long j;
@@ -78,17 +85,48 @@ static void make_freq(const unsigned char* block, unsigned long* freq, unsigned
     }
 }
 
+double estimated_size(const unsigned long* freq, unsigned long size_block)
+{
+    double bits = 0, codes = 255, length, coded;
+
+    for(int i = 0; i < 256; i++) {
+        if(freq[i]) {
+            //Each symbol costs about its information but no code is shorter than 1 bit
+            length = -log2((double)freq[i] / size_block);
+            if(length < 1) length = 1;
+            bits += freq[i] * length;
+            //Codes are written as '0'/'1' characters plus 255 separators
+            codes += length;
+        }
+    }
+
+    coded = bits / 8 + codes;
+    //Same rule as module C's stored blocks
+    return coded < size_block - (size_block >> 5) ? coded : size_block;
+}
+
+void make_context_freq(const unsigned char* block, unsigned long (*freq)[256], unsigned long size_block)
+{
+    unsigned char prev = 0;
+    //Puts all the elements of freq as 0
+    memset(freq, 0, sizeof(unsigned long[256][256]));
+    //Each symbol is counted in the row of the one before it (The first symbol of the block comes after a NULL)
+    for(unsigned long j = 0; j < size_block; j++)
+    {
+        ++freq[prev][block[j]];
+        prev = block[j];
+    }
+}
+
 /**
-\brief Writes the frequencies in the freq file
+\brief Writes a row of frequencies (Consecutive equal frequencies are written once followed by a ';' each)
  @param freq Array with the frequencies
  @param f_freq Freq file where we load the content
- @param block_num Current block
- @param n_blocks Number of blocks
  @returns Error status
 */
-static _modules_error write_freq(const unsigned long *freq, FILE* f_freq, const unsigned long long block_num, const unsigned long long n_blocks) 
+static _modules_error write_freq_row(const unsigned long *freq, FILE* f_freq)
 {
-    int i, j, print = 0, print2 = 0, print3 = 0;
+    int i, j, print = 0, print2 = 0;
     _modules_error error = _SUCCESS;
     //Goes through the block of frequencies
     for(i = 0; i < 256;)
@@ -97,7 +135,7 @@ static _modules_error write_freq(const unsigned long *freq, FILE* f_freq, const
         //Verifys if the fprintf went well
         if(print >= 1) {
             //If the frequencies of consecutive values are the same writes ';' after the fisrt value
-            for(j = i; freq[i] == freq[j] && j<256 ; j++)
+            for(j = i; j<256 && freq[i] == freq[j]; j++)
             {
                 if(j!=255) {
                     print2 = fprintf(f_freq, ";");
@@ -108,7 +146,16 @@ static _modules_error write_freq(const unsigned long *freq, FILE* f_freq, const
             i = j;
         }
         else error = _FILE_STREAM_FAILED; 
-    }//If it's the last block
+    }
+
+    return error;
+}
+
+_modules_error write_freq(const unsigned long *freq, FILE* f_freq, const unsigned long long block_num, const unsigned long long n_blocks)
+{
+    int print3 = 0;
+    _modules_error error = write_freq_row(freq, f_freq);
+    //If it's the last block
     if(block_num == n_blocks -1) {
         print3 = fprintf(f_freq, "@0");
         //If the fprintf went wrong
@@ -118,6 +165,80 @@ static _modules_error write_freq(const unsigned long *freq, FILE* f_freq, const
     return error;
 }
 
+_modules_error write_context_freq(const unsigned long (*freq)[256], FILE* f_freq)
+{
+    _modules_error error = _SUCCESS;
+    //Only the contexts found in the block are written: <context>:<frequencies>|
+    for(int ctx = 0; ctx < 256 && !error; ctx++)
+    {
+        int used = 0;
+        for(int i = 0; i < 256 && !used; i++) used = freq[ctx][i] != 0;
+
+        if(used) {
+            if(fprintf(f_freq, "%d:", ctx) < 2) error = _FILE_STREAM_FAILED;
+            if(!error) error = write_freq_row(freq[ctx], f_freq);
+            if(!error && fputc('|', f_freq) == EOF) error = _FILE_STREAM_FAILED;
+        }
+    }
+
+    return error;
+}
+
+/**
+\brief Writes the headers and (null) frequencies of holes' blocks in the freq files
+ @param f_rle_freq Freq file of the rle file (NULL if it isn't being written)
+ @param f_freq Freq file of the txt file (NULL if it isn't being written)
+ @param size Size of each hole's block
+ @param first First hole's block
+ @param last Block after the last hole's block
+ @param n_blocks Number of blocks
+ @returns Error status
+*/
+static _modules_error write_holes(FILE* f_rle_freq, FILE* f_freq, const unsigned long size, const unsigned long long first, const unsigned long long last, const unsigned long long n_blocks)
+{
+    static const unsigned long freq[256] = {0};
+    const BlockHeader header = {.size = 0, .original_size = size, .hole = true};
+    _modules_error error = _SUCCESS;
+
+    for(unsigned long long block_num = first; block_num < last && !error; ++block_num) {
+        if(f_rle_freq && !(error = write_block_header(f_rle_freq, &header)))
+            error = write_freq(freq, f_rle_freq, block_num, n_blocks);
+        if(f_freq && !error && !(error = write_block_header(f_freq, &header)))
+            error = write_freq(freq, f_freq, block_num, n_blocks);
+    }
+
+    return error;
+}
+
+/**
+\brief Queues the next blocks of the txt file to be read ahead (Blocks inside holes of a sparse file are skipped)
+ @param reader Reader of the txt file
+ @param f Txt file
+ @param holes Where to mark the blocks inside holes
+ @param sparse If the txt file is sparse
+ @param next_block Next block to be queued
+ @param queued Number of blocks queued and not taken yet
+ @param n_blocks Number of blocks
+ @param block_size Size of each block (But the last)
+ @param size_f Size of the txt file
+ @returns Error status
+*/
+static _modules_error queue_blocks(BlockReader* reader, FILE* f, bool* holes, const bool sparse, unsigned long long* next_block, unsigned* queued, const unsigned long long n_blocks, const unsigned long block_size, const unsigned long size_f)
+{
+    _modules_error error = _SUCCESS;
+    unsigned long size;
+
+    for(; !error && *queued < READ_AHEAD && *next_block < n_blocks; ++*next_block) {
+        size = *next_block == n_blocks - 1 ? size_f - *next_block * block_size : block_size;
+        //The last block always is read so the file's size is kept
+        holes[*next_block] = sparse && *next_block < n_blocks - 1 && block_is_hole(f, *next_block * block_size, size);
+        error = block_reader_queue(reader, size, holes[*next_block]);
+        if(!error && !holes[*next_block]) ++*queued;
+    }
+
+    return error;
+}
+
 /**
 \brief Prints the results of the program execution
  @param n_blocks Number of blocks
@@ -138,12 +259,14 @@ static inline void print_summary(unsigned long long n_blocks, unsigned long *blo
         "Number of blocks: %lu\n" , n_blocks
     );
     
-    printf("Size of blocks analyzed in the original file: ");
-    //Cycle to print the block sizes of the txt file
-    for(unsigned long long i = 0; i < n_blocks; i++) {
-        if(i == n_blocks - 1)
-            printf("%lu\n", block_sizes[i]);
-        else printf("%lu/", block_sizes[i]);
+    //Cycle to print the block sizes of the txt file (Only when the user wants every block)
+    if(STATS == STATS_TEXT) {
+        printf("Size of blocks analyzed in the original file: ");
+        for(unsigned long long i = 0; i < n_blocks; i++) {
+            if(i == n_blocks - 1)
+                printf("%lu\n", block_sizes[i]);
+            else printf("%lu/", block_sizes[i]);
+        }
     }
     
     if(path_rle) {
@@ -156,13 +279,14 @@ static inline void print_summary(unsigned long long n_blocks, unsigned long *blo
         compression_ratio*=100.0;
         printf("RLE Compression: %s (%f%% compression)\n", path_rle, compression_ratio);
         
-        printf("Size of blocks analyzed in the RLE file: ");
-        //Cycle to print the block sizes of the rle file
-    
-        for(unsigned long long i = 0; i < n_blocks; i++) {
-            if(i == n_blocks - 1)
-                printf("%lu bytes\n", block_rle_sizes[i]);
-            else printf("%lu/", block_rle_sizes[i]);
+        //Cycle to print the block sizes of the rle file (Only when the user wants every block)
+        if(STATS == STATS_TEXT) {
+            printf("Size of blocks analyzed in the RLE file: ");
+            for(unsigned long long i = 0; i < n_blocks; i++) {
+                if(i == n_blocks - 1)
+                    printf("%lu bytes\n", block_rle_sizes[i]);
+                else printf("%lu/", block_rle_sizes[i]);
+            }
         }
     }
     printf("Module runtime (milliseconds): %f\n", total_t);
@@ -177,19 +301,21 @@ static inline void print_summary(unsigned long long n_blocks, unsigned long *blo
 }
 
 
-_modules_error freq_rle_compress(char** const path, const bool force_rle, const bool force_freq, const unsigned long block_size)
+_modules_error freq_rle_compress(char** const path, const bool force_rle, const bool force_freq, const bool adaptive, const bool order1, const bool bwt, const unsigned long block_size)
 {
     clock_t t; 
     float total_t;
-    float compression_ratio;
-    uint8_t *buffer, *block;
-    int  print_rle, print;
-    long compression;
-    unsigned long long n_blocks, block_num;
-    bool compress_rle;
+    uint8_t *buffer, *block, *transformed;
+    int  print_rle = 0, print = 0;
+    unsigned long long n_blocks, block_num, first_data, next_block;
+    unsigned queued;
+    bool compress_rle, sparse, *holes;
     long size_of_last_block;
     char *path_rle = NULL, *path_rle_freq = NULL, *path_freq = NULL; 
-    unsigned long size_f, the_block_size, size_block_rle, compresd, *block_sizes, *block_rle_sizes, s;
+    unsigned long size_f, the_block_size, size_block_rle, compresd, *block_sizes, *block_rle_sizes, s, bwt_index = 0;
+    double *entropies = NULL, span;
+    PerfSample sample;
+    BlockReader *reader = NULL;
     FILE *f, *f_rle=NULL, *f_rle_freq=NULL, *f_freq=NULL;
 
     compress_rle = true;
@@ -226,35 +352,83 @@ _modules_error freq_rle_compress(char** const path, const bool force_rle, const
                         if(block_sizes) {
                             //Allocates memory for the array that will contain the block sizes of the rle file
                             block_rle_sizes = malloc(n_blocks * sizeof(unsigned long));
+                            //Allocates memory for the entropy of each block (Only needed for the JSON statistics)
+                            if(block_rle_sizes && STATS == STATS_JSON) {
+                                entropies = malloc(n_blocks * sizeof(double));
+                                if(!entropies) {
+                                    free(block_rle_sizes);
+                                    block_rle_sizes = NULL;
+                                }
+                            }
                             if(block_rle_sizes) {
+                                //Blocks are read ahead while the previous ones are compressed and the ones inside holes of a sparse file aren't read
+                                sparse = file_is_sparse(f);
+                                holes = calloc(n_blocks, sizeof(bool));
+                                next_block = queued = 0;
+                                if(!holes) error = _LACK_OF_MEMORY;
+                                else if(!(error = block_reader_open(f, &reader)))
+                                    error = queue_blocks(reader, f, holes, sparse, &next_block, &queued, n_blocks, the_block_size, size_f);
+                                //Finds the first block with data (Holes before it are written once the files' headers are)
+                                for(first_data = 0; !error && holes[first_data]; ++first_data);
                                 //Divides the buffer into blocks
-                                for (block_num = 0, s = 0; block_num < n_blocks; ++block_num) {
+                                for (block_num = 0, s = 0; !error && block_num < n_blocks; ++block_num) {
                                     //If it's the last block
                                     if(block_num == n_blocks -1) {
                                         compresd = size_f - s;                                            
                                     }
                                     //Loads size of the current block of the txt file to the respective array
                                     block_sizes[block_num] = compresd;
-                                    //Allocates memory for the array that will contain the content of the txt file
-                                    buffer = malloc(compresd * sizeof(uint8_t));
+                                    //If the block is a hole it's skipped and only its header is written
+                                    if(holes[block_num]) {
+                                        block_rle_sizes[block_num] = 0;
+                                        if(entropies) entropies[block_num] = 0;
+                                        if(block_num > first_data)
+                                            error = write_holes(f_rle_freq, f_freq, compresd, block_num, block_num + 1, n_blocks);
+                                        s+=compresd;
+                                        if(error) break;
+                                        continue;
+                                    }
+                                    //Takes the content of the block of the txt file (Already read or being read) and queues the next one
+                                    span = TRACE_BEGIN();
+                                    error = block_reader_next(reader, &buffer);
+                                    if(!error) {
+                                        --queued;
+                                        error = queue_blocks(reader, f, holes, sparse, &next_block, &queued, n_blocks, the_block_size, size_f);
+                                    }
+                                    TRACE_END("read block", span);
                                     if(buffer) {
-                                        //Loads the content of the block of the txt file into the buffer
-                                        if(fread(buffer, sizeof(uint8_t), compresd, f) == compresd) {
+                                        if(!error) {
                                             //Allocates memory for the array that will contain the compressed content of the buffer
-                                            block = malloc(compresd * 2 + 3); // (size/2 + 1) * 3 + size/2 = 2*size + 3
+                                            block = bufpool_alloc(compresd * 2 + 3); // Worst case is a NULL between every other symbol: (size/2 + 1) * 2 + size/2 < 2*size + 3
                                             if(block) {
                                                 if(compress_rle) {
+                                                    //Transforms the block with Burrows-Wheeler and move-to-front first so RLE finds runs where the block has repeated contexts
+                                                    transformed = NULL;
+                                                    if(bwt) {
+                                                        transformed = bufpool_alloc(compresd);
+                                                        span = TRACE_BEGIN();
+                                                        PERF_BEGIN(sample);
+                                                        error = transformed ? bwt_encode(buffer, transformed, compresd, &bwt_index) : _LACK_OF_MEMORY;
+                                                        PERF_END(sample, PERF_BWT_ENCODE, compresd);
+                                                        TRACE_END("bwt encode", span);
+                                                        if(error) {
+                                                            bufpool_free(transformed);
+                                                            bufpool_free(block);
+                                                            bufpool_free(buffer);
+                                                            break;
+                                                        }
+                                                    }
                                                     //Compresses the current block and returns its size
-                                                    size_block_rle = block_compression(buffer, block, compresd, size_f);
-                                                    //If it's the first block
-                                                    if(block_num == 0) {
-                                                        //Calculates the compression rate
-                                                        compression = compresd - size_block_rle;
-                                                        compression_ratio = (float)compression/(float)compresd;
-                                                                    
-                                                                    
-                                                        //If the rate is lower than 5% and the user didn't force the rle file
-                                                        if(compression_ratio < 0.05 && !force_rle) compress_rle = false;
+                                                    span = TRACE_BEGIN();
+                                                    PERF_BEGIN(sample);
+                                                    size_block_rle = block_compression(bwt ? transformed : buffer, block, compresd, size_f);
+                                                    PERF_END(sample, PERF_BLOCK_COMPRESSION, compresd);
+                                                    TRACE_END("rle encode", span);
+                                                    bufpool_free(transformed);
+                                                    //If it's the first block with data (In adaptive mode each block decides by itself)
+                                                    if(block_num == first_data && !adaptive) {
+                                                        //If the compression rate is lower than RLE_MIN_GAIN and the user didn't force the rle file
+                                                        if(!rle_worth(compresd, size_block_rle) && !force_rle) compress_rle = false;
                                                     }
                                                 }
 
@@ -283,37 +457,67 @@ _modules_error freq_rle_compress(char** const path, const bool force_rle, const
                                                     }
                                                 }
                                                                         
-                                                //If it's the first block and the user forced the rle file
-                                                if(block_num == 0 && compress_rle) {
-                                                    //Prints the header of the freq file: @R@n_blocks
-                                                    print_rle = fprintf(f_rle_freq,"@R@%lu", n_blocks);
+                                                //If it's the first block and the user forced the rle file (Header's flags are read with read_file_header)
+                                                if(block_num == first_data && compress_rle) {
+                                                    //Prints the header of the freq file: @Rv@n_blocks (@Av@n_blocks if RLE is chosen per block, v for RLE's version 2, c for order-1 contexts)
+                                                    print_rle = fprintf(f_rle_freq,"@%cv%s@%lu", adaptive ? 'A' : 'R', order1 ? "c" : "", n_blocks);
                                                 }
                                                 //If it's the first block and the user didn't forced the rle file or forced the freq file
-                                                if(block_num == 0 && (!compress_rle || force_freq)) {
-                                                    //Prints the header of the freq file: @N@n_blocks
-                                                    print = fprintf(f_freq,"@N@%lu", n_blocks);
+                                                if(block_num == first_data && (!compress_rle || force_freq)) {
+                                                    //Prints the header of the freq file: @N@n_blocks (@Nc@n_blocks with order-1 contexts)
+                                                    print = fprintf(f_freq,"@N%s@%lu", order1 ? "c" : "", n_blocks);
+                                                }
+                                                //If the file starts with holes their headers go right after the file's header
+                                                if(block_num == first_data && first_data && write_holes(f_rle_freq, f_freq, the_block_size, 0, first_data, n_blocks)) {
+                                                    print = print_rle = 0;
                                                 }
                                                 //If the fprintf went well
                                                 if((print >= 4 && print_rle >= 4) || (print >= 4 && !compress_rle) || print_rle >= 4) {
-                                                    //Allocates memory for all the 256 symbol's frequencies
-                                                    unsigned long *freq = malloc(sizeof(unsigned long)*256);
-                                                    if(freq) {
+                                                    //Allocates memory for all the 256 symbol's frequencies (Twice in adaptive mode to compare both versions of the block)
+                                                    unsigned long *freq = bufpool_alloc(sizeof(unsigned long)*256*(adaptive ? 2 : 1));
+                                                    //And the frequencies of each symbol after each other one (Order-1 contexts)
+                                                    unsigned long (*context_freq)[256] = order1 ? bufpool_alloc(sizeof(unsigned long[256][256])) : NULL;
+                                                    if(freq && (context_freq || !order1)) {
                                                         //If it can be compressed
                                                         if(compress_rle) {
+                                                            const uint8_t *rle_output = block;
+                                                            bool rle_block = true;
+
+                                                            //Generates an array of frequencies of the block (rle file content)
+                                                            span = TRACE_BEGIN();
+                                                            PERF_BEGIN(sample);
+                                                            make_freq(block, freq, size_block_rle);
+                                                            PERF_END(sample, PERF_MAKE_FREQ, size_block_rle);
+                                                            TRACE_END("make freq", span);
+
+                                                            //Keeps the original block if it's estimated to end up smaller than the compressed one (raw/SF against RLE/RLE+SF)
+                                                            if(adaptive) {
+                                                                make_freq(buffer, freq + 256, compresd);
+                                                                rle_block = estimated_size(freq, size_block_rle) < estimated_size(freq + 256, compresd);
+                                                                if(!rle_block) {
+                                                                    rle_output = buffer;
+                                                                    size_block_rle = compresd;
+                                                                    memcpy(freq, freq + 256, sizeof(unsigned long)*256);
+                                                                }
+                                                            }
+                                                            if(entropies) entropies[block_num] = stats_entropy(freq);
                                                                         
                                                             //Loads size of the current block of the rle file to the respective array
                                                             block_rle_sizes[block_num] = size_block_rle;
                                                             //Writes each compressed block in the rle file
-                                                            int res = fwrite(block, 1, size_block_rle, f_rle);
+                                                            int res = fwrite(rle_output, 1, size_block_rle, f_rle);
                                                             if(res == size_block_rle){
-                                                                //Generates an array of frequencies of the block (rle file content)
-                                                                make_freq(block, freq, size_block_rle);
-                                                                //Prints the size of the current compressed block in the freq file
-                                                                if(fprintf(f_rle_freq, "@%lu@", size_block_rle) >= 2) {
+                                                                //Prints the size of the current compressed block in the freq file (Tagged if RLE was chosen for this block, with the size it will be decompressed to and the index which undoes Burrows-Wheeler)
+                                                                error = write_block_header(f_rle_freq, &(BlockHeader) {.size = size_block_rle, .original_size = rle_block ? compresd : 0, .bwt_index = rle_block ? bwt_index : 0, .rle = adaptive && rle_block});
+                                                                //Writes the frequencies of each context before the block's ones
+                                                                if(!error && order1) {
+                                                                    make_context_freq(rle_output, context_freq, size_block_rle);
+                                                                    error = write_context_freq(context_freq, f_rle_freq);
+                                                                }
+                                                                if(!error) {
                                                                     //Writes each frequencies block in the freq file from the rle file
                                                                     error = write_freq(freq, f_rle_freq, block_num, n_blocks);
                                                                 }
-                                                                else error = _FILE_STREAM_FAILED;
                                                         
                                                             }
                                                             else error = _FILE_STREAM_FAILED;
@@ -322,38 +526,48 @@ _modules_error freq_rle_compress(char** const path, const bool force_rle, const
                                                         if(!compress_rle || force_freq) {
                                                                         
                                                             //Generates an array of frequencies of the block (txt file content)
+                                                            span = TRACE_BEGIN();
+                                                            PERF_BEGIN(sample);
                                                             make_freq(buffer, freq, compresd);
+                                                            PERF_END(sample, PERF_MAKE_FREQ, compresd);
+                                                            TRACE_END("make freq", span);
+                                                            if(entropies && !compress_rle) entropies[block_num] = stats_entropy(freq);
                                                             //Prints the current block size in the freq file
                                                             if(fprintf(f_freq, "@%lu@", compresd) >= 2) {
+                                                                //Writes the frequencies of each context before the block's ones
+                                                                if(order1) {
+                                                                    make_context_freq(buffer, context_freq, compresd);
+                                                                    error = write_context_freq(context_freq, f_freq);
+                                                                }
                                                                 //Writes each frequencies block in the freq file from the txt file
-                                                                error = write_freq(freq, f_freq, block_num, n_blocks);
+                                                                if(!error) error = write_freq(freq, f_freq, block_num, n_blocks);
                                                                             
                                                             }
                                                             else error = _FILE_STREAM_FAILED;
                                                             
                                                         }
-                                                        free(freq);
-                                                    
                                                     }
                                                     else error = _LACK_OF_MEMORY;
+                                                    bufpool_free(freq);
+                                                    bufpool_free(context_freq);
                                                 }
                                                 else error = _FILE_STREAM_FAILED;
 
                                             
-                                                free(block);
+                                                bufpool_free(block);
                                             }
                                             else error = _LACK_OF_MEMORY;
 
                                                         
                                         }
-                                        else error = _FILE_STREAM_FAILED;
 
                                         s+=compresd;
-                                        free(buffer);
+                                        bufpool_free(buffer);
                                     }
-                                    else error = _LACK_OF_MEMORY;
                                                 
                                 }
+                                if(reader) block_reader_close(reader);
+                                free(holes);
                                 if(f_rle) fclose(f_rle);
                                 if(f_freq) fclose(f_freq);
                                 if(f_rle_freq) fclose(f_rle_freq);
@@ -401,12 +615,112 @@ _modules_error freq_rle_compress(char** const path, const bool force_rle, const
         t = clock() - t;
         //Calculates the time in milliseconds
         total_t = (float) ((((double) t) / CLOCKS_PER_SEC) * 1000);
-        print_summary(n_blocks, block_sizes, size_f, block_rle_sizes, total_t, path_rle,  path_freq, path_rle_freq);
+        if(STATS == STATS_JSON)
+            error = stats_add_stage("f", path_rle ? "RLE compression and frequencies" : "Frequencies", n_blocks, block_sizes, path_rle ? block_rle_sizes : block_sizes, entropies, path_rle_freq ? path_rle_freq : path_freq);
+        else if(STATS != STATS_NONE) {
+            multithread_lock();
+            print_summary(n_blocks, block_sizes, size_f, block_rle_sizes, total_t, path_rle,  path_freq, path_rle_freq);
+            multithread_unlock();
+        }
         free(block_sizes);
         free(block_rle_sizes);
+        free(entropies);
         if(path_freq) free(path_freq);
         if(path_rle_freq) free(path_rle_freq);
     }
 
     return error;
 }
+
+
+bool rle_worth(const unsigned long size, const unsigned long rle_size)
+{
+    return (float) ((long) size - (long) rle_size) / (float) size >= RLE_MIN_GAIN;
+}
+
+
+unsigned long auto_block_size(const char * const path)
+{
+    unsigned long freq[NUM_SYMBOLS_STATS] = {0}, freq_rle[NUM_SYMBOLS_STATS] = {0}, * sampled = freq;
+    unsigned long long size, min_block, block, total = 0, total_rle = 0, sampled_size = 0;
+    size_t read = 0, read_rle;
+    double entropy, codes_size, ratio = 1;
+    uint8_t * sample, * rle;
+    FILE * fd;
+
+    fd = fopen(path, "rb");
+    if (!fd)
+        return _64KiB;
+
+    sample = malloc(SAMPLE_SIZE);
+    rle = malloc(SAMPLE_SIZE * 2 + 3); // block_compression's worst case
+    if (!sample || !rle || fseek(fd, 0, SEEK_END) || (long long) (size = ftell(fd)) < 0) {
+        free(sample);
+        free(rle);
+        fclose(fd);
+        return _64KiB;
+    }
+
+    // RLE runs first so the codes are built from its output, not the original symbols (Runs leave few of them behind)
+    for (int i = 0; i < SAMPLES; ++i) {
+        if (fseek(fd, (long) (size / SAMPLES * i), SEEK_SET))
+            break;
+
+        read = fread(sample, sizeof(uint8_t), SAMPLE_SIZE, fd);
+        for (size_t j = 0; j < read; ++j)
+            ++freq[sample[j]];
+
+        read_rle = block_compression(sample, rle, read, read);
+        for (size_t j = 0; j < read_rle; ++j)
+            ++freq_rle[rle[j]];
+
+        total += read;
+        total_rle += read_rle;
+    }
+
+    free(sample);
+    free(rle);
+    fclose(fd);
+
+    if (size < _1KiB)
+        return _64KiB; // Module F won't compress it anyway
+
+    if (total && rle_worth(total, total_rle)) {
+        sampled = freq_rle;
+        ratio = (double) total_rle / total;
+    }
+
+    for (int i = 0; i < NUM_SYMBOLS_STATS; ++i)
+        sampled_size += sampled[i];
+
+    // Each symbol's code is written as '0'/'1' characters (about -log2 of its probability, rare symbols get long ones) plus 255 separators
+    codes_size = NUM_SYMBOLS_STATS - 1;
+    for (int i = 0; i < NUM_SYMBOLS_STATS; ++i)
+        if (sampled[i])
+            codes_size += sampled[i] < sampled_size ? -log2((double) sampled[i] / sampled_size) + 1 : 1;
+
+    entropy = stats_entropy(sampled);
+    min_block = codes_size * CODES_OVERHEAD * 8 / ((entropy > 0.5 ? entropy : 0.5) * ratio);
+
+    if (min_block < _64KiB)
+        min_block = _64KiB;
+
+    block = size / ((unsigned long long) multithread_num_cores() * BLOCKS_PER_CORE);
+
+    if (block > _8MiB)
+        block = _8MiB;
+    if (block < min_block) {
+        if (min_block >= size)
+            return size > MAX_BLOCK_SIZE ? MAX_BLOCK_SIZE : size; // Single block
+
+        // Spread over as many blocks as fit so the last one isn't a small one paying for a whole table of codes
+        block = (size + size / min_block - 1) / (size / min_block);
+    }
+
+    if (block >= size)
+        return size > MAX_BLOCK_SIZE ? MAX_BLOCK_SIZE : size; // Single block
+
+    block = (block + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+
+    return block > MAX_BLOCK_SIZE ? MAX_BLOCK_SIZE : block;
+}
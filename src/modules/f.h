@@ -1,18 +1,98 @@
 #ifndef MODULE_F_H
 #define MODULE_F_H
 
+#include <stdio.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #include "utils/errors.h"
 
+#define RLE_MIN_GAIN 0.05 // RLE is only kept (unless forced) if it saves at least 5% of the first block with data
+
 /**
 \brief Compresses file with RLE's algorithm if needed and creates the respective output frequencies' table. Finally saves it to disk
  @param path Pointer to the original file's path
- @param force_rle Force execution of RLE's algorithm even if % of compression <= 5%
+ @param force_rle Force execution of RLE's algorithm even if % of compression < RLE_MIN_GAIN
  @param force_freq Force frequencies' file creation for original file even if it can be compressed with RLE
+ @param adaptive Choose for each block whether it's compressed with RLE (Estimating its size after module C with and without it)
+ @param order1 Also writes the frequencies of each symbol after each other one (Order-1 contexts) so module T builds codes for each context
+ @param bwt Transforms each block with Burrows-Wheeler and move-to-front before RLE (Tagged with its primary index)
  @param block_size Size of each block
  @returns Error status
 */
-_modules_error freq_rle_compress(char ** path, bool force_rle, bool force_freq, unsigned long block_size);
+_modules_error freq_rle_compress(char ** path, bool force_rle, bool force_freq, bool adaptive, bool order1, bool bwt, unsigned long block_size);
+
+/**
+\brief Tells whether RLE saves enough of a block to be kept (At least RLE_MIN_GAIN)
+ @param size Block's size
+ @param rle_size Block's size after RLE
+ @returns True if RLE should be kept
+*/
+bool rle_worth(unsigned long size, unsigned long rle_size);
+
+/**
+\brief Chooses a block size for a file: big enough for each block's codes to cost about 1% of its compressed
+        size (estimated from a few samples after RLE) but small enough to keep every core busy
+ @param path File's path
+ @returns Block size (_64KiB if the file can't be read)
+*/
+unsigned long auto_block_size(const char * path);
+
+/*
+    Each block's work (Also used by the pipeline which runs modules F, T and C block by block)
+*/
+
+/**
+\brief Compresses a block with RLE's version 2: runs of 4 or more symbols (2 or more NULs) as {0}{varint n_reps}symbol,
+       isolated NULs as {0}{0} and everything else as it is
+ @param buffer Array loaded with the original file content
+ @param block Array where to load the compressed content (At least 2 * block_size bytes)
+ @param block_size Size of the current block
+ @param size_f Size of the original file
+ @returns Size of the compressed block
+*/
+unsigned long block_compression(const uint8_t buffer[], uint8_t block[], unsigned long block_size, unsigned long size_f);
+
+/**
+\brief Turns block of content in an array of frequencies (each index matches a symbol from 0 to 255)
+ @param block Array with the symbols (current block)
+ @param freq Array to put the frequencies
+ @param size_block Block size
+*/
+void make_freq(const unsigned char * block, unsigned long * freq, unsigned long size_block);
+
+/**
+\brief Counts the frequencies of each symbol after each other one (Order-1 contexts, the first symbol of the block comes after a NULL)
+ @param block Array with the symbols (current block)
+ @param freq Matrix to put the frequencies (Row of the previous symbol, column of the symbol)
+ @param size_block Block size
+*/
+void make_context_freq(const unsigned char * block, unsigned long (* freq)[256], unsigned long size_block);
+
+/**
+\brief Estimates a block's size after module C: coded with Shannon-Fano or stored if that wouldn't save enough
+ @param freq Array with the frequencies of the block
+ @param size_block Block size
+ @returns Estimated size in bytes
+*/
+double estimated_size(const unsigned long * freq, unsigned long size_block);
+
+/**
+\brief Writes the frequencies in the freq file
+ @param freq Array with the frequencies
+ @param f_freq Freq file where we load the content
+ @param block_num Current block
+ @param n_blocks Number of blocks
+ @returns Error status
+*/
+_modules_error write_freq(const unsigned long * freq, FILE * f_freq, unsigned long long block_num, unsigned long long n_blocks);
+
+/**
+\brief Writes the frequencies of the contexts found in the block (<context>:<frequencies>|) before the block's own ones
+ @param freq Matrix with the frequencies of each context
+ @param f_freq Freq file where we load the content
+ @returns Error status
+*/
+_modules_error write_context_freq(const unsigned long (* freq)[256], FILE * f_freq);
 
 #endif //MODULE_F_H
@@ -0,0 +1,655 @@
+/************************************************
+ *
+ *  Author(s): agent
+ *  Created Date: 19 Oct 2026
+ *  Updated Date: 19 Oct 2026
+ *
+ ***********************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "f.h"
+#include "t.h"
+#include "c.h"
+#include "utils/bwt.h"
+#include "utils/file.h"
+#include "utils/perf.h"
+#include "utils/stats.h"
+#include "utils/trace.h"
+#include "utils/errors.h"
+#include "utils/header.h"
+#include "utils/blockio.h"
+#include "utils/bufpool.h"
+#include "utils/extensions.h"
+#include "utils/multithread.h"
+
+#define NUM_SYMBOLS 256
+
+/*
+    Everything shared by the blocks of a file
+*/
+typedef struct {
+    FILE * f_rle, * f_rle_freq, * f_freq, * f_codes, * f_shafa; // Same files modules F, T and C write (NULL if they aren't)
+    BlockWriter * writer;               // Shannon-Fano's content of the .shaf file
+    bool compress_rle;
+    bool force_freq;
+    bool adaptive;
+    bool ans;                           // Blocks are coded with rANS instead of Shannon-Fano
+    bool order1;                        // Frequencies (and Shannon-Fano's codes) of each context too
+    bool bwt;                           // Blocks are transformed with Burrows-Wheeler and move-to-front before RLE
+    unsigned long restart_interval;
+    unsigned long long num_blocks;
+    unsigned long * input_sizes;        // Original size of each block
+    unsigned long * output_sizes;       // Size of each block in the .shaf file
+    unsigned long long * block_offsets; // Where each block's header is in the .shaf file
+    double * entropies;                 // Only for the JSON statistics
+} Pipeline;
+
+/*
+    A block going through every module: F's output is T and C's input
+*/
+typedef struct {
+    Pipeline * pipeline;
+    unsigned long long block_num;
+    unsigned long size;
+    uint8_t * input;        // Original content (NULL for holes)
+    uint8_t * rle;          // Content compressed with RLE (NULL if the file isn't)
+    unsigned long rle_size;
+    unsigned long bwt_index;    // Primary index of the RLE content's Burrows-Wheeler transform (0 -> None)
+    bool rle_block;         // Modules T and C's input is the RLE content (Otherwise the original one)
+    bool hole;
+    unsigned long freq[NUM_SYMBOLS];          // Frequencies of modules T and C's input
+    unsigned long freq_original[NUM_SYMBOLS]; // Frequencies of the original content (For the adaptive choice and the forced .freq file)
+    unsigned long (* context_freq)[NUM_SYMBOLS];          // Frequencies of each context of modules T and C's input (Only with order-1 contexts)
+    unsigned long (* context_freq_original)[NUM_SYMBOLS]; // Frequencies of each context of the original content (Only for the forced .freq file)
+    char * codes;           // Shannon-Fano's codes (Or the normalized frequencies for rANS, or the codes of each context too)
+    uint8_t * output;       // Shannon-Fano's (or rANS') content (NULL if it's stored)
+    unsigned long output_size;
+    unsigned long long * restarts;
+    unsigned long num_restarts;
+} Block;
+
+
+/**
+\brief Compresses a block with RLE
+ @param block Block
+ @param bwt Transforms the block with Burrows-Wheeler and move-to-front first
+ @returns Error status
+*/
+static _modules_error rle_compress(Block * const block, const bool bwt)
+{
+    _modules_error error = _SUCCESS;
+    uint8_t * transformed = NULL;
+    double span;
+    PerfSample sample;
+
+    block->rle = bufpool_alloc(block->size * 2 + 3); // Worst case is a NULL between every other symbol: (size/2 + 1) * 2 + size/2 < 2*size + 3
+    if (!block->rle)
+        return _LACK_OF_MEMORY;
+
+    if (bwt) {
+        transformed = bufpool_alloc(block->size);
+
+        span = TRACE_BEGIN();
+        PERF_BEGIN(sample);
+        error = transformed ? bwt_encode(block->input, transformed, block->size, &block->bwt_index) : _LACK_OF_MEMORY;
+        PERF_END(sample, PERF_BWT_ENCODE, block->size);
+        TRACE_END("bwt encode", span);
+    }
+
+    if (!error) {
+        span = TRACE_BEGIN();
+        PERF_BEGIN(sample);
+        block->rle_size = block_compression(bwt ? transformed : block->input, block->rle, block->size, block->size);
+        PERF_END(sample, PERF_BLOCK_COMPRESSION, block->size);
+        TRACE_END("rle encode", span);
+    }
+
+    bufpool_free(transformed);
+
+    return error;
+}
+
+
+/**
+\brief Does modules F, T and C's work on a block: RLE (unless the first block already had it), frequencies, codes and Shannon-Fano's compression
+ @param _block Block
+ @returns Error status
+*/
+static _modules_error process_block(void * const _block)
+{
+    Block * const block = (Block *) _block;
+    const Pipeline * const pipeline = block->pipeline;
+    _modules_error error = _SUCCESS;
+    const uint8_t * content;
+    unsigned long content_size;
+    double span;
+    PerfSample sample;
+
+    // Holes have nothing but their (empty) codes or frequencies
+    if (!block->hole) {
+
+        if (pipeline->compress_rle && !block->rle)
+            error = rle_compress(block, pipeline->bwt);
+
+        if (error)
+            return error;
+
+        block->rle_block = pipeline->compress_rle;
+
+        span = TRACE_BEGIN();
+        PERF_BEGIN(sample);
+        if (block->rle_block)
+            make_freq(block->rle, block->freq, block->rle_size);
+        else
+            make_freq(block->input, block->freq, block->size);
+        PERF_END(sample, PERF_MAKE_FREQ, block->rle_block ? block->rle_size : block->size);
+        TRACE_END("make freq", span);
+
+        if (pipeline->compress_rle && (pipeline->adaptive || pipeline->force_freq))
+            make_freq(block->input, block->freq_original, block->size);
+
+        // Keeps the original block if it's estimated to end up smaller than the compressed one (raw/SF against RLE/RLE+SF)
+        if (pipeline->adaptive && estimated_size(block->freq, block->rle_size) >= estimated_size(block->freq_original, block->size)) {
+            block->rle_block = false;
+            memcpy(block->freq, block->freq_original, sizeof(block->freq));
+        }
+
+        if (pipeline->entropies)
+            pipeline->entropies[block->block_num] = stats_entropy(block->freq);
+
+        // Frequencies of each context (Of the original content too if its .freq file is forced)
+        if (pipeline->order1) {
+            block->context_freq = bufpool_alloc(sizeof(unsigned long[NUM_SYMBOLS][NUM_SYMBOLS]));
+            if (!block->context_freq)
+                return _LACK_OF_MEMORY;
+
+            if (block->rle_block)
+                make_context_freq(block->rle, block->context_freq, block->rle_size);
+            else
+                make_context_freq(block->input, block->context_freq, block->size);
+
+            if (pipeline->compress_rle && pipeline->force_freq) {
+                block->context_freq_original = bufpool_alloc(sizeof(unsigned long[NUM_SYMBOLS][NUM_SYMBOLS]));
+                if (!block->context_freq_original)
+                    return _LACK_OF_MEMORY;
+
+                make_context_freq(block->input, block->context_freq_original, block->size);
+            }
+        }
+    }
+
+    // Holes have no contexts (Their codes are the same either way)
+    if (block->context_freq && !pipeline->ans)
+        error = sf_context_block_codes(block->freq, (const unsigned long (*)[NUM_SYMBOLS]) block->context_freq, &block->codes);
+    else {
+        block->codes = bufpool_alloc(SF_BLOCK_CODES_SIZE);
+        if (!block->codes)
+            return _LACK_OF_MEMORY;
+
+        if (pipeline->ans)
+            error = ans_block_freq(block->freq, block->codes);
+        else
+            error = sf_block_codes(block->freq, block->codes);
+    }
+
+    if (!error && !block->hole) {
+        content = block->rle_block ? block->rle : block->input;
+        content_size = block->rle_block ? block->rle_size : block->size;
+
+        if (pipeline->ans)
+            error = ans_block_compress(block->codes, content, content_size, &block->output, &block->output_size);
+        else if (pipeline->order1)
+            error = context_block_compress(block->codes, content, content_size, &block->output, &block->output_size);
+        else
+            error = shafa_block_compress(block->codes, content, content_size, pipeline->restart_interval, &block->output, &block->output_size, &block->restarts, &block->num_restarts);
+    }
+
+    return error;
+}
+
+
+/**
+\brief Writes a block to every file (in order) as modules F, T and C would
+ @param _block Block
+ @param prev_error Previous thread error status
+ @param error Process error status
+ @returns Error status
+*/
+static _modules_error write_block(void * const _block, const _modules_error prev_error, _modules_error error)
+{
+    Block * const block = (Block *) _block;
+    Pipeline * const pipeline = block->pipeline;
+    uint8_t ** content = block->rle_block ? &block->rle : &block->input; // Modules T and C's input
+    const unsigned long content_size = block->rle_block ? block->rle_size : block->size;
+    BlockHeader header, freq_header, shafa_header;
+    double span = TRACE_BEGIN();
+
+    // Header of the block in the frequencies' and codes' files
+    if (block->hole)
+        header = (BlockHeader) {.size = 0, .original_size = block->size, .hole = true};
+    else if (pipeline->compress_rle)
+        header = (BlockHeader) {.size = content_size, .original_size = block->rle_block ? block->size : 0, .bwt_index = block->rle_block ? block->bwt_index : 0, .rle = pipeline->adaptive && block->rle_block};
+    else
+        header = (BlockHeader) {.size = block->size};
+
+    if (!error && !prev_error) {
+
+        // Module F
+        if (pipeline->compress_rle) {
+            if (!block->hole && fwrite(*content, sizeof(uint8_t), content_size, pipeline->f_rle) != content_size)
+                error = _FILE_STREAM_FAILED;
+
+            if (!error && !(error = write_block_header(pipeline->f_rle_freq, &header)) && block->context_freq)
+                error = write_context_freq((const unsigned long (*)[NUM_SYMBOLS]) block->context_freq, pipeline->f_rle_freq);
+
+            if (!error)
+                error = write_freq(block->freq, pipeline->f_rle_freq, block->block_num, pipeline->num_blocks);
+        }
+
+        if (!error && pipeline->f_freq) {
+            freq_header = block->hole ? header : (BlockHeader) {.size = block->size};
+
+            if (!(error = write_block_header(pipeline->f_freq, &freq_header)) && block->context_freq)
+                error = write_context_freq((const unsigned long (*)[NUM_SYMBOLS]) (pipeline->compress_rle ? block->context_freq_original : block->context_freq), pipeline->f_freq);
+
+            if (!error)
+                error = write_freq(pipeline->compress_rle ? block->freq_original : block->freq, pipeline->f_freq, block->block_num, pipeline->num_blocks);
+        }
+
+        // Module T
+        if (!error && !(error = write_block_header(pipeline->f_codes, &header)) && fputs(block->codes, pipeline->f_codes) == EOF)
+            error = _FILE_STREAM_FAILED;
+
+        // Module C (The block is freed by the writer once it's written)
+        if (!error) {
+            shafa_header = (BlockHeader) {
+                .size = block->hole ? 0 : block->output_size,
+                .original_size = header.original_size,
+                .bwt_index = header.bwt_index,
+                .restart_interval = block->restarts ? pipeline->restart_interval : 0,
+                .num_restarts = block->num_restarts,
+                .restarts = block->restarts,
+                .rle = header.rle,
+                .stored = !block->hole && !block->output,
+                .hole = block->hole
+            };
+
+            pipeline->input_sizes[block->block_num] = block->size;
+            pipeline->output_sizes[block->block_num] = shafa_header.size;
+            error = block_writer_header(pipeline->writer, &shafa_header, &pipeline->block_offsets[block->block_num]);
+
+            if (!error && shafa_header.size) {
+                if (block->output) {
+                    error = block_writer_write(pipeline->writer, block->output, shafa_header.size);
+                    block->output = NULL;
+                }
+                else {
+                    error = block_writer_write(pipeline->writer, *content, shafa_header.size);
+                    *content = NULL;
+                }
+            }
+        }
+    }
+
+    bufpool_free(block->input);
+    bufpool_free(block->rle);
+    bufpool_free(block->output);
+    bufpool_free(block->codes);
+    bufpool_free(block->context_freq);
+    bufpool_free(block->context_freq_original);
+    free(block->restarts);
+    free(block);
+
+    TRACE_END("write", span);
+
+    return error;
+}
+
+
+/**
+\brief Queues the next blocks of the original file to be read ahead (Blocks inside holes of a sparse file are skipped)
+ @param reader Reader of the original file
+ @param fd Original file
+ @param holes Where to mark the blocks inside holes
+ @param sparse If the original file is sparse
+ @param next_block Next block to be queued
+ @param queued Number of blocks queued and not taken yet
+ @param num_blocks Number of blocks
+ @param block_size Size of each block (But the last)
+ @param size_f Size of the original file
+ @returns Error status
+*/
+static _modules_error queue_blocks(BlockReader * const reader, FILE * const fd, bool * const holes, const bool sparse, unsigned long long * const next_block, unsigned * const queued, const unsigned long long num_blocks, const unsigned long block_size, const unsigned long long size_f)
+{
+    _modules_error error = _SUCCESS;
+    unsigned long size;
+
+    for (; !error && *queued < READ_AHEAD && *next_block < num_blocks; ++*next_block) {
+        size = *next_block == num_blocks - 1 ? size_f - *next_block * block_size : block_size;
+
+        // The last block always is read so the file's size is kept
+        holes[*next_block] = sparse && *next_block < num_blocks - 1 && block_is_hole(fd, *next_block * block_size, size);
+        error = block_reader_queue(reader, size, holes[*next_block]);
+
+        if (!error && !holes[*next_block])
+            ++*queued;
+    }
+
+    return error;
+}
+
+
+/**
+\brief Opens the files modules F, T and C would write and writes their headers
+ @param pipeline Pipeline (Knows whether RLE is used)
+ @param path Original file's path
+ @param path_shafa Where to save the .shaf file's path
+ @returns Error status
+*/
+static _modules_error open_files(Pipeline * const pipeline, const char * const path, char ** const path_shafa)
+{
+    const FileHeader codes_header = {.mode = !pipeline->compress_rle ? 'N' : pipeline->adaptive ? 'A' : 'R', .rle_v2 = pipeline->compress_rle, .ans = pipeline->ans, .order1 = pipeline->order1 && !pipeline->ans, .num_blocks = pipeline->num_blocks};
+    _modules_error error = _SUCCESS;
+    char * path_base, * path_file;
+
+    // Modules T and C's files are named after F's output
+    path_base = pipeline->compress_rle ? add_ext(path, RLE_EXT) : add_ext(path, "");
+    if (!path_base)
+        return _LACK_OF_MEMORY;
+
+    *path_shafa = add_ext(path_base, SHAFA_EXT);
+
+    if (pipeline->compress_rle) {
+        pipeline->f_rle = fopen(path_base, "wb");
+
+        if ((path_file = add_ext(path_base, FREQ_EXT))) {
+            pipeline->f_rle_freq = fopen(path_file, "wb");
+            free(path_file);
+        }
+    }
+
+    if (!pipeline->compress_rle || pipeline->force_freq) {
+        if ((path_file = add_ext(path, FREQ_EXT))) {
+            pipeline->f_freq = fopen(path_file, "wb");
+            free(path_file);
+        }
+    }
+
+    if ((path_file = add_ext(path_base, CODES_EXT))) {
+        pipeline->f_codes = fopen(path_file, "wb");
+        free(path_file);
+    }
+
+    if (*path_shafa)
+        pipeline->f_shafa = fopen(*path_shafa, "wb");
+
+    free(path_base);
+
+    if (!*path_shafa)
+        return _LACK_OF_MEMORY;
+
+    if ((pipeline->compress_rle && (!pipeline->f_rle || !pipeline->f_rle_freq)) || ((!pipeline->compress_rle || pipeline->force_freq) && !pipeline->f_freq)
+        || !pipeline->f_codes || !pipeline->f_shafa)
+        return _FILE_INACCESSIBLE;
+
+    // Same headers as each module's (@Rv@n_blocks, @Av@n_blocks or @N@n_blocks, with a c for order-1 contexts, and @n_blocks)
+    if (pipeline->compress_rle && fprintf(pipeline->f_rle_freq, "@%cv%s@%llu", codes_header.mode, pipeline->order1 ? "c" : "", pipeline->num_blocks) < 4)
+        error = _FILE_STREAM_FAILED;
+
+    if (!error && pipeline->f_freq && fprintf(pipeline->f_freq, "@N%s@%llu", pipeline->order1 ? "c" : "", pipeline->num_blocks) < 4)
+        error = _FILE_STREAM_FAILED;
+
+    if (!error)
+        error = write_file_header(pipeline->f_codes, &codes_header);
+
+    if (!error && fprintf(pipeline->f_shafa, "@%llu", pipeline->num_blocks) < 2)
+        error = _FILE_STREAM_FAILED;
+
+    if (!error)
+        error = block_writer_open(pipeline->f_shafa, &pipeline->writer);
+
+    return error;
+}
+
+
+/**
+\brief Closes every file written (Removing them if something failed)
+ @param pipeline Pipeline
+ @param path Original file's path
+ @param error Error status
+ @returns Error status (The first one)
+*/
+static _modules_error close_files(Pipeline * const pipeline, const char * const path, _modules_error error)
+{
+    const char * const exts[] = {RLE_EXT, RLE_EXT FREQ_EXT, FREQ_EXT, pipeline->compress_rle ? RLE_EXT CODES_EXT : CODES_EXT, pipeline->compress_rle ? RLE_EXT SHAFA_EXT : SHAFA_EXT};
+    FILE * const files[] = {pipeline->f_rle, pipeline->f_rle_freq, pipeline->f_freq, pipeline->f_codes, pipeline->f_shafa};
+    _modules_error writer_error;
+    char * path_file;
+
+    if (pipeline->writer && (writer_error = block_writer_close(pipeline->writer)) && !error)
+        error = writer_error;
+
+    for (int i = 0; i < 5; ++i) {
+        if (!files[i])
+            continue;
+
+        if (fclose(files[i]) && !error)
+            error = _FILE_STREAM_FAILED;
+
+        if (error && (path_file = add_ext(path, exts[i]))) {
+            remove(path_file);
+            free(path_file);
+        }
+    }
+
+    return error;
+}
+
+
+/**
+\brief Prints the results of the program execution
+ @param num_blocks Number of blocks
+ @param input_sizes Original size of each block
+ @param output_sizes Size of each block in the .shaf file
+ @param total_time Time that the program took to execute
+ @param path The path to the generated file
+*/
+static inline void print_summary(const unsigned long long num_blocks, const unsigned long * const input_sizes, const unsigned long * const output_sizes, const double total_time, const char * const path)
+{
+    unsigned long long input_size = 0, output_size = 0;
+
+    printf(
+        "Module: F, T & C (RLE, frequencies, codes and Shannon-Fano's compression of each block at once)\n"
+        "Number of blocks: %llu\n", num_blocks
+    );
+    for (unsigned long long i = 0; i < num_blocks; ++i) {
+        input_size += input_sizes[i];
+        output_size += output_sizes[i];
+
+        if (STATS == STATS_TEXT)
+            printf("Size before/after & compression rate (Block %llu): %lu/%lu -> %d%%\n", i, input_sizes[i], output_sizes[i], input_sizes[i] ? (int) (((float) output_sizes[i] / input_sizes[i]) * 100) : 0); // Holes are empty
+    }
+
+    printf(
+        "Size before/after: %llu/%llu\n"
+        "Module runtime (milliseconds): %f\n"
+        "Generated file %s\n",
+        input_size, output_size, total_time, path
+    );
+}
+
+
+_modules_error pipeline_compress(char ** const path, const bool force_rle, const bool force_freq, const bool adaptive, const unsigned long block_size, const unsigned long restart_interval, const bool ans, const bool order1, const bool bwt)
+{
+    _modules_error error = _SUCCESS, wait_error;
+    double start_time = clock_wall_ms(), span;
+    FILE * fd;
+    BlockReader * reader = NULL;
+    Block * block, * first = NULL;
+    char * path_shafa = NULL;
+    bool sparse, * holes = NULL;
+    unsigned long the_block_size = block_size, * sizes = NULL;
+    unsigned long long size_f, first_data, next_block = 0;
+    unsigned queued = 0;
+    long size_of_last_block = 0;
+    long long num_blocks;
+    Pipeline pipeline = {.compress_rle = true, .force_freq = force_freq, .adaptive = adaptive, .ans = ans, .order1 = order1, .bwt = bwt, .restart_interval = restart_interval};
+
+    fd = fopen(*path, "rb");
+    if (!fd)
+        return _FILE_INACCESSIBLE;
+
+    num_blocks = fsize(fd, *path, &the_block_size, &size_of_last_block);
+    if (num_blocks <= 0) {
+        fclose(fd);
+        return _FILE_INACCESSIBLE;
+    }
+
+    size_f = (num_blocks - 1) * (unsigned long long) the_block_size + size_of_last_block;
+    if (size_f < _1KiB) {
+        fclose(fd);
+        return _FILE_TOO_SMALL;
+    }
+
+    pipeline.num_blocks = num_blocks;
+
+    sizes = malloc(2 * num_blocks * sizeof(unsigned long));
+    pipeline.block_offsets = malloc(num_blocks * sizeof(unsigned long long));
+    holes = calloc(num_blocks, sizeof(bool));
+
+    // Entropy of each block is only needed for the JSON statistics
+    if (STATS == STATS_JSON)
+        pipeline.entropies = malloc(num_blocks * sizeof(double));
+
+    if (!sizes || !pipeline.block_offsets || !holes || (STATS == STATS_JSON && !pipeline.entropies))
+        error = _LACK_OF_MEMORY;
+    else {
+        pipeline.input_sizes = sizes;
+        pipeline.output_sizes = sizes + num_blocks;
+
+        // Blocks are read ahead while the previous ones go through every module and the ones inside holes of a sparse file aren't read
+        sparse = file_is_sparse(fd);
+        if (!(error = block_reader_open(fd, &reader)))
+            error = queue_blocks(reader, fd, holes, sparse, &next_block, &queued, num_blocks, the_block_size, size_f);
+    }
+
+    // The first block with data chooses whether the file is compressed with RLE (Like module F) before anything is written
+    for (first_data = 0; !error && holes[first_data]; ++first_data);
+
+    if (!error) {
+        first = calloc(1, sizeof(Block));
+
+        if (!first)
+            error = _LACK_OF_MEMORY;
+        else if (!(error = block_reader_next(reader, &first->input))) {
+            --queued;
+            first->size = first_data == (unsigned long long) num_blocks - 1 ? size_f - first_data * the_block_size : the_block_size;
+            error = rle_compress(first, bwt);
+        }
+
+        if (!error && !adaptive && !rle_worth(first->size, first->rle_size) && !force_rle) {
+            pipeline.compress_rle = false;
+            bufpool_free(first->rle);
+            first->rle = NULL;
+        }
+    }
+
+    if (!error)
+        error = open_files(&pipeline, *path, &path_shafa);
+
+    for (unsigned long long block_num = 0; !error && block_num < (unsigned long long) num_blocks; ++block_num) {
+
+        span = TRACE_BEGIN();
+
+        if (block_num == first_data) {
+            block = first;
+            first = NULL;
+        }
+        else {
+            block = calloc(1, sizeof(Block));
+            if (!block) {
+                error = _LACK_OF_MEMORY;
+                break;
+            }
+
+            block->size = block_num == (unsigned long long) num_blocks - 1 ? size_f - block_num * the_block_size : the_block_size;
+            block->hole = holes[block_num];
+
+            // Takes the content of the block (Already read or being read) and queues the next ones
+            if (!block->hole && !(error = block_reader_next(reader, &block->input))) {
+                --queued;
+                error = queue_blocks(reader, fd, holes, sparse, &next_block, &queued, num_blocks, the_block_size, size_f);
+            }
+
+            if (error) {
+                bufpool_free(block->input);
+                free(block);
+                break;
+            }
+        }
+
+        block->pipeline = &pipeline;
+        block->block_num = block_num;
+        TRACE_END("read block", span);
+
+        error = multithread_create(process_block, write_block, block);
+
+        if (error) {
+            bufpool_free(block->input);
+            bufpool_free(block->rle);
+            free(block);
+            break;
+        }
+    }
+
+    wait_error = multithread_wait();
+    if (!error)
+        error = wait_error;
+
+    if (first) {
+        bufpool_free(first->input);
+        bufpool_free(first->rle);
+        free(first);
+    }
+
+    if (reader)
+        block_reader_close(reader);
+
+    // Ends of the codes' file and of the .shaf file (Table of blocks' offsets), the frequencies' files end with their last block
+    if (!error && fprintf(pipeline.f_codes, "@0") < 2)
+        error = _FILE_STREAM_FAILED;
+
+    if (!error && pipeline.writer && (error = block_writer_close(pipeline.writer)) == _SUCCESS)
+        error = write_block_table(pipeline.f_shafa, pipeline.block_offsets, num_blocks);
+    pipeline.writer = NULL;
+
+    error = close_files(&pipeline, *path, error);
+    fclose(fd);
+
+    if (!error) {
+        free(*path);
+        *path = path_shafa;
+        path_shafa = NULL;
+
+        if (STATS == STATS_JSON)
+            error = stats_add_stage("ftc", "RLE, frequencies, codes and Shannon-Fano compression (pipelined)", num_blocks, pipeline.input_sizes, pipeline.output_sizes, pipeline.entropies, *path);
+        else if (STATS != STATS_NONE) {
+            multithread_lock();
+            print_summary(num_blocks, pipeline.input_sizes, pipeline.output_sizes, clock_wall_ms() - start_time, *path);
+            multithread_unlock();
+        }
+    }
+
+    free(path_shafa);
+    free(sizes);
+    free(holes);
+    free(pipeline.block_offsets);
+    free(pipeline.entropies);
+
+    return error;
+}
@@ -0,0 +1,24 @@
+#ifndef MODULE_P_H
+#define MODULE_P_H
+
+#include <stdbool.h>
+
+#include "utils/errors.h"
+
+/**
+\brief Runs modules F, T and C block by block instead of one after the other: while a block is read the previous ones go through RLE,
+       frequencies, codes and Shannon-Fano's compression in the workers and are written in order to the same files the modules would write
+ @param path Pointer to the original file's path (Replaced by the .shaf file's path)
+ @param force_rle Force execution of RLE's algorithm even if % of compression <= 5%
+ @param force_freq Force frequencies' file creation for original file even if it can be compressed with RLE
+ @param adaptive Choose for each block whether it's compressed with RLE (Estimating its size after module C with and without it)
+ @param block_size Size of each block
+ @param restart_interval Symbols between the restart points recorded in each block for module D's parallel decoding (0 -> None, ignored by rANS)
+ @param ans Codes the blocks with rANS instead of Shannon-Fano (The .cod file has the normalized frequencies and is flagged)
+ @param order1 Codes each symbol with the codes of its context (the previous symbol) when they save more than they cost (Ignored by rANS)
+ @param bwt Transforms each block with Burrows-Wheeler and move-to-front before RLE
+ @returns Error status
+*/
+_modules_error pipeline_compress(char ** path, bool force_rle, bool force_freq, bool adaptive, unsigned long block_size, unsigned long restart_interval, bool ans, bool order1, bool bwt);
+
+#endif //MODULE_P_H
@@ -11,9 +11,17 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdbool.h>
 
+#include "t.h"
+#include "utils/stats.h"
+#include "utils/trace.h"
 #include "utils/errors.h"
+#include "utils/header.h"
+#include "utils/rans.h"
+#include "utils/bufpool.h"
 #include "utils/extensions.h"
+#include "utils/multithread.h"
 
 #define NUM_SYMBOLS 256
 #define MIN(a,b) ((a) < (b) ? a : b)
@@ -64,6 +72,35 @@ static _modules_error read_block(char * restrict codes_input, unsigned long * re
     return _SUCCESS;
 }
 
+/**
+\brief Reads the frequencies of a block with order-1 contexts: each context's ones (<context>:<frequencies>|) followed by the block's own ones
+ @param codes_input Buffer of the respective .freq file block (Its separators are overwritten)
+ @param frequencies Array to store the frequencies from each symbol
+ @param context_freq Matrix to store the frequencies of each context (The contexts not in the block are all 0)
+ @returns Error status
+*/
+static _modules_error read_context_block(char * codes_input, unsigned long * frequencies, unsigned long (* context_freq)[NUM_SYMBOLS])
+{
+    _modules_error error = _SUCCESS;
+    unsigned long context;
+    char * separator, * end;
+
+    memset(context_freq, 0, sizeof(unsigned long[NUM_SYMBOLS][NUM_SYMBOLS]));
+
+    while (!error && (separator = strchr(codes_input, '|'))) {
+        *separator = '\0';
+
+        context = strtoul(codes_input, &end, 10);
+        if (end == codes_input || *end != ':' || context >= NUM_SYMBOLS)
+            return _FILE_UNRECOGNIZABLE;
+
+        error = read_block(end + 1, context_freq[context]);
+        codes_input = separator + 1;
+    }
+
+    return error ? error : read_block(codes_input, frequencies);
+}
+
 /**
 \brief Sort the frequencies array in descending order 
  @param frequencies The array to save the frequencies
@@ -209,6 +246,192 @@ static int not_null (unsigned long frequencies[NUM_SYMBOLS])
     return (NUM_SYMBOLS - 1 - r);
 }
 
+_modules_error sf_block_codes(const unsigned long freq[NUM_SYMBOLS], char * block_codes)
+{
+    unsigned long frequencies[NUM_SYMBOLS];
+    int positions[NUM_SYMBOLS], freq_notnull;
+    size_t length;
+    double span;
+
+    // Memory allocation to save the generated codes
+    char (* codes)[NUM_SYMBOLS] = bufpool_calloc(sizeof(char[NUM_SYMBOLS][NUM_SYMBOLS]));
+
+    if (!codes)
+        return _LACK_OF_MEMORY;
+
+    memcpy(frequencies, freq, sizeof(frequencies));
+
+    // Initializes the array to keep the original index of each symbol
+    for (int j = 0; j < NUM_SYMBOLS; ++j) positions[j] = j;
+
+    span = TRACE_BEGIN();
+
+    // Calls insert_sort function
+    insert_sort(frequencies, positions, 0, NUM_SYMBOLS - 1);
+
+    // Holes have no symbols so their codes are all empty
+    if (frequencies[0]) {
+
+        // Saves in freq_notnull the number of non-null elements in the array
+        freq_notnull = not_null(frequencies);
+
+        // Calls sf_codes to generate the Shannon-Fano codes (A single symbol still needs a code or it couldn't be decoded)
+        if (freq_notnull)
+            sf_codes(frequencies, codes, 0, freq_notnull);
+        else
+            add_bit_to_code('0', codes, 0, 0);
+    }
+
+    TRACE_END("build codes", span);
+
+    // Every code followed by ';' but the last one
+    for (int iter = 0; iter < NUM_SYMBOLS; ++iter) {
+        length = strlen(codes[positions[iter]]);
+        memcpy(block_codes, codes[positions[iter]], length);
+        block_codes += length;
+
+        if (iter < NUM_SYMBOLS - 1)
+            *block_codes++ = ';';
+    }
+    *block_codes = '\0';
+
+    // Free allocated memory to codes
+    bufpool_free(codes);
+
+    return _SUCCESS;
+}
+
+
+/**
+\brief Length of each symbol's code
+ @param codes Every symbol's code separated by ';'
+ @param lengths Array to store the lengths
+*/
+static void code_lengths(const char * codes, unsigned long lengths[NUM_SYMBOLS])
+{
+    for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol, ++codes)
+        for (lengths[symbol] = 0; *codes && *codes != ';'; ++codes)
+            ++lengths[symbol];
+}
+
+_modules_error sf_context_block_codes(const unsigned long freq[NUM_SYMBOLS], const unsigned long (* context_freq)[NUM_SYMBOLS], char ** block_codes)
+{
+    _modules_error error;
+    unsigned long lengths[NUM_SYMBOLS], context_lengths[NUM_SYMBOLS];
+    unsigned long long fallback_bits, own_bits;
+    size_t size = 0, capacity = 2 * SF_BLOCK_CODES_SIZE, length;
+    char * codes = bufpool_alloc(capacity), * own_codes = bufpool_alloc(SF_BLOCK_CODES_SIZE), * context_codes = bufpool_alloc(SF_BLOCK_CODES_SIZE), * grown;
+    bool missing;
+
+    error = codes && own_codes && context_codes ? sf_block_codes(freq, own_codes) : _LACK_OF_MEMORY;
+
+    if (!error)
+        code_lengths(own_codes, lengths);
+
+    for (int context = 0; context < NUM_SYMBOLS && !error; ++context) {
+
+        fallback_bits = 0;
+        missing = false;
+
+        // Bits the context's symbols take with the block's codes (Which every symbol of the block should have)
+        for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol) {
+            fallback_bits += (unsigned long long) context_freq[context][symbol] * lengths[symbol];
+            missing |= context_freq[context][symbol] && !lengths[symbol];
+        }
+
+        if (!fallback_bits && !missing)
+            continue;
+
+        if ((error = sf_block_codes(context_freq[context], context_codes)))
+            break;
+
+        code_lengths(context_codes, context_lengths);
+        length = strlen(context_codes);
+
+        // Rare contexts keep using the block's codes since their own would cost more than they save (Their codes are written as characters)
+        own_bits = 8 * (length + 5);
+        for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol)
+            own_bits += (unsigned long long) context_freq[context][symbol] * context_lengths[symbol];
+
+        if (own_bits >= fallback_bits && !missing)
+            continue;
+
+        // Room for the block's own codes too
+        if (size + length + 5 + SF_BLOCK_CODES_SIZE > capacity) {
+            grown = bufpool_realloc(codes, capacity *= 2);
+            if (!grown) {
+                error = _LACK_OF_MEMORY;
+                break;
+            }
+            codes = grown;
+        }
+
+        size += sprintf(codes + size, "%d:%s|", context, context_codes);
+    }
+
+    if (!error) {
+        strcpy(codes + size, own_codes);
+        *block_codes = codes;
+        codes = NULL;
+    }
+
+    bufpool_free(codes);
+    bufpool_free(own_codes);
+    bufpool_free(context_codes);
+
+    return error;
+}
+
+
+_modules_error ans_block_freq(const unsigned long freq[NUM_SYMBOLS], char * block_freq)
+{
+    uint16_t normalized[NUM_SYMBOLS] = {0};
+    unsigned long long total = 0;
+    long sum = 0;
+    int largest = 0;
+    double span = TRACE_BEGIN();
+
+    for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol) {
+        total += freq[symbol];
+        if (freq[symbol] > freq[largest])
+            largest = symbol;
+    }
+
+    // Holes have no symbols so every frequency is 0
+    if (total) {
+
+        // Each symbol of the block keeps at least 1 slot of the table or it couldn't be coded
+        for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol) {
+            if (freq[symbol]) {
+                normalized[symbol] = freq[symbol] * RANS_TABLE_SIZE / total;
+                if (!normalized[symbol])
+                    normalized[symbol] = 1;
+                sum += normalized[symbol];
+            }
+        }
+
+        // The slots taken by the rare symbols come from the biggest frequencies (One at a time so none drops to 0)
+        while (sum > RANS_TABLE_SIZE) {
+            int biggest = largest;
+            for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol)
+                if (normalized[symbol] > normalized[biggest])
+                    biggest = symbol;
+            --normalized[biggest];
+            --sum;
+        }
+
+        // And the ones left by the rounding go to the most frequent symbol
+        normalized[largest] += RANS_TABLE_SIZE - sum;
+    }
+
+    TRACE_END("build table", span);
+
+    rans_write_freq(normalized, block_freq);
+
+    return _SUCCESS;
+}
+
+
 /**
 \brief Prints in the screen all information related to this module 
  @param num_blocks Number of blocks analyzed
@@ -224,16 +447,21 @@ static inline void print_summary(unsigned long long num_blocks, const unsigned l
             "Francisco Neves,a93202,MIEI/CD, 1-JAN-2021\n"
             "Leonardo Freitas,a93281,MIEI/CD, 1-JAN-2021\n"
             "Module:T (Calculation of symbol codes)\n"
-            "Number of blocks: %lu\n"
-            "Size of blocks analyzed in the symbol file: " ,
+            "Number of blocks: %lu\n",
             num_blocks 
     );
-    // Prints the sizes of each block, except the last 
-    for (i = 0; i < num_blocks - 1; ++i) {
-        printf("%lu/", sizes[i]);
+
+    // Only when the user wants every block
+    if (STATS == STATS_TEXT) {
+        printf("Size of blocks analyzed in the symbol file: ");
+
+        // Prints the sizes of each block, except the last 
+        for (i = 0; i < num_blocks - 1; ++i) {
+            printf("%lu/", sizes[i]);
+        }
+        // Prints the size of the last block
+        printf("%lu bytes\n", sizes[i]);
     }
-    // Prints the size of the last block
-    printf("%lu bytes\n", sizes[i]);
 
     printf(
             "Module runtime (milliseconds): %f\n"
@@ -243,22 +471,23 @@ static inline void print_summary(unsigned long long num_blocks, const unsigned l
 }
 
 
-_modules_error get_shafa_codes(const char * path)
+_modules_error get_shafa_codes(const char * path, const bool ans)
 {
     clock_t t;
     FILE * fd_freq, * fd_codes;
     char * path_freq;
     char * path_codes;
     char * block_input;
-    char mode;
+    FileHeader file_header;
     unsigned long long num_blocks = 0;
     unsigned long block_size = 0;
-    int freq_notnull, iter;
+    BlockHeader header;
     int error = _SUCCESS;
-    int positions[NUM_SYMBOLS];
     unsigned long frequencies[NUM_SYMBOLS], * sizes = NULL ;
-    double total_time;
-    char (* codes)[NUM_SYMBOLS];
+    double total_time, * entropies = NULL;
+    char * block_codes, * context_codes = NULL;
+    unsigned long (* context_freq)[NUM_SYMBOLS];
+    bool contexts;
 
     t = clock();
     
@@ -275,13 +504,25 @@ _modules_error get_shafa_codes(const char * path)
         if (fd_freq) {
 
              // Reading the header of .freq file
-            if (fscanf(fd_freq, "@%c@%lu", &mode, &num_blocks) == 2) {   
+            if (!(error = read_file_header(fd_freq, &file_header))) {   
+
+                num_blocks = file_header.num_blocks;
 
-                // Checks if it haves a possible mode (R - RLE or N - Normal)
-                if (mode == 'R' || mode == 'N') {
+                // Checks if it haves a possible mode (R - RLE, N - Normal or A - RLE chosen per block)
+                if (file_header.mode == 'R' || file_header.mode == 'N' || file_header.mode == 'A') {
 
                 // Allocates memory to an array with the purpose of saving the sizes of each block
                     sizes = malloc (num_blocks * sizeof(unsigned long));
+
+                    // Allocates memory to save the entropy of each block (Only needed for the JSON statistics)
+                    if (sizes && STATS == STATS_JSON) {
+                        entropies = malloc (num_blocks * sizeof(double));
+
+                        if (!entropies) {
+                            free(sizes);
+                            sizes = NULL;
+                        }
+                    }
                     
                     // Checks if it was possible to allocate memory
                     if (sizes) {                    
@@ -298,96 +539,94 @@ _modules_error get_shafa_codes(const char * path)
                             // Checks if it was possible to open the file
                             if (fd_codes) {
                                 
-                                // Prints header in the .cod file and checks if it only prints the proper elements
-                                if (fprintf(fd_codes, "@%c@%lu", mode, num_blocks) >= 3) {                               
+                                // Prints header in the .cod file (Same mode and flags, flagged if the blocks are coded with rANS) and checks if it only prints the proper elements
+                                // rANS only uses each block's own frequencies so its .cod file has no contexts
+                                contexts = file_header.order1;
+                                file_header.ans = ans;
+                                file_header.order1 = contexts && !ans;
+
+                                // Frequencies of each context (Only for files with order-1 contexts)
+                                context_freq = contexts ? bufpool_alloc(sizeof(unsigned long[NUM_SYMBOLS][NUM_SYMBOLS])) : NULL;
+                                if (contexts && !context_freq)
+                                    error = _LACK_OF_MEMORY;
+
+                                if (!error && !(error = write_file_header(fd_codes, &file_header))) {                               
                                     
                                     // Loop to analyze every block in .freq file
                                     for (long long i = 0; i < num_blocks && !error; ++i) {
 
-                                        // Memory allocation to save the generated codes
-                                        codes = calloc(1, sizeof(char[NUM_SYMBOLS][NUM_SYMBOLS]));
-                                        
+                                        // Memory allocation to save the generated codes (Same layout as a block of the .cod file)
+                                        block_codes = bufpool_alloc(SF_BLOCK_CODES_SIZE);
+
                                         // Checks if it was possible to allocate the required memory
-                                        if (codes) {
-                                            
+                                        if (block_codes) {
+
                                             // Initializes the array to keep the frequencies with 0's
                                             memset(frequencies, 0, NUM_SYMBOLS * 4);
 
-                                            // Initializes the array to keep the original index of each symbol
-                                            for (int j = 0; j < NUM_SYMBOLS; ++j) positions[j] = j;
+                                            // Reads the current block's header (size and tags) and verifies possible file stream errors
+                                            if (!(error = read_block_header(fd_freq, &header))) {
 
-                                            // Reads the current block size and verifies possible file stream errors
-                                            if (fscanf(fd_freq, "@%lu", &block_size) == 1) {
+                                                block_size = header.size;
 
                                                 // Saves the size of the block in the array to that purpose
                                                 sizes[i] = block_size;
                                     
-                                                // Allocates memory to keep the frequencies read, so it's possible to the lecture in only 1 access
-                                                block_input = malloc(9 * NUM_SYMBOLS + (NUM_SYMBOLS - 1) + 1); // 9 (max digits for frequency) + 256 (symbols) + 255 (';') + 1 (NULL terminator)
+                                                // Allocates memory to keep the frequencies read, so it's possible to the lecture in only 1 access (Blocks with contexts are allocated while they're read)
+                                                block_input = contexts ? NULL : bufpool_alloc(9 * NUM_SYMBOLS + (NUM_SYMBOLS - 1) + 1); // 9 (max digits for frequency) + 256 (symbols) + 255 (';') + 1 (NULL terminator)
 
                                                 // Checks if it was possible to allocate the required memory
-                                                if (block_input) {
+                                                if (block_input || contexts) {
                                                     
                                                     // Reads the frequencies and verifies the read
-                                                    if (fscanf(fd_freq, "@%2559[^@]", block_input) == 1) {
-                                            
-                                                        // Calls read_block function
-                                                        error = read_block(block_input, frequencies);
-                                                       
-                                                       // Checks for possible errors in read_block function
-                                                        if (!error) {
-                                                            
-                                                            // Calls insert_sort function
-                                                            insert_sort(frequencies, positions, 0, NUM_SYMBOLS - 1);
-
-                                                            // Saves in freq_notnull the number of non-null elements in the array
-                                                            freq_notnull = not_null(frequencies);
-
-                                                            // Calls sf_codes to generate the Shannon-Fano codes
-                                                            sf_codes(frequencies, codes, 0, freq_notnull);
-
-                                                            // Prints in the .cod file the block size
-                                                            if (fprintf(fd_codes, "@%lu@", block_size) >= 2) {
-
-                                                                // Loop to print the codes till the last one in .cod file and checks for possible file stream errors
-                                                                for (iter = 0; iter < NUM_SYMBOLS - 1 && !error; ++iter) {
-                                                                    
-                                                                    if (fprintf(fd_codes, "%s;", codes[positions[iter]]) < 1)
-                                                                        error = _FILE_STREAM_FAILED;
-                                                                }
-
-                                                                // Prints last code in the file and checks for possible file stream errors
-                                                                if (!error && fprintf(fd_codes, "%s", codes[positions[iter]]) < 0) 
-                                                                    error = _FILE_STREAM_FAILED;
-                                                                    
-                                                            }
-                                                            else 
-                                                                error = _FILE_STREAM_FAILED;
-                                                             
-                                                        }
+                                                    if (contexts)
+                                                        error = read_block_content(fd_freq, &block_input);
+                                                    else if (fscanf(fd_freq, "%2559[^@]", block_input) != 1)
+                                                        error = _FILE_STREAM_FAILED;
 
+                                                    // Calls read_block function (Each context's frequencies come before the block's own ones)
+                                                    if (!error)
+                                                        error = contexts ? read_context_block(block_input, frequencies, context_freq) : read_block(block_input, frequencies);
+                                                       
+                                                    // Checks for possible errors in read_block function
+                                                    if (!error) {
+
+                                                        if (entropies)
+                                                            entropies[i] = stats_entropy(frequencies);
+                                                        
+                                                        // Generates the Shannon-Fano codes (Or the normalized frequencies for rANS, or the codes of each context too)
+                                                        if (ans)
+                                                            error = ans_block_freq(frequencies, block_codes);
+                                                        else if (contexts)
+                                                            error = sf_context_block_codes(frequencies, (const unsigned long (*)[NUM_SYMBOLS]) context_freq, &context_codes);
+                                                        else
+                                                            error = sf_block_codes(frequencies, block_codes);
+
+                                                        // Prints in the .cod file the block's header (Same size and tags) and the codes
+                                                        if (!error && !(error = write_block_header(fd_codes, &header)) && fputs(file_header.order1 ? context_codes : block_codes, fd_codes) == EOF)
+                                                            error = _FILE_STREAM_FAILED;
+
+                                                        if (file_header.order1)
+                                                            bufpool_free(context_codes);
+                                                        context_codes = NULL;
                                                     }
-                                                    else 
-                                                        error = _FILE_STREAM_FAILED;
                                                     
                                                     // Free allocated memory to block_input
-                                                    free(block_input);
+                                                    bufpool_free(block_input);
                                                 }
                                                 else
                                                     error = _LACK_OF_MEMORY;
                                             }
-                                            else 
-                                                error = _FILE_STREAM_FAILED;
                                             
-                                            // Free allocated memory to codes
-                                            free(codes);
+                                            // Free allocated memory to block_codes
+                                            bufpool_free(block_codes);
                                         }
                                         else
                                             error = _LACK_OF_MEMORY;
                                     }
                                 }
-                                else 
-                                    error = _FILE_STREAM_FAILED;
+
+                                bufpool_free(context_freq);
 
                                     /* if we don't have any error at this point, 
                                     it should write "@0" in the .cod file to indicate 
@@ -414,8 +653,6 @@ _modules_error get_shafa_codes(const char * path)
                 else
                     error = _FILE_UNRECOGNIZABLE;   
             }  
-            else 
-                error = _FILE_UNRECOGNIZABLE;
             
             // Closes input file
             fclose(fd_freq);
@@ -434,12 +671,21 @@ _modules_error get_shafa_codes(const char * path)
         t = clock() - t;
         total_time = (((double) t) / CLOCKS_PER_SEC) * 1000;
 
-        // Calls print_summary function
-        print_summary(num_blocks, sizes, total_time, path_codes);
+        // Calls print_summary function or saves the statistics for later
+        if (STATS == STATS_JSON)
+            error = stats_add_stage("t", ans ? "rANS normalized frequencies" : "Shannon-Fano codes", num_blocks, sizes, NULL, entropies, path_codes);
+        else if (STATS != STATS_NONE) {
+            multithread_lock();
+            print_summary(num_blocks, sizes, total_time, path_codes);
+            multithread_unlock();
+        }
+
+        free(path_codes);
     }              
 
     // Free allocated memory to sizes
     free(sizes);
+    free(entropies);
     
     return error;
 }
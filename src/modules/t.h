@@ -1,13 +1,47 @@
 #ifndef MODULE_T_H
 #define MODULE_T_H
 
+#include <stdbool.h>
+
 #include "utils/errors.h"
 
+#define SF_BLOCK_CODES_SIZE 33152 // Sum of 1 to 256 (worst case Shannon-Fano) + 255 semicolons + 1 byte NULL
+
 /**
 \brief Creates a table of Shanon Fano's codes and saves it to disk
  @param path Original/RLE file's path
+ @param ans Saves each block's frequencies normalized for rANS instead of its codes (The .cod file is flagged so modules C and D use rANS)
+ @returns Error status
+*/
+_modules_error get_shafa_codes(const char * path, bool ans);
+
+
+/**
+\brief Generates a block's Shannon-Fano codes (Also used by the pipeline which runs modules F, T and C block by block)
+ @param freq Frequency of each symbol (All zeros for a hole: every code is empty)
+ @param block_codes Where to write every symbol's code separated by ';' as in a block of the .cod file (At least SF_BLOCK_CODES_SIZE bytes)
+ @returns Error status
+*/
+_modules_error sf_block_codes(const unsigned long freq[256], char * block_codes);
+
+
+/**
+\brief Generates a block's Shannon-Fano codes and the ones of each context (previous symbol) which saves more than its codes cost
+       (Also used by the pipeline which runs modules F, T and C block by block)
+ @param freq Frequency of each symbol (Their codes are used by the contexts without their own)
+ @param context_freq Frequency of each symbol after each other one
+ @param block_codes Where to save the codes as in a block of the .cod file: (<context>:<codes>|)*<block's codes> (It's the caller's to be freed with bufpool_free)
+ @returns Error status
+*/
+_modules_error sf_context_block_codes(const unsigned long freq[256], const unsigned long (* context_freq)[256], char ** block_codes);
+
+
+/**
+\brief Normalizes a block's frequencies so they add up to rANS' table size (Every symbol of the block keeps at least 1)
+ @param freq Frequency of each symbol (All zeros for a hole: every normalized frequency is 0)
+ @param block_freq Where to write the normalized frequencies separated by ';' as in a block of the .cod file (At least RANS_BLOCK_FREQ_SIZE bytes)
  @returns Error status
 */
-_modules_error get_shafa_codes(const char * path);
+_modules_error ans_block_freq(const unsigned long freq[256], char * block_freq);
 
 #endif //MODULE_T_H
\ No newline at end of file
@@ -0,0 +1,566 @@
+#include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "errors.h"
+#include "blockio.h"
+#include "bufpool.h"
+
+#ifdef URING
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/*
+    Submission and completion queues shared with the kernel (Only one thread at a time may use a ring)
+*/
+typedef struct {
+    int fd;
+    unsigned * sq_tail, * sq_mask, * sq_array;
+    unsigned * cq_head, * cq_tail, * cq_mask;
+    struct io_uring_sqe * sqes;
+    struct io_uring_cqe * cqes;
+    void * sq_ring, * cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned to_submit;
+} Ring;
+
+
+/**
+\brief Creates a ring (Fails where io_uring isn't available, e.g. older kernels or seccomp filters)
+ @param ring Ring
+ @param entries Requests that may be in flight at once
+ @returns Whether the ring can be used
+*/
+static bool ring_init(Ring * const ring, const unsigned entries)
+{
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(Ring));
+
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0)
+        return false;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->sq_ring != MAP_FAILED)
+            munmap(ring->sq_ring, ring->sq_ring_size);
+        if (ring->cq_ring != MAP_FAILED)
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        if (ring->sqes != MAP_FAILED)
+            munmap(ring->sqes, ring->sqes_size);
+        close(ring->fd);
+        return false;
+    }
+
+    ring->sq_tail = (unsigned *) ((char *) ring->sq_ring + params.sq_off.tail);
+    ring->sq_mask = (unsigned *) ((char *) ring->sq_ring + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) ((char *) ring->sq_ring + params.sq_off.array);
+    ring->cq_head = (unsigned *) ((char *) ring->cq_ring + params.cq_off.head);
+    ring->cq_tail = (unsigned *) ((char *) ring->cq_ring + params.cq_off.tail);
+    ring->cq_mask = (unsigned *) ((char *) ring->cq_ring + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) ((char *) ring->cq_ring + params.cq_off.cqes);
+
+    return true;
+}
+
+
+/**
+\brief Queues a read or a write (Submitted by the next ring_enter, so several go in a single system call)
+ @param ring Ring
+ @param opcode IORING_OP_READ or IORING_OP_WRITE
+ @param fd File's descriptor
+ @param buffer Block
+ @param size Block's size
+ @param offset Block's offset in the file
+ @param data Identifies the request in its completion
+*/
+static void ring_prepare(Ring * const ring, const uint8_t opcode, const int fd, uint8_t * const buffer, const unsigned long size, const unsigned long long offset, const unsigned long long data)
+{
+    const unsigned tail = *ring->sq_tail;
+    const unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe * const sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t) buffer;
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->user_data = data;
+
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++ring->to_submit;
+}
+
+
+/**
+\brief Submits every queued request and optionally waits for a completion
+ @param ring Ring
+ @param wait Waits for at least one completion
+ @returns Whether it succeeded
+*/
+static bool ring_enter(Ring * const ring, const bool wait)
+{
+    int submitted;
+
+    do
+        submitted = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    while (submitted < 0 && errno == EINTR);
+
+    if (submitted < 0)
+        return false;
+
+    ring->to_submit -= submitted;
+    return true;
+}
+
+
+/**
+\brief Takes the oldest completion
+ @param ring Ring
+ @param data Where to save the request's identifier
+ @param result Where to save the request's result (Bytes or -errno)
+ @returns Whether there was a completion
+*/
+static bool ring_complete(Ring * const ring, unsigned long long * const data, int * const result)
+{
+    const unsigned head = *ring->cq_head;
+    const struct io_uring_cqe * cqe;
+
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        return false;
+
+    cqe = &ring->cqes[head & *ring->cq_mask];
+    *data = cqe->user_data;
+    *result = cqe->res;
+
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+
+/**
+\brief Destroys a ring (Every request must be complete)
+ @param ring Ring
+*/
+static void ring_exit(Ring * const ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+
+/**
+\brief Finishes a request which didn't transfer every byte (Short or failed, e.g. interrupted) with blocking system calls
+ @param fd File's descriptor
+ @param write Whether it's a write
+ @param buffer Block
+ @param size Block's size
+ @param offset Block's offset in the file
+ @param done Bytes already transferred (Negative if the request failed)
+ @returns Error status
+*/
+static _modules_error finish_request(const int fd, const bool write, uint8_t * const buffer, const unsigned long size, const unsigned long long offset, long long done)
+{
+    ssize_t transferred;
+
+    for (done = done < 0 ? 0 : done; (unsigned long) done < size; done += transferred) {
+        if (write)
+            transferred = pwrite(fd, buffer + done, size - done, offset + done);
+        else
+            transferred = pread(fd, buffer + done, size - done, offset + done);
+
+        if (transferred <= 0)
+            return _FILE_STREAM_FAILED;
+    }
+
+    return _SUCCESS;
+}
+#endif
+
+
+/*
+    Block queued in a reader
+*/
+typedef struct {
+    uint8_t * block;
+    unsigned long size;
+    unsigned long long offset;
+    unsigned long long skip; // Bytes skipped right before it
+    long long done;          // Bytes read or the request's error (Only with io_uring)
+    bool finished;
+} Queued;
+
+struct BlockReader {
+    FILE * fd;
+    Queued queue[READ_AHEAD];
+    unsigned head;
+    unsigned count;
+    unsigned long long offset;  // Where the next queued block starts
+    unsigned long long skip;    // Bytes skipped since the last queued block
+#ifdef URING
+    Ring ring;
+    bool uring;
+#endif
+};
+
+
+_modules_error block_reader_open(FILE * const fd, BlockReader ** const reader)
+{
+    const long offset = ftell(fd);
+
+    if (offset < 0)
+        return _FILE_STREAM_FAILED;
+
+    *reader = calloc(1, sizeof(BlockReader));
+    if (!*reader)
+        return _LACK_OF_MEMORY;
+
+    (*reader)->fd = fd;
+    (*reader)->offset = offset;
+
+#ifdef URING
+    (*reader)->uring = ring_init(&(*reader)->ring, READ_AHEAD);
+#endif
+
+    return _SUCCESS;
+}
+
+
+_modules_error block_reader_queue(BlockReader * const reader, const unsigned long size, const bool skip)
+{
+    Queued * queued;
+    unsigned slot;
+
+    if (skip) {
+        reader->offset += size;
+        reader->skip += size;
+        return _SUCCESS;
+    }
+
+    if (reader->count == READ_AHEAD)
+        return _FILE_STREAM_FAILED;
+
+    slot = (reader->head + reader->count) % READ_AHEAD;
+    queued = &reader->queue[slot];
+
+    *queued = (Queued) {.size = size, .offset = reader->offset, .skip = reader->skip, .finished = true};
+
+#ifdef URING
+    if (reader->uring) {
+        queued->block = bufpool_alloc(size);
+        if (!queued->block)
+            return _LACK_OF_MEMORY;
+
+        queued->finished = false;
+        ring_prepare(&reader->ring, IORING_OP_READ, fileno(reader->fd), queued->block, size, queued->offset, slot);
+    }
+#endif
+
+    reader->offset += size;
+    reader->skip = 0;
+    ++reader->count;
+
+    return _SUCCESS;
+}
+
+
+_modules_error block_reader_next(BlockReader * const reader, uint8_t ** const block)
+{
+    _modules_error error = _SUCCESS;
+    Queued * queued;
+
+    *block = NULL;
+
+    if (!reader->count)
+        return _FILE_STREAM_FAILED;
+
+    queued = &reader->queue[reader->head];
+
+#ifdef URING
+    if (reader->uring) {
+        unsigned long long data;
+        int result;
+
+        // Everything queued since the last block is submitted at once
+        if (reader->ring.to_submit && !ring_enter(&reader->ring, false))
+            return _FILE_STREAM_FAILED;
+
+        while (!queued->finished) {
+            if (ring_complete(&reader->ring, &data, &result)) {
+                reader->queue[data].done = result;
+                reader->queue[data].finished = true;
+            }
+            else if (!ring_enter(&reader->ring, true))
+                return _FILE_STREAM_FAILED;
+        }
+
+        if ((unsigned long long) queued->done != queued->size)
+            error = finish_request(fileno(reader->fd), false, queued->block, queued->size, queued->offset, queued->done);
+
+        if (!error)
+            *block = queued->block;
+        else
+            bufpool_free(queued->block);
+    }
+    else
+#endif
+    {
+        *block = bufpool_alloc(queued->size);
+        if (!*block)
+            error = _LACK_OF_MEMORY;
+        else if (queued->skip && fseek(reader->fd, queued->skip, SEEK_CUR)) {
+            bufpool_free(*block);
+            *block = NULL;
+            error = _FILE_STREAM_FAILED;
+        }
+        else if (fread(*block, sizeof(uint8_t), queued->size, reader->fd) != queued->size) {
+            bufpool_free(*block);
+            *block = NULL;
+            error = _FILE_STREAM_FAILED;
+        }
+    }
+
+    reader->head = (reader->head + 1) % READ_AHEAD;
+    --reader->count;
+
+    return error;
+}
+
+
+void block_reader_close(BlockReader * const reader)
+{
+#ifdef URING
+    unsigned long long data, taken;
+    int result;
+
+    if (reader->uring) {
+        taken = reader->count ? reader->queue[reader->head].offset : reader->offset;
+
+        // Buffers still being read can't be freed yet
+        if (reader->ring.to_submit)
+            ring_enter(&reader->ring, false);
+
+        for (unsigned i = 0; i < reader->count; ++i) {
+            Queued * const queued = &reader->queue[(reader->head + i) % READ_AHEAD];
+
+            while (!queued->finished) {
+                if (ring_complete(&reader->ring, &data, &result))
+                    reader->queue[data].finished = true;
+                else if (!ring_enter(&reader->ring, true))
+                    break; // Can't wait for it so its buffer is leaked rather than freed under the kernel
+            }
+
+            if (queued->finished)
+                bufpool_free(queued->block);
+        }
+
+        ring_exit(&reader->ring);
+        fseek(reader->fd, taken, SEEK_SET);
+    }
+#endif
+
+    free(reader);
+}
+
+
+struct BlockWriter {
+    FILE * fd;
+    _modules_error error;
+#ifdef URING
+    Ring ring;
+    bool uring;
+    unsigned long long offset; // Where the next header or block goes (The stream is only moved there once the writer is closed)
+    unsigned in_flight;
+    struct {
+        uint8_t * block;
+        unsigned long size;
+        unsigned long long offset;
+        bool busy;
+    } slots[WRITE_BEHIND * 2]; // A header and its block each
+#endif
+};
+
+
+#ifdef URING
+/**
+\brief Takes the completed writes (Finishing the short ones) and frees their blocks
+ @param writer Writer
+ @param wait Waits for at least one write
+ @returns Whether it could wait (Blocks in flight can't be freed otherwise)
+*/
+static bool writer_reap(BlockWriter * const writer, bool wait)
+{
+    unsigned long long slot;
+    int result;
+    _modules_error error;
+
+    for (;;) {
+        if (!ring_complete(&writer->ring, &slot, &result)) {
+            if (!wait)
+                return true;
+
+            if (!ring_enter(&writer->ring, true)) {
+                if (!writer->error)
+                    writer->error = _FILE_STREAM_FAILED;
+                return false;
+            }
+            continue;
+        }
+
+        if ((unsigned long) result != writer->slots[slot].size) {
+            error = finish_request(fileno(writer->fd), true, writer->slots[slot].block, writer->slots[slot].size, writer->slots[slot].offset, result);
+            if (!writer->error)
+                writer->error = error;
+        }
+
+        bufpool_free(writer->slots[slot].block);
+        writer->slots[slot].busy = false;
+        --writer->in_flight;
+        wait = false;
+    }
+}
+#endif
+
+
+#ifdef URING
+/**
+\brief Writes a buffer at the writer's position and moves it after the buffer
+ @param writer Writer
+ @param block Buffer from bufpool_alloc (It's the writer's to be freed, even if it fails)
+ @param size Buffer's size
+ @returns Error status
+*/
+static _modules_error writer_submit(BlockWriter * const writer, uint8_t * const block, const unsigned long size)
+{
+    unsigned slot;
+
+    if (writer->in_flight == WRITE_BEHIND * 2 && !writer_reap(writer, true)) {
+        bufpool_free(block);
+        return _FILE_STREAM_FAILED;
+    }
+
+    for (slot = 0; writer->slots[slot].busy; ++slot);
+
+    writer->slots[slot].block = block;
+    writer->slots[slot].size = size;
+    writer->slots[slot].offset = writer->offset;
+    writer->slots[slot].busy = true;
+    ++writer->in_flight;
+
+    ring_prepare(&writer->ring, IORING_OP_WRITE, fileno(writer->fd), block, size, writer->offset, slot);
+    if (!ring_enter(&writer->ring, false) && !writer->error)
+        writer->error = _FILE_STREAM_FAILED; // Still queued so the block can't be freed
+
+    writer->offset += size;
+
+    writer_reap(writer, false);
+
+    return writer->error;
+}
+#endif
+
+
+_modules_error block_writer_open(FILE * const fd, BlockWriter ** const writer)
+{
+#ifdef URING
+    long offset;
+#endif
+
+    *writer = calloc(1, sizeof(BlockWriter));
+    if (!*writer)
+        return _LACK_OF_MEMORY;
+
+    (*writer)->fd = fd;
+
+#ifdef URING
+    // Whatever stdio has goes before the blocks (Written with stdio if the position can't be known)
+    if (!fflush(fd) && (offset = ftell(fd)) >= 0 && ring_init(&(*writer)->ring, WRITE_BEHIND * 2)) {
+        (*writer)->uring = true;
+        (*writer)->offset = offset;
+    }
+#endif
+
+    return _SUCCESS;
+}
+
+
+_modules_error block_writer_header(BlockWriter * const writer, const BlockHeader * const header, unsigned long long * const offset)
+{
+#ifdef URING
+    uint8_t * buffer;
+
+    if (writer->uring) {
+        buffer = bufpool_alloc(BLOCK_HEADER_MAX_SIZE(header->num_restarts));
+        if (!buffer)
+            return _LACK_OF_MEMORY;
+
+        *offset = writer->offset;
+
+        return writer_submit(writer, buffer, format_block_header((char *) buffer, header));
+    }
+#endif
+
+    *offset = ftell(writer->fd);
+
+    return write_block_header(writer->fd, header);
+}
+
+
+_modules_error block_writer_write(BlockWriter * const writer, uint8_t * const block, const unsigned long size)
+{
+    _modules_error error = _SUCCESS;
+
+#ifdef URING
+    if (writer->uring && size)
+        return writer_submit(writer, block, size);
+#endif
+
+    if (fwrite(block, sizeof(uint8_t), size, writer->fd) != size)
+        error = _FILE_STREAM_FAILED;
+
+    bufpool_free(block);
+
+    return error;
+}
+
+
+_modules_error block_writer_close(BlockWriter * const writer)
+{
+    _modules_error error;
+
+#ifdef URING
+    if (writer->uring) {
+        // Blocks which can't be waited for are leaked rather than freed under the kernel
+        while (writer->in_flight && writer_reap(writer, true));
+
+        ring_exit(&writer->ring);
+
+        // The stream goes on after the last block
+        if (fseek(writer->fd, writer->offset, SEEK_SET) && !writer->error)
+            writer->error = _FILE_STREAM_FAILED;
+    }
+#endif
+
+    error = writer->error;
+    free(writer);
+
+    return error;
+}
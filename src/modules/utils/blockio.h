@@ -0,0 +1,105 @@
+#ifndef UTILS_BLOCKIO_H
+#define UTILS_BLOCKIO_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "errors.h"
+#include "header.h"
+
+#if defined(__linux__) && !defined(NO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define URING // Blocks are read and written asynchronously with io_uring (-DNO_URING builds the stdio version only)
+#endif
+#endif
+
+#define READ_AHEAD 4    // Blocks a BlockReader may have queued
+#define WRITE_BEHIND 8  // Blocks (And their headers) a BlockWriter may have in flight
+
+/*
+    Reads a file's blocks in order ahead of their use. With io_uring every queued block is being read while the previous ones
+    are processed (submitted in batches), otherwise each block is read with stdio when it's asked for.
+*/
+typedef struct BlockReader BlockReader;
+
+/*
+    Writes blocks behind the stream's position so the caller doesn't wait for them (With io_uring, otherwise they're written with stdio).
+    With io_uring the writer keeps the stream's position itself (Headers and blocks are written at it) and only moves the stream once it's closed,
+    so nothing else may be written to the stream in between.
+*/
+typedef struct BlockWriter BlockWriter;
+
+
+/**
+\brief Starts reading a file's blocks from the stream's position
+ @param fd File's stream
+ @param reader Where to save the reader
+ @returns Error status
+*/
+_modules_error block_reader_open(FILE * fd, BlockReader ** reader);
+
+
+/**
+\brief Queues the next bytes of the file (Up to READ_AHEAD blocks may be queued and not taken by block_reader_next)
+ @param reader Reader
+ @param size Block's size
+ @param skip The bytes are skipped instead of read (e.g. a hole): block_reader_next won't return them and they don't count for READ_AHEAD
+ @returns Error status
+*/
+_modules_error block_reader_queue(BlockReader * reader, unsigned long size, bool skip);
+
+
+/**
+\brief Waits for the oldest queued block
+ @param reader Reader
+ @param block Where to save the block (It's the caller's to be freed with bufpool_free)
+ @returns Error status
+*/
+_modules_error block_reader_next(BlockReader * reader, uint8_t ** block);
+
+
+/**
+\brief Stops reading (Waiting for the blocks still being read) and leaves the stream after the last block taken
+ @param reader Reader
+*/
+void block_reader_close(BlockReader * reader);
+
+
+/**
+\brief Starts writing blocks at the stream's position (Anything already written with stdio comes before them)
+ @param fd File's stream
+ @param writer Where to save the writer
+ @returns Error status
+*/
+_modules_error block_writer_open(FILE * fd, BlockWriter ** writer);
+
+
+/**
+\brief Writes a block's header at the writer's position
+ @param writer Writer
+ @param header Block's header
+ @param offset Where to save the header's offset in the file
+ @returns Error status
+*/
+_modules_error block_writer_header(BlockWriter * writer, const BlockHeader * header, unsigned long long * offset);
+
+
+/**
+\brief Writes a block at the writer's position
+ @param writer Writer
+ @param block Block from bufpool_alloc (It's the writer's to be freed, even if it fails)
+ @param size Block's size
+ @returns Error status
+*/
+_modules_error block_writer_write(BlockWriter * writer, uint8_t * block, unsigned long size);
+
+
+/**
+\brief Waits for every block to be written and stops writing (The stream is left after the last block)
+ @param writer Writer
+ @returns First error of the blocks written
+*/
+_modules_error block_writer_close(BlockWriter * writer);
+
+#endif //UTILS_BLOCKIO_H
@@ -0,0 +1,169 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bufpool.h"
+#include "multithread.h"
+
+#ifdef POSIX_THREADS
+#include <pthread.h>
+
+static pthread_mutex_t LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+#define lock() pthread_mutex_lock(&LOCK)
+#define unlock() pthread_mutex_unlock(&LOCK)
+
+#elif defined(WIN_THREADS)
+#include <windows.h>
+
+static SRWLOCK LOCK = SRWLOCK_INIT;
+
+#define lock() AcquireSRWLockExclusive(&LOCK)
+#define unlock() ReleaseSRWLockExclusive(&LOCK)
+
+#else
+#define lock() ((void) 0)
+#define unlock() ((void) 0)
+
+#endif
+
+/*
+    Right before every buffer (Keeps the buffer as aligned as malloc's)
+*/
+typedef union Header {
+    struct {
+        size_t capacity;      // Bytes usable
+        unsigned shift;       // capacity == 2^shift (0 if it isn't kept once freed)
+        union Header * next;  // Next buffer of the same size kept
+    };
+    max_align_t align;
+} Header;
+
+/*
+    Buffers kept for each power of two
+*/
+static struct {
+    Header * kept[BUFPOOL_MAX_SHIFT + 1];
+    size_t size; // Bytes kept
+} CACHE;
+
+
+/**
+\brief Finds the power of two a size is rounded up to
+ @param size Size
+ @returns Its exponent (0 if buffers of this size aren't kept)
+*/
+static unsigned shift_of(const size_t size)
+{
+    unsigned shift = BUFPOOL_MIN_SHIFT;
+
+    if (size < (size_t) 1 << BUFPOOL_MIN_SHIFT || size > (size_t) 1 << BUFPOOL_MAX_SHIFT)
+        return 0;
+
+    while ((size_t) 1 << shift < size)
+        ++shift;
+
+    return shift;
+}
+
+
+void * bufpool_alloc(const size_t size)
+{
+    const unsigned shift = shift_of(size);
+    Header * header = NULL;
+
+    if (shift) {
+        lock();
+        header = CACHE.kept[shift];
+        if (header) {
+            CACHE.kept[shift] = header->next;
+            CACHE.size -= header->capacity;
+        }
+        unlock();
+    }
+
+    if (!header) {
+        header = malloc(sizeof(Header) + (shift ? (size_t) 1 << shift : size));
+        if (!header)
+            return NULL;
+
+        header->capacity = shift ? (size_t) 1 << shift : size;
+        header->shift = shift;
+    }
+
+    return header + 1;
+}
+
+
+void * bufpool_calloc(const size_t size)
+{
+    void * const buffer = bufpool_alloc(size);
+
+    if (buffer)
+        memset(buffer, 0, size);
+
+    return buffer;
+}
+
+
+void * bufpool_realloc(void * const buffer, const size_t size)
+{
+    const Header * header;
+    void * new_buffer;
+
+    if (!buffer)
+        return bufpool_alloc(size);
+
+    header = (Header *) buffer - 1;
+
+    if (size <= header->capacity)
+        return buffer;
+
+    new_buffer = bufpool_alloc(size);
+    if (new_buffer) {
+        memcpy(new_buffer, buffer, header->capacity);
+        bufpool_free(buffer);
+    }
+
+    return new_buffer;
+}
+
+
+void bufpool_free(void * const buffer)
+{
+    Header * header;
+
+    if (!buffer)
+        return;
+
+    header = (Header *) buffer - 1;
+
+    if (header->shift) {
+        lock();
+        if (CACHE.size + header->capacity <= BUFPOOL_MAX_CACHED) {
+            header->next = CACHE.kept[header->shift];
+            CACHE.kept[header->shift] = header;
+            CACHE.size += header->capacity;
+            header = NULL;
+        }
+        unlock();
+    }
+
+    free(header);
+}
+
+
+void bufpool_trim(void)
+{
+    Header * header;
+
+    lock();
+    for (unsigned shift = BUFPOOL_MIN_SHIFT; shift <= BUFPOOL_MAX_SHIFT; ++shift) {
+        while ((header = CACHE.kept[shift])) {
+            CACHE.kept[shift] = header->next;
+            free(header);
+        }
+    }
+    CACHE.size = 0;
+    unlock();
+}
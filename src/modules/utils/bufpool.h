@@ -0,0 +1,58 @@
+#ifndef UTILS_BUFPOOL_H
+#define UTILS_BUFPOOL_H
+
+#include <stddef.h>
+
+#define BUFPOOL_MIN_SHIFT 10                // Smallest buffer kept: 1 KiB (Smaller ones are plain allocations)
+#define BUFPOOL_MAX_SHIFT 26                // Largest buffer kept: 64 MiB, i.e. MAX_BLOCK_SIZE (Bigger ones are plain allocations)
+#define BUFPOOL_MAX_CACHED ((size_t) 256 << 20) // Bytes kept at most (Buffers freed beyond it are released)
+
+/*
+    Recycles the buffers every block allocates (Blocks of a file have the same size so the same sizes are asked for over and over).
+    Sizes are rounded up to a power of two and freed buffers are kept for the next allocation of their size, whichever thread
+    makes it: blocks are usually allocated by the thread reading them and freed by the worker which processed them.
+    Buffers bigger than a block (e.g. RLE's output of a 64 MiB block, 2 * 64 MiB + 3 bytes) aren't rounded up nor kept: each one
+    would take 256 MiB, a few per worker, and fill the whole cache.
+
+    Buffers from bufpool_[c|re]alloc must be freed with bufpool_free (and only them).
+*/
+
+
+/**
+\brief Allocates a buffer (Reusing a freed one when possible)
+ @param size Buffer's size
+ @returns Buffer (NULL if there's no memory)
+*/
+void * bufpool_alloc(size_t size);
+
+
+/**
+\brief Allocates a buffer filled with zeros (Reusing a freed one when possible)
+ @param size Buffer's size
+ @returns Buffer (NULL if there's no memory)
+*/
+void * bufpool_calloc(size_t size);
+
+
+/**
+\brief Resizes a buffer keeping its content (In place while it fits the size it was rounded up to)
+ @param buffer Buffer (NULL allocates a new one)
+ @param size New size
+ @returns Buffer (NULL if there's no memory and then the old one is still valid)
+*/
+void * bufpool_realloc(void * buffer, size_t size);
+
+
+/**
+\brief Frees a buffer, keeping it for the next allocations of its size
+ @param buffer Buffer (May be NULL)
+*/
+void bufpool_free(void * buffer);
+
+
+/**
+\brief Releases every buffer kept
+*/
+void bufpool_trim(void);
+
+#endif //UTILS_BUFPOOL_H
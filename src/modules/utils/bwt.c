@@ -0,0 +1,352 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bwt.h"
+#include "errors.h"
+#include "bufpool.h"
+
+#define NUM_SYMBOLS 256
+#define PACKED_MAX_ROWS (1UL << 24) // Rows which fit in 24 bits (Packed with their symbol in 32 bits)
+
+/*
+    String whose suffixes are sorted: the block (Each byte plus one, ended by a 0) or the names of a reduced problem
+*/
+typedef struct {
+    const uint8_t * bytes;  // NULL for a reduced problem
+    const int32_t * names;
+    int32_t size;           // Including the symbol which ends it
+    int32_t alphabet;       // Every symbol is in [0, alphabet)
+} Text;
+
+
+static inline int32_t symbol_at(const Text * const text, const int32_t idx)
+{
+    if (text->bytes)
+        return idx == text->size - 1 ? 0 : text->bytes[idx] + 1;
+
+    return text->names[idx];
+}
+
+
+// Suffixes' types are kept a bit each: S (smaller than the next suffix) or L (larger)
+static inline bool is_s(const uint8_t * const types, const int32_t idx)
+{
+    return types[idx >> 3] >> (idx & 7) & 1;
+}
+
+
+// Leftmost S suffix of a run of them
+static inline bool is_lms(const uint8_t * const types, const int32_t idx)
+{
+    return idx > 0 && is_s(types, idx) && !is_s(types, idx - 1);
+}
+
+
+/**
+\brief Finds where each symbol's bucket starts (or ends) in the suffix array
+ @param counts Occurrences of each symbol
+ @param alphabet Number of symbols
+ @param buckets Where to save each bucket's start (or end)
+ @param end Saves the buckets' ends instead
+*/
+static void get_buckets(const int32_t * const counts, const int32_t alphabet, int32_t * const buckets, const bool end)
+{
+    int32_t sum = 0;
+
+    for (int32_t symbol = 0; symbol < alphabet; ++symbol) {
+        sum += counts[symbol];
+        buckets[symbol] = end ? sum : sum - counts[symbol];
+    }
+}
+
+
+/**
+\brief Sorts every L suffix from the sorted ones in the array and then every S suffix from the L ones
+ @param text String
+ @param types Type of each suffix
+ @param sa Suffix array (-1 where it's empty)
+ @param counts Occurrences of each symbol
+ @param buckets Room for the buckets
+*/
+static void induce(const Text * const text, const uint8_t * const types, int32_t * const sa, const int32_t * const counts, int32_t * const buckets)
+{
+    int32_t prev;
+
+    get_buckets(counts, text->alphabet, buckets, false);
+    for (int32_t idx = 0; idx < text->size; ++idx) {
+        prev = sa[idx] - 1;
+        if (sa[idx] > 0 && !is_s(types, prev))
+            sa[buckets[symbol_at(text, prev)]++] = prev;
+    }
+
+    get_buckets(counts, text->alphabet, buckets, true);
+    for (int32_t idx = text->size; idx-- > 0; ) {
+        prev = sa[idx] - 1;
+        if (sa[idx] > 0 && is_s(types, prev))
+            sa[--buckets[symbol_at(text, prev)]] = prev;
+    }
+}
+
+
+/**
+\brief Whether two LMS substrings (From an LMS suffix up to the next one) are equal
+ @param text String
+ @param types Type of each suffix
+ @param first Start of the first one
+ @param second Start of the second one
+ @returns true if they are
+*/
+static bool same_lms(const Text * const text, const uint8_t * const types, const int32_t first, const int32_t second)
+{
+    // The symbol which ends the string is unique so they differ before it's reached
+    for (int32_t offset = 0; ; ++offset) {
+        if (symbol_at(text, first + offset) != symbol_at(text, second + offset) || is_s(types, first + offset) != is_s(types, second + offset))
+            return false;
+
+        if (offset && (is_lms(types, first + offset) || is_lms(types, second + offset)))
+            return true;
+    }
+}
+
+
+/**
+\brief Builds a suffix array in linear time (SA-IS: LMS substrings are sorted by induction, named and their order is solved recursively)
+ @param text String (Ended by a unique symbol smaller than the others)
+ @param sa Where to save the suffix array (text->size positions)
+ @returns Error status
+*/
+static _modules_error sais(const Text * const text, int32_t * const sa)
+{
+    const int32_t size = text->size;
+    _modules_error error = _SUCCESS;
+    int32_t idx, pos, prev, name, num_lms;
+    int32_t * reduced_sa, * names;
+    uint8_t * types = calloc(size / 8 + 1, 1);
+    int32_t * counts = calloc(text->alphabet, sizeof(int32_t));
+    int32_t * buckets = malloc(text->alphabet * sizeof(int32_t));
+
+    if (!types || !counts || !buckets) {
+        free(types);
+        free(counts);
+        free(buckets);
+        return _LACK_OF_MEMORY;
+    }
+
+    for (idx = 0; idx < size; ++idx)
+        ++counts[symbol_at(text, idx)];
+
+    // The last suffix is S and the one before it L (Nothing is smaller than the symbol which ends the string)
+    types[(size - 1) >> 3] |= 1 << ((size - 1) & 7);
+    for (idx = size - 2; idx-- > 0; )
+        if (symbol_at(text, idx) < symbol_at(text, idx + 1) || (symbol_at(text, idx) == symbol_at(text, idx + 1) && is_s(types, idx + 1)))
+            types[idx >> 3] |= 1 << (idx & 7);
+
+    // LMS suffixes at the end of their buckets sort their substrings once the others are induced
+    get_buckets(counts, text->alphabet, buckets, true);
+    for (idx = 0; idx < size; ++idx)
+        sa[idx] = -1;
+    for (idx = 1; idx < size; ++idx)
+        if (is_lms(types, idx))
+            sa[--buckets[symbol_at(text, idx)]] = idx;
+
+    induce(text, types, sa, counts, buckets);
+
+    // Sorted LMS substrings go first and each one is named after its rank (Kept by position in the second half)
+    for (idx = 0, num_lms = 0; idx < size; ++idx)
+        if (is_lms(types, sa[idx]))
+            sa[num_lms++] = sa[idx];
+
+    for (idx = num_lms; idx < size; ++idx)
+        sa[idx] = -1;
+
+    for (idx = 0, name = 0, prev = -1; idx < num_lms; ++idx) {
+        pos = sa[idx];
+        if (prev < 0 || !same_lms(text, types, pos, prev)) {
+            ++name;
+            prev = pos;
+        }
+        sa[num_lms + pos / 2] = name - 1;
+    }
+
+    for (idx = size - 1, pos = size - 1; idx >= num_lms; --idx)
+        if (sa[idx] >= 0)
+            sa[pos--] = sa[idx];
+
+    // LMS suffixes' order: straight from their names if they're unique, otherwise from the reduced string's suffix array
+    reduced_sa = sa;
+    names = sa + size - num_lms;
+
+    if (name < num_lms)
+        error = sais(&(Text) {.names = names, .size = num_lms, .alphabet = name}, reduced_sa);
+    else
+        for (idx = 0; idx < num_lms; ++idx)
+            reduced_sa[names[idx]] = idx;
+
+    if (!error) {
+        for (idx = 1, pos = 0; idx < size; ++idx)
+            if (is_lms(types, idx))
+                names[pos++] = idx;
+
+        for (idx = 0; idx < num_lms; ++idx)
+            reduced_sa[idx] = names[reduced_sa[idx]];
+
+        for (idx = num_lms; idx < size; ++idx)
+            sa[idx] = -1;
+
+        // Sorted LMS suffixes at the end of their buckets induce every other suffix
+        get_buckets(counts, text->alphabet, buckets, true);
+        for (idx = num_lms; idx-- > 0; ) {
+            pos = sa[idx];
+            sa[idx] = -1;
+            sa[--buckets[symbol_at(text, pos)]] = pos;
+        }
+
+        induce(text, types, sa, counts, buckets);
+    }
+
+    free(types);
+    free(counts);
+    free(buckets);
+
+    return error;
+}
+
+
+_modules_error bwt_encode(const uint8_t * const input, uint8_t * const output, const unsigned long size, unsigned long * const primary)
+{
+    _modules_error error;
+    uint8_t order[NUM_SYMBOLS], symbol, prev, next;
+    unsigned long out = 0;
+    int32_t * sa;
+    int rank;
+
+    *primary = 0;
+
+    if (!size)
+        return _SUCCESS;
+
+    if (size >= INT32_MAX)
+        return _LACK_OF_MEMORY;
+
+    sa = bufpool_alloc((size + 1) * sizeof(int32_t));
+    if (!sa)
+        return _LACK_OF_MEMORY;
+
+    error = sais(&(Text) {.bytes = input, .size = size + 1, .alphabet = NUM_SYMBOLS + 1}, sa);
+
+    // Each row's symbol is the one before its suffix (The first row is the suffix of the ending symbol alone, after the block's last one)
+    for (unsigned long row = 0; !error && row <= size; ++row) {
+        if (sa[row])
+            output[out++] = input[sa[row] - 1];
+        else
+            *primary = row;
+    }
+
+    bufpool_free(sa);
+
+    if (error)
+        return error;
+
+    for (int idx = 0; idx < NUM_SYMBOLS; ++idx)
+        order[idx] = idx;
+
+    // Each symbol is moved to the front while it's looked for (Ranks are mostly small so the list is barely walked)
+    for (unsigned long idx = 0; idx < size; ++idx) {
+        symbol = output[idx];
+        prev = order[0];
+
+        for (rank = 0; prev != symbol; prev = next) {
+            next = order[++rank];
+            order[rank] = prev;
+        }
+
+        order[0] = symbol;
+        output[idx] = rank + 1;
+    }
+
+    return _SUCCESS;
+}
+
+
+_modules_error bwt_decode(uint8_t * const block, const unsigned long size, const unsigned long primary)
+{
+    uint8_t order[NUM_SYMBOLS], symbol;
+    unsigned long next[NUM_SYMBOLS] = {0}, row, start = 1; // The first row is the ending symbol's (Smaller than any other)
+    uint32_t * packed;
+    uint64_t * links;
+    uint8_t rank;
+
+    if (!size)
+        return _SUCCESS;
+
+    if (!primary || primary > size)
+        return _FILE_UNRECOGNIZABLE;
+
+    for (int idx = 0; idx < NUM_SYMBOLS; ++idx)
+        order[idx] = idx;
+
+    for (unsigned long idx = 0; idx < size; ++idx) {
+        rank = block[idx] - 1;
+        symbol = order[rank];
+
+        for ( ; rank; --rank)
+            order[rank] = order[rank - 1];
+        order[0] = symbol;
+        block[idx] = symbol;
+        ++next[symbol];
+    }
+
+    // Where each symbol's rows start (Sorted by their suffix, i.e. the first column)
+    for (int idx = 0; idx < NUM_SYMBOLS; ++idx) {
+        row = next[idx];
+        next[idx] = start;
+        start += row;
+    }
+
+    /*
+        Each row of the first column keeps its symbol and the row of the next suffix so the block comes out in order with a single
+        random access per symbol (Packed in 32 bits while the rows fit in 24 of them, like bzip2's)
+    */
+    if (size < PACKED_MAX_ROWS) {
+        packed = bufpool_alloc((size + 1) * sizeof(uint32_t));
+        if (!packed)
+            return _LACK_OF_MEMORY;
+
+        packed[0] = 0;
+        for (row = 0; row <= size; ++row)
+            if (row != primary) {
+                symbol = block[row < primary ? row : row - 1];
+                packed[next[symbol]++] = row << 8 | symbol;
+            }
+
+        // The primary row's suffix is the whole block
+        for (unsigned long idx = 0, link = packed[primary]; idx < size; link = packed[link >> 8])
+            block[idx++] = link;
+
+        bufpool_free(packed);
+    }
+    else {
+        links = bufpool_alloc((size + 1) * sizeof(uint64_t));
+        if (!links)
+            return _LACK_OF_MEMORY;
+
+        links[0] = 0;
+        for (row = 0; row <= size; ++row)
+            if (row != primary) {
+                symbol = block[row < primary ? row : row - 1];
+                links[next[symbol]++] = (uint64_t) row << 8 | symbol;
+            }
+
+        for (unsigned long idx = 0; idx < size; ) {
+            row = idx ? row : primary;
+            block[idx++] = links[row];
+            row = links[row] >> 8;
+        }
+
+        bufpool_free(links);
+    }
+
+    return _SUCCESS;
+}
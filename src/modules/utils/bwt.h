@@ -0,0 +1,37 @@
+#ifndef UTILS_BWT_H
+#define UTILS_BWT_H
+
+#include <stdint.h>
+
+#include "errors.h"
+
+/*
+    Burrows-Wheeler transform followed by move-to-front, applied by module F to each block before RLE (opt-in, see header.h's 'b' tag).
+    The block's suffixes are sorted as if it ended with a unique symbol smaller than any byte (SA-IS, linear time), each symbol is
+    replaced by the one before its suffix and the row of the whole block (whose symbol would be the missing one) is left out and
+    recorded as the primary index (1 to the block's size). Move-to-front then writes each symbol's rank plus one (mod 256) so the
+    frequent rank 0 isn't the NUL RLE escapes with.
+*/
+
+
+/**
+\brief Transforms a block with Burrows-Wheeler and move-to-front
+ @param input Block's content
+ @param output Where to write the transformed block (Same size)
+ @param size Block's size (Less than 2^31)
+ @param primary Where to save the primary index (Needed to undo it)
+ @returns Error status
+*/
+_modules_error bwt_encode(const uint8_t * input, uint8_t * output, unsigned long size, unsigned long * primary);
+
+
+/**
+\brief Undoes bwt_encode in place
+ @param block Transformed block (Replaced by the original one)
+ @param size Block's size
+ @param primary Primary index
+ @returns Error status (_FILE_UNRECOGNIZABLE if the primary index can't be the block's)
+*/
+_modules_error bwt_decode(uint8_t * block, unsigned long size, unsigned long primary);
+
+#endif //UTILS_BWT_H
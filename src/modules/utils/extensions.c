@@ -16,13 +16,14 @@
 // If used strrchr the worst case would be a long path without a '.' because it would compare every letter
 bool check_ext(const char * const path, const char * const ext)
 {
-    size_t diff;
+    size_t len_path, len_ext;
 
     if (path) {
-        diff = strlen(path) - strlen(ext);
+        len_path = strlen(path);
+        len_ext = strlen(ext);
 
-        if (diff >= 0)
-            return (!strcmp(path + diff, ext));
+        if (len_path >= len_ext)
+            return (!strcmp(path + len_path - len_ext, ext));
     }
 
     return false;
@@ -8,6 +8,7 @@
 #define FREQ_EXT ".freq"
 #define CODES_EXT ".cod"
 #define SHAFA_EXT ".shaf"
+#define ARCHIVE_EXT ".sfa"
 
 
 /**
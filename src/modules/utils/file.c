@@ -1,5 +1,24 @@
+#define _GNU_SOURCE // SEEK_DATA
+
 #include <stdio.h>
+#include <errno.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define make_dir(path) _mkdir(path)
+#else
+#define make_dir(path) mkdir(path, 0777)
+#endif
+
+#include "file.h"
+#include "errors.h"
+#include "extensions.h"
 
 /*
 Function fsize() to get the size of files and the number of blocks contained
@@ -115,3 +134,139 @@ long long fsize(FILE *fp_in, char *filename, unsigned long *the_block_size, long
 
     return(n_blocks);
 }
+
+
+long long file_size(const char * const path)
+{
+    struct stat info;
+
+    if (stat(path, &info))
+        return -1;
+
+    return info.st_size;
+}
+
+
+bool file_is_sparse(FILE * const fd)
+{
+#if defined(SEEK_DATA) && !defined(_WIN32)
+    struct stat info;
+
+    return !fstat(fileno(fd), &info) && (long long) info.st_blocks * 512 < (long long) info.st_size;
+#else
+    (void) fd;
+    return false;
+#endif
+}
+
+
+bool block_is_hole(FILE * const fd, const long long offset, const unsigned long size)
+{
+    bool hole = false;
+#if defined(SEEK_DATA) && !defined(_WIN32)
+    const off_t position = lseek(fileno(fd), 0, SEEK_CUR);
+    off_t data = lseek(fileno(fd), offset, SEEK_DATA);
+
+    hole = data < 0 ? errno == ENXIO : data >= offset + (long long) size;
+
+    // The descriptor is moved behind stdio's back so it's put back where stdio left it
+    if (position < 0 || lseek(fileno(fd), position, SEEK_SET) < 0)
+        hole = false;
+#else
+    (void) fd; (void) offset; (void) size;
+#endif
+    return hole;
+}
+
+
+_modules_error list_files(const char * const dir, char *** const files, size_t * const num_files)
+{
+    _modules_error error = _SUCCESS;
+    struct dirent * entry;
+    struct stat info;
+    size_t len_dir = strlen(dir);
+    char * path, ** tmp_files;
+    DIR * handle;
+
+    handle = opendir(dir);
+    if (!handle)
+        return _FILE_INACCESSIBLE;
+
+    while (!error && (entry = readdir(handle))) {
+
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+
+        path = malloc(len_dir + 1 + strlen(entry->d_name) + 1);
+        if (!path) {
+            error = _LACK_OF_MEMORY;
+            break;
+        }
+
+        // Avoids a double separator when the user's path already ends with one
+        if (len_dir && (dir[len_dir - 1] == '/' || dir[len_dir - 1] == '\\'))
+            sprintf(path, "%s%s", dir, entry->d_name);
+        else
+            sprintf(path, "%s/%s", dir, entry->d_name);
+
+        if (stat(path, &info)) {
+            free(path);
+            continue; // Vanished or inaccessible entries are just skipped
+        }
+
+        if (S_ISDIR(info.st_mode)) {
+            error = list_files(path, files, num_files);
+            free(path);
+        }
+        else if (S_ISREG(info.st_mode) && !check_ext(path, FREQ_EXT) && !check_ext(path, CODES_EXT)) {
+
+            tmp_files = realloc(*files, (*num_files + 1) * sizeof(char *));
+            if (tmp_files) {
+                *files = tmp_files;
+                (*files)[(*num_files)++] = path;
+            }
+            else {
+                free(path);
+                error = _LACK_OF_MEMORY;
+            }
+        }
+        else
+            free(path);
+    }
+
+    closedir(handle);
+
+    return error;
+}
+
+
+_modules_error make_parent_dirs(const char * const path)
+{
+    _modules_error error = _SUCCESS;
+    struct stat info;
+    char * dir, separator;
+
+    dir = add_ext(path, "");
+    if (!dir)
+        return _LACK_OF_MEMORY;
+
+    // First character is skipped so a root's separator isn't seen as an empty directory
+    for (char * c = dir + 1; *c && !error; ++c) {
+
+        if (*c != '/' && *c != '\\')
+            continue;
+
+        separator = *c;
+        *c = '\0';
+
+        // Only fails if it doesn't exist after trying (Someone else may have just created it)
+        if (make_dir(dir) && (stat(dir, &info) || !S_ISDIR(info.st_mode)))
+            error = _FILE_INACCESSIBLE;
+
+        *c = separator;
+    }
+
+    free(dir);
+
+    return error;
+}
@@ -2,6 +2,10 @@
 #define UTILS_FILE_H
 
 #include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "errors.h"
 
 enum {
     _1KiB   = 1024,
@@ -11,6 +15,9 @@ enum {
     _64MiB  = 67108864
 };
 
+#define MIN_BLOCK_SIZE 512      // Smallest block size accepted by fsize
+#define MAX_BLOCK_SIZE _64MiB   // Biggest block size accepted by fsize
+
 
 /**
 \brief Calculate the whole file size per block. O.S. Independent
@@ -21,4 +28,49 @@ enum {
 */
 long long fsize(FILE *fp_in, char *filename, unsigned long *the_block_size, long *size_of_last_block);
 
+
+/**
+\brief Checks if a file has less space allocated than its size (Always false where holes can't be found)
+ @param fd File Descriptor
+ @returns Whether the file has holes
+*/
+bool file_is_sparse(FILE * fd);
+
+
+/**
+\brief Checks if a block of a file is entirely inside a hole (A block which was never written reads as zeros)
+        without changing the stream's position
+ @param fd File Descriptor
+ @param offset Block's position in the file
+ @param size Block's size
+ @returns Whether the block holds no data
+*/
+bool block_is_hole(FILE * fd, long long offset, unsigned long size);
+
+
+/**
+\brief Appends every regular file inside a directory (recursively) to a list, skipping Shafa's metadata files (.freq and .cod)
+ @param dir Directory's path
+ @param files Pointer to an array of allocated paths (grown with realloc)
+ @param num_files Pointer to the number of paths in the array
+ @returns Error status
+*/
+_modules_error list_files(const char * dir, char *** files, size_t * num_files);
+
+
+/**
+\brief Size of a file without opening it
+ @param path File's path
+ @returns Size in bytes or -1 if it can't be accessed
+*/
+long long file_size(const char * path);
+
+
+/**
+\brief Creates every missing directory of a path (The last component is considered a file)
+ @param path File's path
+ @returns Error status
+*/
+_modules_error make_parent_dirs(const char * path);
+
 #endif //UTILS_FILE_H
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "header.h"
+#include "errors.h"
+#include "bufpool.h"
+
+#define BLOCK_CONTENT_MIN_SIZE 33152 // Any block of a file without contexts fits
+
+
+_modules_error write_file_header(FILE * const fd, const FileHeader * const header)
+{
+    if (fprintf(fd, "@%c%s%s%s@%llu", header->mode, header->rle_v2 ? "v" : "", header->ans ? "n" : "", header->order1 ? "c" : "", header->num_blocks) < 4)
+        return _FILE_STREAM_FAILED;
+
+    return _SUCCESS;
+}
+
+
+_modules_error read_file_header(FILE * const fd, FileHeader * const header)
+{
+    int flag;
+
+    *header = (FileHeader) {0};
+
+    if (fscanf(fd, "@%c", &header->mode) != 1)
+        return _FILE_STREAM_FAILED;
+
+    while ((flag = getc(fd)) != '@') {
+        switch (flag) {
+            case 'v':
+                header->rle_v2 = true;
+                break;
+            case 'n':
+                header->ans = true;
+                break;
+            case 'c':
+                header->order1 = true;
+                break;
+            case EOF:
+                return _FILE_STREAM_FAILED;
+            default:
+                return _FILE_UNRECOGNIZABLE;
+        }
+    }
+
+    if (fscanf(fd, "%llu", &header->num_blocks) != 1)
+        return _FILE_STREAM_FAILED;
+
+    return _SUCCESS;
+}
+
+
+_modules_error read_block_content(FILE * const fd, char ** const content)
+{
+    size_t size = 0, capacity = BLOCK_CONTENT_MIN_SIZE;
+    char * buffer = bufpool_alloc(capacity), * grown;
+    int c;
+
+    if (!buffer)
+        return _LACK_OF_MEMORY;
+
+    while ((c = getc(fd)) != '@' && c != EOF) {
+        // Room for the NULL terminator too
+        if (size + 1 == capacity) {
+            grown = bufpool_realloc(buffer, capacity *= 2);
+            if (!grown) {
+                bufpool_free(buffer);
+                return _LACK_OF_MEMORY;
+            }
+            buffer = grown;
+        }
+
+        buffer[size++] = c;
+    }
+
+    // Every block is followed by another header (Or the end of the file's "@0")
+    if (c == EOF || !size || ungetc(c, fd) == EOF) {
+        bufpool_free(buffer);
+        return _FILE_STREAM_FAILED;
+    }
+
+    buffer[size] = '\0';
+    *content = buffer;
+
+    return _SUCCESS;
+}
+
+
+unsigned long format_block_header(char * const buffer, const BlockHeader * const header)
+{
+    int size = sprintf(buffer, "@%lu%s", header->size, header->rle ? "r" : "");
+
+    if (header->original_size)
+        size += sprintf(buffer + size, "o%lu", header->original_size);
+    if (header->bwt_index)
+        size += sprintf(buffer + size, "b%lu", header->bwt_index);
+    if (header->restart_interval)
+        size += sprintf(buffer + size, "k%lu", header->restart_interval);
+
+    for (unsigned long i = 0; i < header->num_restarts; ++i)
+        size += sprintf(buffer + size, ":%llu", header->restarts[i]);
+
+    size += sprintf(buffer + size, "%s%s@", header->stored ? "s" : "", header->hole ? "z" : "");
+
+    return size;
+}
+
+
+_modules_error write_block_header(FILE * const fd, const BlockHeader * const header)
+{
+    char small[BLOCK_HEADER_MAX_SIZE(0)], * buffer = small;
+    unsigned long size;
+    _modules_error error = _SUCCESS;
+
+    // Only restart points make it bigger than a few tags
+    if (header->num_restarts) {
+        buffer = malloc(BLOCK_HEADER_MAX_SIZE(header->num_restarts));
+        if (!buffer)
+            return _LACK_OF_MEMORY;
+    }
+
+    size = format_block_header(buffer, header);
+    if (fwrite(buffer, 1, size, fd) != size)
+        error = _FILE_STREAM_FAILED;
+
+    if (buffer != small)
+        free(buffer);
+
+    return error;
+}
+
+
+/**
+\brief Reads the bits of a block's restart points (Each one after a ':')
+ @param fd File's stream (Right after the restart points' interval)
+ @param header Block's header where they're saved
+ @returns Error status
+*/
+static _modules_error read_restarts(FILE * const fd, BlockHeader * const header)
+{
+    unsigned long capacity = 0;
+    unsigned long long * restarts;
+    int separator;
+
+    while ((separator = getc(fd)) == ':') {
+        if (header->num_restarts == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            restarts = realloc(header->restarts, capacity * sizeof(unsigned long long));
+            if (!restarts)
+                return _LACK_OF_MEMORY;
+            header->restarts = restarts;
+        }
+
+        if (fscanf(fd, "%llu", &header->restarts[header->num_restarts++]) != 1)
+            return _FILE_UNRECOGNIZABLE;
+    }
+
+    if (separator == EOF || ungetc(separator, fd) == EOF)
+        return _FILE_STREAM_FAILED;
+
+    return _SUCCESS;
+}
+
+
+_modules_error read_block_header(FILE * const fd, BlockHeader * const header)
+{
+    _modules_error error = _SUCCESS;
+    int tag;
+
+    *header = (BlockHeader) {0};
+
+    if (fscanf(fd, "@%lu", &header->size) != 1)
+        return _FILE_STREAM_FAILED;
+
+    // Can't be done with fscanf's %[...] since it fails (without consuming the '@') when there are no tags
+    while (!error && (tag = getc(fd)) != '@') {
+        switch (tag) {
+            case 'r':
+                header->rle = true;
+                break;
+            case 'o':
+                if (fscanf(fd, "%lu", &header->original_size) != 1 || !header->original_size)
+                    error = _FILE_UNRECOGNIZABLE;
+                break;
+            case 'b':
+                if (fscanf(fd, "%lu", &header->bwt_index) != 1 || !header->bwt_index)
+                    error = _FILE_UNRECOGNIZABLE;
+                break;
+            case 'k':
+                if (fscanf(fd, "%lu", &header->restart_interval) != 1 || !header->restart_interval || header->restarts)
+                    error = _FILE_UNRECOGNIZABLE;
+                else
+                    error = read_restarts(fd, header);
+                break;
+            case 's':
+                header->stored = true;
+                break;
+            case 'z':
+                header->hole = true;
+                break;
+            case EOF:
+                error = _FILE_STREAM_FAILED;
+                break;
+            default:
+                error = _FILE_UNRECOGNIZABLE;
+        }
+    }
+
+    if (error) {
+        free(header->restarts);
+        header->restarts = NULL;
+    }
+
+    return error;
+}
+
+
+_modules_error write_block_table(FILE * const fd, const unsigned long long * const offsets, const unsigned long long num_blocks)
+{
+    const long table_offset = ftell(fd);
+
+    if (table_offset < 0)
+        return _FILE_STREAM_FAILED;
+
+    for (unsigned long long i = 0; i < num_blocks; ++i)
+        if (fprintf(fd, "@%llu", offsets[i]) < 2)
+            return _FILE_STREAM_FAILED;
+
+    if (fprintf(fd, "@%020llu", (unsigned long long) table_offset) != BLOCK_TABLE_TRAILER_SIZE)
+        return _FILE_STREAM_FAILED;
+
+    return _SUCCESS;
+}
+
+
+_modules_error read_block_table(FILE * const fd, const unsigned long long num_blocks, unsigned long long ** const offsets)
+{
+    unsigned long long table_offset, previous = 0;
+    char trailer[BLOCK_TABLE_TRAILER_SIZE + 1];
+    long table_end;
+    int digits;
+
+    *offsets = NULL;
+
+    // Anything else than a complete table means the file was written before it existed
+    if (!num_blocks || fseek(fd, -BLOCK_TABLE_TRAILER_SIZE, SEEK_END) || (table_end = ftell(fd)) < 0
+        || fread(trailer, sizeof(char), BLOCK_TABLE_TRAILER_SIZE, fd) != BLOCK_TABLE_TRAILER_SIZE)
+        return _SUCCESS;
+
+    trailer[BLOCK_TABLE_TRAILER_SIZE] = '\0';
+    if (sscanf(trailer, "@%20llu%n", &table_offset, &digits) != 1 || digits != BLOCK_TABLE_TRAILER_SIZE
+        || table_offset >= (unsigned long long) table_end || fseek(fd, table_offset, SEEK_SET))
+        return _SUCCESS;
+
+    *offsets = malloc(num_blocks * sizeof(unsigned long long));
+    if (!*offsets)
+        return _LACK_OF_MEMORY;
+
+    // Blocks come one after the other and before the table
+    for (unsigned long long i = 0; i < num_blocks; ++i) {
+        if (fscanf(fd, "@%llu", &(*offsets)[i]) != 1 || (i && (*offsets)[i] <= previous) || (*offsets)[i] >= table_offset) {
+            free(*offsets);
+            *offsets = NULL;
+            return _SUCCESS;
+        }
+        previous = (*offsets)[i];
+    }
+
+    if (ftell(fd) != table_end) {
+        free(*offsets);
+        *offsets = NULL;
+    }
+
+    return _SUCCESS;
+}
@@ -0,0 +1,140 @@
+#ifndef UTILS_HEADER_H
+#define UTILS_HEADER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "errors.h"
+
+/*
+    Header at the start of .freq and .cod files: @<mode>[flags]@<number of blocks>
+
+    Modes: N -> Original file | R -> Every block compressed with RLE | A -> RLE chosen per block
+    Flags are letters right after the mode (Files written before flags existed have none):
+        v -> RLE's version 2: runs' lengths as varints and isolated NULs as {0}{0} (Version 1 limits runs to 255 and writes any NUL as {0}{0}{1})
+        n -> rANS (Only in .cod files): each block has its symbols' normalized frequencies instead of codes and is coded with rANS (See rans.h)
+        c -> Order-1 contexts: each block starts with the frequencies (.freq) or codes (.cod) of every context (previous symbol) which has its own,
+             (<context>:<frequencies or codes>|)*, followed by the block's own ones as usual (Used by the contexts without their own)
+*/
+typedef struct {
+    char mode;
+    bool rle_v2;
+    bool ans;
+    bool order1;
+    unsigned long long num_blocks;
+} FileHeader;
+
+
+/*
+    Header written before each block of .freq, .cod and .shaf files: @<size>[tags]@
+
+    Tags are letters right after the size describing how the block was written.
+    Files written before tags existed have none so they are read as they always were.
+        r -> RLE: the block was compressed with RLE (Only in files whose mode is 'A' since in mode 'R' every block is)
+        o<size> -> Original size: size of a RLE block once decompressed
+        b<index> -> Burrows-Wheeler: the block was transformed with Burrows-Wheeler and move-to-front before RLE (opt-in, see bwt.h)
+                    and <index> is the primary index which undoes it once RLE is decompressed
+        k<interval>(:<bit>)* -> Restart points (Only in .shaf files, opt-in): every <interval> symbols the bit where the next symbol's code starts
+                                (Symbols interval, 2 * interval, ... of the block) so module D decodes its segments on different threads
+        s -> Stored: the block holds module C's input as it is (Shannon-Fano wouldn't save enough)
+        z -> Hole: the original block is a hole of a sparse file (Its size is 0 and its original size is the hole's)
+*/
+typedef struct {
+    unsigned long size;
+    unsigned long original_size; // 0 -> Unknown
+    unsigned long bwt_index; // 0 -> Not transformed with Burrows-Wheeler
+    unsigned long restart_interval; // 0 -> No restart points
+    unsigned long num_restarts;
+    unsigned long long * restarts; // Allocated by read_block_header (The caller's to be freed)
+    bool rle;
+    bool stored;
+    bool hole;
+} BlockHeader;
+
+
+/*
+    Table at the end of .shaf files (After the last block): (@<block_offset>)*@<table_offset>
+
+    Blocks' offsets point to each block's header so a block can be read without the previous ones.
+    The table's offset is zero padded to BLOCK_TABLE_TRAILER_SIZE so it's found from the end of the file.
+    Files written before the table existed don't have it and are read block after block.
+*/
+#define BLOCK_TABLE_TRAILER_SIZE 21 // '@' + 20 digits
+
+#define BLOCK_HEADER_MAX_SIZE(num_restarts) (96 + (num_restarts) * 21) // Every tag with 20 digits (And ':' + 20 digits per restart point)
+
+
+/**
+\brief Writes a .freq or .cod file's header
+ @param fd File's stream
+ @param header File's header
+ @returns Error status
+*/
+_modules_error write_file_header(FILE * fd, const FileHeader * header);
+
+
+/**
+\brief Reads a .freq or .cod file's header (The stream is left at the first block's header)
+ @param fd File's stream
+ @param header Where to save the file's header
+ @returns Error status
+*/
+_modules_error read_file_header(FILE * fd, FileHeader * header);
+
+
+/**
+\brief Reads the content of a block of a .freq or .cod file, however long it is (Up to the next header, which is left in the stream)
+ @param fd File's stream (Right after the block's header)
+ @param content Where to save the content (It's the caller's to be freed with bufpool_free)
+ @returns Error status
+*/
+_modules_error read_block_content(FILE * fd, char ** content);
+
+
+/**
+\brief Writes a block's header into a buffer (Without the ending NUL)
+ @param buffer Where to write it (At least BLOCK_HEADER_MAX_SIZE bytes for the header's restart points)
+ @param header Block's header
+ @returns Header's size
+*/
+unsigned long format_block_header(char * buffer, const BlockHeader * header);
+
+
+/**
+\brief Writes a block's header
+ @param fd File's stream
+ @param header Block's header
+ @returns Error status
+*/
+_modules_error write_block_header(FILE * fd, const BlockHeader * header);
+
+
+/**
+\brief Reads a block's header (The stream is left at the block's first byte and restart points are allocated, NULL if there are none)
+ @param fd File's stream
+ @param header Where to save the block's header
+ @returns Error status
+*/
+_modules_error read_block_header(FILE * fd, BlockHeader * header);
+
+
+/**
+\brief Writes the table of blocks' offsets at the end of a .shaf file (The stream must be after the last block)
+ @param fd File's stream
+ @param offsets Offset of each block's header
+ @param num_blocks Number of blocks
+ @returns Error status
+*/
+_modules_error write_block_table(FILE * fd, const unsigned long long * offsets, unsigned long long num_blocks);
+
+
+/**
+\brief Reads the table of blocks' offsets at the end of a .shaf file (The stream's position is lost)
+ @param fd File's stream
+ @param num_blocks Number of blocks
+ @param offsets Where to save the allocated offsets (NULL if the file doesn't have the table)
+ @returns Error status (_SUCCESS without the table too)
+*/
+_modules_error read_block_table(FILE * fd, unsigned long long num_blocks, unsigned long long ** offsets);
+
+#endif //UTILS_HEADER_H
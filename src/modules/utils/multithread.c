@@ -12,6 +12,7 @@
 #include <stdbool.h>
 
 
+#include "trace.h"
 #include "errors.h"
 #include "multithread.h"
 
@@ -22,9 +23,29 @@ bool NO_MULTITHREAD = false;
     #ifdef POSIX_THREADS
     #include <pthread.h>
 
+    typedef pthread_t Thread;
+    typedef pthread_mutex_t Mutex;
+    typedef pthread_cond_t Cond;
+
+    #define mutex_lock(mutex) pthread_mutex_lock(mutex)
+    #define mutex_unlock(mutex) pthread_mutex_unlock(mutex)
+    #define cond_wait(cond, mutex) pthread_cond_wait(cond, mutex)
+    #define cond_signal(cond) pthread_cond_signal(cond)
+    #define cond_broadcast(cond) pthread_cond_broadcast(cond)
+
     #elif defined(WIN_THREADS)
     #include <windows.h>
 
+    typedef HANDLE Thread;
+    typedef CRITICAL_SECTION Mutex;
+    typedef CONDITION_VARIABLE Cond;
+
+    #define mutex_lock(mutex) EnterCriticalSection(mutex)
+    #define mutex_unlock(mutex) LeaveCriticalSection(mutex)
+    #define cond_wait(cond, mutex) SleepConditionVariableCS(cond, mutex, INFINITE)
+    #define cond_signal(cond) WakeConditionVariable(cond)
+    #define cond_broadcast(cond) WakeAllConditionVariable(cond)
+
     #endif
 
 #else
@@ -32,96 +53,221 @@ bool NO_MULTITHREAD = true;
 
 #endif
 
+#define MAX_PENDING_PER_WORKER 4 // Blocks each chain may have in memory per worker before multithread_create blocks
+
+
 /*
-    Stack functions, arguments for both functions and lastly the previous thread ID into a struct
+    Every thread which calls multithread_create owns a chain: its `write`'s functions run
+    sequentially in the order they were created even though every chain shares the same workers.
+
+    Chains live in the creator's thread local storage which is why `multithread[_create | _wait]`
+    must be called by the same thread and it must call multithread_wait before exiting.
 */
-#ifdef THREADS
 typedef struct {
-
-#ifdef POSIX_THREADS
-    pthread_t prev_thread;
-    uintptr_t (* process)(void *);
-    uintptr_t (* write)(void *, _modules_error, _modules_error);
-#elif defined(WIN_THREADS)
-    HANDLE prev_hthread;
-    DWORD (* process)(void *);
-    DWORD (* write)(void *, _modules_error, _modules_error);
+#ifdef THREADS
+    Cond cond;                       // Signaled whenever `turn` or `pending` changes
+    bool initialized;
 #endif
+    unsigned long long next_ticket;  // Ticket of the next created task
+    unsigned long long turn;         // Ticket of the next task allowed to write
+    unsigned long pending;           // Tasks created but not written yet
+    _modules_error error;            // First error of the chain
+    double busy_time;                // Time spent by `process`'s functions
+} Chain;
+
+static _Thread_local Chain CHAIN;
 
+
+#ifdef THREADS
+/*
+    Stack functions, arguments for both functions and lastly its place in the chain into a struct
+*/
+typedef struct Task {
+    _modules_error (* process)(void *);
+    _modules_error (* write)(void *, _modules_error, _modules_error);
     void * args;
-} Data;
-#endif //THREADS
+    Chain * chain;
+    unsigned long long ticket;
+    struct Task * next;
+} Task;
+
+/*
+    Shared workers. Everything is protected by `lock` (including every chain's counters)
+*/
+static struct {
+    Mutex lock;
+    Mutex output_lock;
+    Cond not_empty;
+    Task * head;
+    Task ** tail;
+    Thread * workers;
+    int num_workers;
+    bool started;
+    bool stop;
+} POOL;
+
 
-// This static global variable is only accessed by the main thread
-// `multithread[_create | _wait]`'s functions are Thread-Unsafe because of it. For Thread-Safety it requires a reentrant version
-// For further examples check: `strtok` and `strtok_r` respectively defined in C standard and Posix only
-// Why? Use same multithread[_create | _wait]'s function assignature for Windows and Posix
 #ifdef POSIX_THREADS
-static pthread_t THREAD = 0;
+static pthread_once_t POOL_ONCE = PTHREAD_ONCE_INIT;
+
+static void pool_init(void)
+{
+    pthread_mutex_init(&POOL.lock, NULL);
+    pthread_mutex_init(&POOL.output_lock, NULL);
+    pthread_cond_init(&POOL.not_empty, NULL);
+    POOL.tail = &POOL.head;
+}
+
+#define POOL_INIT() pthread_once(&POOL_ONCE, pool_init)
+
 #elif defined(WIN_THREADS)
-static HANDLE HTHREAD = 0;
+static INIT_ONCE POOL_ONCE = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK pool_init(PINIT_ONCE once, PVOID parameter, PVOID * context)
+{
+    InitializeCriticalSection(&POOL.lock);
+    InitializeCriticalSection(&POOL.output_lock);
+    InitializeConditionVariable(&POOL.not_empty);
+    POOL.tail = &POOL.head;
+    return TRUE;
+}
+
+#define POOL_INIT() InitOnceExecuteOnce(&POOL_ONCE, pool_init, NULL, NULL)
+
 #endif
 
+
 /**
-\brief Calls both functions and waits last thread closing the handle
- @returns Error status (Hack as a pointer)
+\brief Runs tasks until multithread_shutdown. Tasks' `write`'s functions wait for their turn in their chain
+ @returns Always _SUCCESS (Errors are kept in each chain)
 */
 #ifdef POSIX_THREADS
-static uintptr_t wrapper(Data * data)
+static void * worker(void * _unused)
+#elif defined(WIN_THREADS)
+static DWORD WINAPI worker(LPVOID _unused)
+#endif
 {
-    pthread_t prev_thread;
-    uintptr_t error, prev_error = _SUCCESS; // Define as _SUCCESS in case there is no prev_hthread
+    Task * task;
+    Chain * chain;
+    _modules_error error, prev_error;
+    double busy_time, span;
 
-    error = (*(data->process))(data->args);
-    prev_thread = data->prev_thread;
+    (void) _unused;
 
-    // In case of error in `data->process` it still joins the thread for resource cleanup
-    if (prev_thread && pthread_join(prev_thread, (void **) &prev_error))
-        prev_error = _THREAD_TERMINATION_FAILED;
+    mutex_lock(&POOL.lock);
 
-    error = (*(data->write))(data->args, prev_error, error);
-    
-    free(data);
+    for (;;) {
 
-    return prev_error ? prev_error : error;
-}
-#elif defined(WIN_THREADS)
-static DWORD WINAPI wrapper(LPVOID _data)
-{
-    Data * data = (Data *) _data;
-    HANDLE prev_hthread;
-    DWORD error, prev_error = _SUCCESS; // Define as _SUCCESS in case there is no prev_hthread
-
-    error = (*(data->process))(data->args);
-    prev_hthread = data->prev_hthread;
-
-    if (prev_hthread) { // In case of error in `data->process` it still joins the thread for resource cleanup
-        if (WaitForSingleObject(prev_hthread, INFINITE) != WAIT_OBJECT_0 || !GetExitCodeThread(prev_hthread, &prev_error))
-            prev_error = _THREAD_TERMINATION_FAILED;
-        
-        CloseHandle(prev_hthread);
+        while (!POOL.head && !POOL.stop)
+            cond_wait(&POOL.not_empty, &POOL.lock);
+
+        if (!POOL.head) // Stopped
+            break;
+
+        task = POOL.head;
+        POOL.head = task->next;
+        if (!POOL.head)
+            POOL.tail = &POOL.head;
+
+        mutex_unlock(&POOL.lock);
+
+        busy_time = clock_wall_ms();
+        error = task->process(task->args);
+        busy_time = clock_wall_ms() - busy_time;
+
+        mutex_lock(&POOL.lock);
+
+        chain = task->chain;
+        chain->busy_time += busy_time;
+
+        // Tasks without `write` don't take a turn in the chain so they never wait for the previous ones
+        if (task->write) {
+
+            // The task with the chain's turn was queued before this one, so some worker already has it
+            span = TRACE_BEGIN();
+            while (chain->turn != task->ticket)
+                cond_wait(&chain->cond, &POOL.lock);
+            TRACE_END("wait on previous thread", span);
+
+            prev_error = chain->error;
+
+            mutex_unlock(&POOL.lock);
+
+            span = TRACE_BEGIN();
+            error = task->write(task->args, prev_error, error);
+            TRACE_END("write", span);
+
+            mutex_lock(&POOL.lock);
+
+            ++chain->turn;
+        }
+
+        if (!chain->error)
+            chain->error = error;
+        --chain->pending;
+        cond_broadcast(&chain->cond);
+
+        free(task);
     }
 
-    error = (*(data->write))(data->args, prev_error, error);
-    
-    HeapFree(GetProcessHeap(), 0, data);
+    mutex_unlock(&POOL.lock);
 
-    return prev_error ? prev_error : error;
+    return 0;
 }
+
+
+/**
+\brief Creates the workers. Must be called with POOL.lock held
+ @returns Error status
+*/
+static _modules_error pool_start(void)
+{
+    int num_workers = multithread_num_cores();
+
+    POOL.workers = malloc(num_workers * sizeof(Thread));
+
+    if (!POOL.workers)
+        return _LACK_OF_MEMORY;
+
+    for (int i = 0; i < num_workers; ++i) {
+
+#ifdef POSIX_THREADS
+        if (pthread_create(&POOL.workers[POOL.num_workers], NULL, worker, NULL))
+            break;
+#elif defined(WIN_THREADS)
+        POOL.workers[POOL.num_workers] = CreateThread(
+            NULL,                   // default security attributes
+            0,                      // use default stack size
+            worker,                 // thread function name
+            NULL,                   // argument to thread function
+            0,                      // use default creation flags
+            NULL                    // returns the thread identifier
+        );
+        if (!POOL.workers[POOL.num_workers])
+            break;
 #endif
 
+        ++POOL.num_workers;
+    }
 
+    // Can work with fewer workers but not without any
+    if (!POOL.num_workers) {
+        free(POOL.workers);
+        POOL.workers = NULL;
+        return _THREAD_CREATION_FAILED;
+    }
+
+    POOL.started = true;
+    return _SUCCESS;
+}
+#endif //THREADS
 
-/*
-                                      POSIX CAUTION
-       Attention: Be careful that sizeof(void *) must be >= sizeof(_modules_error) 
-    otherwise make sure the value returned by those funtions are always <= sizeof(void *)
 
-                                     WINDOWS CAUTION
-             Attention: Be careful that sizeof(DWORD) must be >= sizeof(int) 
-     otherwise make sure the value returned by those funtions are always <= sizeof(DWORD)
 
- Why? Because we use a hack to consider a pointer as an _modules_error to pass between threads
+/*
+    Attention: `process`'s functions run in any worker but `write`'s functions of the same chain
+    run one at a time in creation order, receiving the first error of the previous ones.
+    Tasks without `write` only count for multithread_wait (and its error) and the chain's backpressure.
 */
 _modules_error multithread_create(_modules_error (* process)(void *), _modules_error (* write)(void *, _modules_error, _modules_error), void * args)
 {
@@ -131,95 +277,240 @@ _modules_error multithread_create(_modules_error (* process)(void *), _modules_e
 #endif
     {
         _modules_error error;
+        double busy_time = clock_wall_ms(), span;
 
         error = process(args);
-        return write(args, _SUCCESS, error);
+        CHAIN.busy_time += clock_wall_ms() - busy_time;
+
+        if (write) {
+            span = TRACE_BEGIN();
+            error = write(args, CHAIN.error, error);
+            TRACE_END("write", span);
+        }
+
+        // Just like with workers: `args` belongs to `write` now and errors wait for multithread_wait
+        if (!CHAIN.error)
+            CHAIN.error = error;
+
+        return _SUCCESS;
     }
 
-    
 
-#ifdef POSIX_THREADS
 
-    Data * data = malloc(sizeof(Data));
-    
-    if (!data)
-        return _LACK_OF_MEMORY;
+#ifdef THREADS
 
-    * data = (Data) {
-        .prev_thread = THREAD,
-        .process = (uintptr_t (*) (void *)) process,
-        .write = (uintptr_t (*) (void *, _modules_error, _modules_error)) write,
-        .args = args,
-    };
-    
-    if (pthread_create(&THREAD, NULL, (void *) wrapper, data)) {
-        free(data);
-        return _THREAD_CREATION_FAILED;
-    }
+    _modules_error error = _SUCCESS;
+    Task * task;
+
+    POOL_INIT();
 
+    if (!CHAIN.initialized) {
+#ifdef POSIX_THREADS
+        pthread_cond_init(&CHAIN.cond, NULL);
 #elif defined(WIN_THREADS)
+        InitializeConditionVariable(&CHAIN.cond);
+#endif
+        CHAIN.initialized = true;
+    }
 
-    HANDLE handle;
-    Data * data = HeapAlloc(GetProcessHeap(), 0, sizeof(Data));
+    task = malloc(sizeof(Task));
 
-    if (!data)
+    if (!task)
         return _LACK_OF_MEMORY;
 
-    * data = (Data) {
-        .prev_hthread = HTHREAD,
-        .process = (DWORD (*) (void *)) process,
-        .write = (DWORD (*) (void *, _modules_error, _modules_error)) write,
-        .args = args
-    };
-    
-    handle = CreateThread( 
-        NULL,                   // default security attributes
-        0,                      // use default stack size  
-        wrapper,                // thread function name
-        data,                   // argument to thread function 
-        0,                      // use default creation flags 
-        NULL                    // returns the thread identifier 
-    );
-
-    if (handle)
-        HTHREAD = handle;
-    else {
-        HeapFree(GetProcessHeap(), 0, data);
-        return _THREAD_CREATION_FAILED;
+    mutex_lock(&POOL.lock);
+
+    if (!POOL.started)
+        error = pool_start();
+
+    if (!error) {
+
+        // Bounds the memory held by blocks which were read but not written yet
+        while (CHAIN.pending >= (unsigned long) POOL.num_workers * MAX_PENDING_PER_WORKER)
+            cond_wait(&CHAIN.cond, &POOL.lock);
+
+        * task = (Task) {
+            .process = process,
+            .write = write,
+            .args = args,
+            .chain = &CHAIN,
+            .ticket = write ? CHAIN.next_ticket++ : 0,
+            .next = NULL
+        };
+
+        ++CHAIN.pending;
+        *POOL.tail = task;
+        POOL.tail = &task->next;
+        cond_signal(&POOL.not_empty);
     }
 
-#endif
+    mutex_unlock(&POOL.lock);
 
-    return _SUCCESS;
+    if (error)
+        free(task);
+
+    return error;
+
+#endif
 }
 
 _modules_error multithread_wait()
 {
+    _modules_error error = _SUCCESS;
+
 #ifndef _NO_MULTITHREAD
     if (NO_MULTITHREAD)
 #endif
+    {
+        error = CHAIN.error;
+        CHAIN.error = _SUCCESS;
+        return error;
+    }
+
+
+#ifdef THREADS
+
+    if (CHAIN.initialized) {
+        mutex_lock(&POOL.lock);
+
+        while (CHAIN.pending)
+            cond_wait(&CHAIN.cond, &POOL.lock);
+
+        error = CHAIN.error;
+
+        mutex_unlock(&POOL.lock);
+    }
+
+    // Next chain starts from scratch
+    CHAIN.error = _SUCCESS;
+    CHAIN.turn = CHAIN.next_ticket = 0;
+
+    return error;
+
+#endif
+}
+
+
+#ifdef THREADS
+/*
+    Function and argument given to each thread created by multithread_spawn
+*/
+typedef struct {
+    void (* function)(void *);
+    void * args;
+} Spawn;
+
+#ifdef POSIX_THREADS
+static void * spawned(void * _spawn)
+#elif defined(WIN_THREADS)
+static DWORD WINAPI spawned(LPVOID _spawn)
+#endif
+{
+    Spawn * spawn = (Spawn *) _spawn;
+
+    spawn->function(spawn->args);
+
+    return 0;
+}
+#endif
+
+
+_modules_error multithread_spawn(int num_threads, void (* function)(void *), void * args)
+{
+#ifndef _NO_MULTITHREAD
+    if (NO_MULTITHREAD || num_threads <= 1)
+#endif
+    {
+        function(args);
         return _SUCCESS;
+    }
 
+#ifdef THREADS
 
+    _modules_error error = _SUCCESS;
+    Spawn spawn = {.function = function, .args = args};
+    Thread * threads = malloc(num_threads * sizeof(Thread));
+    int created = 0;
+
+    if (!threads)
+        return _LACK_OF_MEMORY;
+
+    for ( ; created < num_threads; ++created) {
+#ifdef POSIX_THREADS
+        if (pthread_create(&threads[created], NULL, spawned, &spawn))
+            break;
+#elif defined(WIN_THREADS)
+        threads[created] = CreateThread(NULL, 0, spawned, &spawn, 0, NULL);
+        if (!threads[created])
+            break;
+#endif
+    }
+
+    // Whatever wasn't given to a thread still has to run
+    if (!created)
+        function(args);
+
+    for (int i = 0; i < created; ++i) {
 #ifdef POSIX_THREADS
+        if (pthread_join(threads[i], NULL))
+            error = _THREAD_TERMINATION_FAILED;
+#elif defined(WIN_THREADS)
+        if (WaitForSingleObject(threads[i], INFINITE) != WAIT_OBJECT_0)
+            error = _THREAD_TERMINATION_FAILED;
+        CloseHandle(threads[i]);
+#endif
+    }
 
-    uintptr_t error;
+    free(threads);
 
-    if (pthread_join(THREAD, (void **) &error))
-        return _THREAD_TERMINATION_FAILED;
+    return error;
+
+#endif
+}
 
+
+void multithread_shutdown(void)
+{
+#ifdef THREADS
+    if (!POOL.started)
+        return;
+
+    mutex_lock(&POOL.lock);
+    POOL.stop = true;
+    cond_broadcast(&POOL.not_empty);
+    mutex_unlock(&POOL.lock);
+
+    for (int i = 0; i < POOL.num_workers; ++i) {
+#ifdef POSIX_THREADS
+        pthread_join(POOL.workers[i], NULL);
 #elif defined(WIN_THREADS)
+        WaitForSingleObject(POOL.workers[i], INFINITE);
+        CloseHandle(POOL.workers[i]);
+#endif
+    }
 
-    DWORD error;
+    free(POOL.workers);
+    POOL.workers = NULL;
+    POOL.num_workers = 0;
+    POOL.started = POOL.stop = false;
+#endif
+}
 
-    if (WaitForSingleObject(HTHREAD, INFINITE) != WAIT_OBJECT_0 || !GetExitCodeThread(HTHREAD, &error))
-        error = _THREAD_TERMINATION_FAILED;
-    
-    CloseHandle(HTHREAD);
 
+void multithread_lock(void)
+{
+#ifdef THREADS
+    POOL_INIT();
+    mutex_lock(&POOL.output_lock);
 #endif
+}
 
-    return error;
+
+void multithread_unlock(void)
+{
+#ifdef THREADS
+    mutex_unlock(&POOL.output_lock);
+#endif
 }
 
 
@@ -230,8 +521,8 @@ float clock_main_thread(CLOCK_ACTION action)
 
 #if defined(THREADS) && (_POSIX_C_SOURCE >= 199309L) // All these have POSIX
 
-    static struct timespec start_time;
-    static bool time_fail = true;
+    static _Thread_local struct timespec start_time;
+    static _Thread_local bool time_fail = true;
     struct timespec finish_time;
 
     if (action == START_CLOCK)
@@ -244,7 +535,7 @@ float clock_main_thread(CLOCK_ACTION action)
 
 
 #else
-    static clock_t start_time = -1;
+    static _Thread_local clock_t start_time = -1;
     clock_t time;
 
     if (action == START_CLOCK) {
@@ -256,12 +547,63 @@ float clock_main_thread(CLOCK_ACTION action)
             return -1;
 
         time = clock();
-        
+
         if (time == -1)
             return -1;
-        
+
         return (float) (((double) (time - start_time)) / CLOCKS_PER_SEC) * 1000;
     }
 
 #endif
 }
+
+
+double clock_wall_ms(void)
+{
+#if defined(THREADS) && (_POSIX_C_SOURCE >= 199309L)
+    struct timespec time;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &time) == -1)
+        return -1;
+    return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+
+#elif defined(WIN_THREADS)
+    LARGE_INTEGER counter, frequency;
+
+    if (!QueryPerformanceCounter(&counter) || !QueryPerformanceFrequency(&frequency))
+        return -1;
+    return (double) counter.QuadPart * 1000.0 / frequency.QuadPart;
+
+#else
+    return (double) clock() * 1000.0 / CLOCKS_PER_SEC;
+
+#endif
+}
+
+
+double multithread_busy_time(void)
+{
+    double busy_time = CHAIN.busy_time;
+
+    CHAIN.busy_time = 0;
+    return busy_time;
+}
+
+
+int multithread_num_cores(void)
+{
+    long cores = 1;
+
+#if defined(WIN_THREADS)
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    cores = info.dwNumberOfProcessors;
+
+#elif defined(_SC_NPROCESSORS_ONLN)
+    cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+#endif
+
+    return cores >= 1 ? cores : 1;
+}
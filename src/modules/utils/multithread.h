@@ -35,20 +35,64 @@ typedef enum {STOP_CLOCK, START_CLOCK} CLOCK_ACTION;
 float clock_main_thread(CLOCK_ACTION action);
 
 /**
-\brief Calls both functions in a separated thread. Even though its a different process, write's function will execute sequentially.
- Warning: This function isn't thread-safe itself
+\brief Monotonic wall clock
+ @returns Milliseconds since an arbitrary point in time (-1 if unavailable)
+*/
+double clock_wall_ms(void);
+
+/**
+\brief Time spent by the `process` functions given to multithread_create since the last call
+ Warning: Only call it after multithread_wait
+ @returns Milliseconds
+*/
+double multithread_busy_time(void);
+
+/**
+\brief Number of processors available
+ @returns Number of online processors (at least 1)
+*/
+int multithread_num_cores(void);
+
+/**
+\brief Queues both functions to the shared workers. Even though `process` runs in parallel, `write`'s functions created by the same thread execute sequentially in creation order.
+ Blocks while the calling thread already has too many blocks in flight.
+ Warning: Each calling thread has its own chain so multithread_wait must be called by the same thread
  @param process This is the processing function which doesn't do IO sequencially
- @param write This is the function which does IO sequentially
+ @param write This is the function which does IO sequentially (NULL if `process` does everything, e.g. output whose place is already known, so it never waits for the previous tasks)
  @param args Arguments passed to both other parameters of this multithread_create's function
- @returns Error status
+ @returns Error status (Only errors creating the task in which case `args` still belongs to the caller, otherwise see multithread_wait)
 */
 _modules_error multithread_create(_modules_error (* process)(void *), _modules_error (* write)(void *, _modules_error, _modules_error), void * args);
 
 /**
-\brief Waits for all threads created from multithread_create's function
- Warning: This function isn't thread-safe itself
- @returns Error status
+\brief Waits for all tasks created by the calling thread with multithread_create's function
+ @returns First error of those tasks
 */
 _modules_error multithread_wait();
 
+/**
+\brief Runs a function in several threads at once and waits for all of them (They may create their own chains)
+ @param num_threads Number of threads
+ @param function Function executed by every thread
+ @param args Argument given to every thread
+ @returns Error status
+*/
+_modules_error multithread_spawn(int num_threads, void (* function)(void *), void * args);
+
+/**
+\brief Stops and joins every worker (they're created again if needed)
+ Warning: Every thread must have called multithread_wait
+*/
+void multithread_shutdown(void);
+
+/**
+\brief Serializes output shared between threads which create their own chains (e.g. each module's summary)
+*/
+void multithread_lock(void);
+
+/**
+\brief Releases the lock taken by multithread_lock
+*/
+void multithread_unlock(void);
+
 #endif //UTILS_MULTITHREAD_H
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "perf.h"
+
+#ifdef PERF_EVENTS
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+bool PERF_COUNTERS = false;
+
+static const char * const KERNEL_NAMES[NUM_PERF_KERNELS] = {
+    "block_compression",
+    "make_freq",
+    "binary_coding",
+    "shafa_block_decompressor",
+    "rle_block_decompressor",
+    "shafa_rle_block_decompressor",
+    "rans_encode",
+    "rans_decode",
+    "bwt_encode",
+    "bwt_decode"
+};
+
+static const char * const COUNTER_NAMES[NUM_PERF_COUNTERS] = {
+    "cycles",
+    "instructions",
+    "branch-misses",
+    "L1d-misses",
+    "LLC-misses"
+};
+
+/*
+    Totals of each kernel
+*/
+typedef struct {
+    unsigned long long calls;
+    unsigned long long bytes;
+    double counters[NUM_PERF_COUNTERS];
+    bool available[NUM_PERF_COUNTERS];
+} Totals;
+
+static Totals TOTALS[NUM_PERF_KERNELS];
+
+#ifdef PERF_EVENTS
+static pthread_mutex_t LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+\brief Opens one counter for the calling thread on any CPU
+ @returns File descriptor or -1 if the counter isn't available
+*/
+static int open_counter(const uint32_t type, const uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1; // Allowed even with a restrictive perf_event_paranoid
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+
+bool perf_enable(void)
+{
+#ifdef PERF_EVENTS
+    return PERF_COUNTERS = true;
+#else
+    return false;
+#endif
+}
+
+
+void perf_begin(PerfSample * const sample)
+{
+#ifdef PERF_EVENTS
+    static const uint32_t TYPES[NUM_PERF_COUNTERS] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE
+    };
+    static const uint64_t CONFIGS[NUM_PERF_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+    };
+
+    // Counters aren't grouped so the ones the CPU/VM doesn't have don't hide the others
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i)
+        sample->fds[i] = open_counter(TYPES[i], CONFIGS[i]);
+
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        if (sample->fds[i] >= 0) {
+            ioctl(sample->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(sample->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#else
+    (void) sample;
+#endif
+}
+
+
+void perf_end(PerfSample * const sample, const PERF_KERNEL kernel, const unsigned long bytes)
+{
+#ifdef PERF_EVENTS
+    uint64_t values[3]; // value, time enabled, time running
+    double counters[NUM_PERF_COUNTERS];
+    bool available[NUM_PERF_COUNTERS];
+
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i)
+        if (sample->fds[i] >= 0)
+            ioctl(sample->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        available[i] = false;
+
+        if (sample->fds[i] < 0)
+            continue;
+
+        if (read(sample->fds[i], values, sizeof(values)) == sizeof(values) && values[2]) {
+            // Scale in case the kernel multiplexed the counter
+            counters[i] = (double) values[0] * values[1] / values[2];
+            available[i] = true;
+        }
+
+        close(sample->fds[i]);
+    }
+
+    pthread_mutex_lock(&LOCK);
+
+    TOTALS[kernel].calls++;
+    TOTALS[kernel].bytes += bytes;
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        if (available[i]) {
+            TOTALS[kernel].counters[i] += counters[i];
+            TOTALS[kernel].available[i] = true;
+        }
+    }
+
+    pthread_mutex_unlock(&LOCK);
+#else
+    (void) sample;
+    (void) kernel;
+    (void) bytes;
+#endif
+}
+
+
+void perf_report(FILE * const fd)
+{
+    Totals * totals;
+    double mb;
+
+    fprintf(fd, "Hardware counters (per MB of uncompressed data):\n%-28s %8s %10s", "kernel", "calls", "MB");
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i)
+        fprintf(fd, " %14s", COUNTER_NAMES[i]);
+    fprintf(fd, " %6s\n", "IPC");
+
+    for (int k = 0; k < NUM_PERF_KERNELS; ++k) {
+        totals = &TOTALS[k];
+
+        if (!totals->calls)
+            continue;
+
+        mb = totals->bytes / 1e6;
+        fprintf(fd, "%-28s %8llu %10.3f", KERNEL_NAMES[k], totals->calls, mb);
+
+        for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+            if (totals->available[i] && mb > 0)
+                fprintf(fd, " %14.0f", totals->counters[i] / mb);
+            else
+                fprintf(fd, " %14s", "n/a");
+        }
+
+        if (totals->available[PERF_CYCLES] && totals->available[PERF_INSTRUCTIONS] && totals->counters[PERF_CYCLES] > 0)
+            fprintf(fd, " %6.2f\n", totals->counters[PERF_INSTRUCTIONS] / totals->counters[PERF_CYCLES]);
+        else
+            fprintf(fd, " %6s\n", "n/a");
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef UTILS_PERF_H
+#define UTILS_PERF_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#ifdef __linux__
+#define PERF_EVENTS // Only Linux has perf_event_open
+#endif
+
+/*
+    Hot kernels measured with hardware counters
+*/
+typedef enum {
+    PERF_BLOCK_COMPRESSION,
+    PERF_MAKE_FREQ,
+    PERF_BINARY_CODING,
+    PERF_SHAFA_BLOCK_DECOMPRESSOR,
+    PERF_RLE_BLOCK_DECOMPRESSOR,
+    PERF_SHAFA_RLE_BLOCK_DECOMPRESSOR,
+    PERF_RANS_ENCODE,
+    PERF_RANS_DECODE,
+    PERF_BWT_ENCODE,
+    PERF_BWT_DECODE,
+    NUM_PERF_KERNELS
+} PERF_KERNEL;
+
+/*
+    Counters read around each kernel
+*/
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    NUM_PERF_COUNTERS
+} PERF_COUNTER;
+
+extern bool PERF_COUNTERS;
+
+/**
+ Counters opened for the calling thread around one kernel's call
+*/
+typedef struct {
+    int fds[NUM_PERF_COUNTERS];
+} PerfSample;
+
+/*
+    Counters are only opened when enabled so the disabled mode costs a single branch:
+
+        PerfSample sample;
+        PERF_BEGIN(sample);
+        ...
+        PERF_END(sample, PERF_BINARY_CODING, block_size);
+*/
+#define PERF_BEGIN(sample) do { if (PERF_COUNTERS) perf_begin(&(sample)); } while (0)
+#define PERF_END(sample, kernel, bytes) do { if (PERF_COUNTERS) perf_end(&(sample), kernel, bytes); } while (0)
+
+/**
+\brief Enables the hardware counters' report
+ @returns false if this O.S. can't provide them
+*/
+bool perf_enable(void);
+
+/**
+\brief Opens and starts every counter for the calling thread
+ @param sample Where to keep the counters' handles
+*/
+void perf_begin(PerfSample * sample);
+
+/**
+\brief Stops, reads and closes every counter adding them to the kernel's total. Thread-safe
+ @param sample Counters started by perf_begin
+ @param kernel Measured kernel
+ @param bytes Uncompressed bytes processed by the kernel
+*/
+void perf_end(PerfSample * sample, PERF_KERNEL kernel, unsigned long bytes);
+
+/**
+\brief Prints each kernel's counters per MB processed
+ @param fd Stream where to print
+*/
+void perf_report(FILE * fd);
+
+#endif //UTILS_PERF_H
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "rans.h"
+#include "errors.h"
+
+#define RANS_L (1u << 23) // Lower bound of a state (Renormalized states are in [RANS_L, 256 * RANS_L))
+#define RANS_MASK (RANS_TABLE_SIZE - 1)
+
+
+void rans_write_freq(const uint16_t freq[RANS_NUM_SYMBOLS], char * block_freq)
+{
+    for (int symbol = 0; symbol < RANS_NUM_SYMBOLS; ++symbol)
+        block_freq += sprintf(block_freq, symbol < RANS_NUM_SYMBOLS - 1 ? "%u;" : "%u", freq[symbol]);
+}
+
+
+_modules_error rans_read_table(const char * block_freq, RansTable * const table)
+{
+    unsigned long freq, start = 0;
+    char * end;
+
+    for (int symbol = 0; symbol < RANS_NUM_SYMBOLS; ++symbol) {
+        freq = strtoul(block_freq, &end, 10);
+
+        if (end == block_freq || *end != (symbol < RANS_NUM_SYMBOLS - 1 ? ';' : '\0') || freq > RANS_TABLE_SIZE - start)
+            return _FILE_UNRECOGNIZABLE;
+
+        table->freq[symbol] = freq;
+        table->start[symbol] = start;
+        memset(table->symbol + start, symbol, freq);
+
+        start += freq;
+        block_freq = end + 1;
+    }
+
+    if (start != RANS_TABLE_SIZE)
+        return _FILE_UNRECOGNIZABLE;
+
+    return _SUCCESS;
+}
+
+
+_modules_error rans_encode(const RansTable * const table, const uint8_t * const input, const unsigned long size, uint8_t * const output, const unsigned long room, unsigned long * const output_size)
+{
+    uint32_t states[2] = {RANS_L, RANS_L}, * state, freq, max_state;
+    uint8_t * ptr = output + room;
+    uint8_t symbol;
+
+    *output_size = 0;
+
+    // Symbols are coded backwards so they're decoded forwards (The bytes are written from the end of output)
+    for (unsigned long idx = size; idx-- > 0; ) {
+        symbol = input[idx];
+        freq = table->freq[symbol];
+        state = &states[idx & 1];
+
+        if (!freq)
+            return _FILE_UNRECOGNIZABLE;
+
+        // Renormalizes the state so it stays in range once the symbol is coded
+        max_state = ((RANS_L >> RANS_SCALE_BITS) << 8) * freq;
+        while (*state >= max_state) {
+            if (ptr == output)
+                return _SUCCESS;
+
+            *--ptr = *state;
+            *state >>= 8;
+        }
+
+        *state = ((*state / freq) << RANS_SCALE_BITS) + (*state % freq) + table->start[symbol];
+    }
+
+    if ((unsigned long) (ptr - output) < 2 * sizeof(uint32_t))
+        return _SUCCESS;
+
+    // Both final states go first (The decoder starts with them)
+    for (int idx = 1; idx >= 0; --idx) {
+        ptr -= sizeof(uint32_t);
+        ptr[0] = states[idx];
+        ptr[1] = states[idx] >> 8;
+        ptr[2] = states[idx] >> 16;
+        ptr[3] = states[idx] >> 24;
+    }
+
+    *output_size = output + room - ptr;
+    memmove(output, ptr, *output_size);
+
+    return _SUCCESS;
+}
+
+
+/**
+\brief Decodes a symbol and renormalizes its state
+ @param table Table of the block
+ @param state State which decodes the symbol
+ @param input Next byte of the coded block
+ @param end End of the coded block
+ @param symbol Where to write the symbol
+ @returns Error status
+*/
+static inline _modules_error decode_symbol(const RansTable * const table, uint32_t * const state, const uint8_t ** const input, const uint8_t * const end, uint8_t * const symbol)
+{
+    const uint32_t slot = *state & RANS_MASK;
+    const uint8_t decoded = table->symbol[slot];
+
+    *symbol = decoded;
+    *state = table->freq[decoded] * (*state >> RANS_SCALE_BITS) + slot - table->start[decoded];
+
+    while (*state < RANS_L) {
+        if (*input == end)
+            return _FILE_UNRECOGNIZABLE;
+
+        *state = (*state << 8) | *(*input)++;
+    }
+
+    return _SUCCESS;
+}
+
+
+_modules_error rans_decode(const RansTable * const table, const uint8_t * input, const unsigned long input_size, uint8_t * const output, const unsigned long size)
+{
+    const uint8_t * const end = input + input_size;
+    uint32_t states[2];
+    unsigned long idx;
+
+    if (input_size < 2 * sizeof(uint32_t))
+        return _FILE_UNRECOGNIZABLE;
+
+    for (int state = 0; state < 2; ++state, input += sizeof(uint32_t))
+        states[state] = input[0] | (uint32_t) input[1] << 8 | (uint32_t) input[2] << 16 | (uint32_t) input[3] << 24;
+
+    // Both states are independent so their lookups overlap
+    for (idx = 0; idx + 1 < size; idx += 2)
+        if (decode_symbol(table, &states[0], &input, end, &output[idx]) || decode_symbol(table, &states[1], &input, end, &output[idx + 1]))
+            return _FILE_UNRECOGNIZABLE;
+
+    if (idx < size && decode_symbol(table, &states[0], &input, end, &output[idx]))
+        return _FILE_UNRECOGNIZABLE;
+
+    // Both states are back where the encoder started once every byte is read (Otherwise the block is broken)
+    if (input != end || states[0] != RANS_L || states[1] != RANS_L)
+        return _FILE_UNRECOGNIZABLE;
+
+    return _SUCCESS;
+}
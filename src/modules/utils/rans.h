@@ -0,0 +1,67 @@
+#ifndef UTILS_RANS_H
+#define UTILS_RANS_H
+
+#include <stdint.h>
+
+#include "errors.h"
+
+#define RANS_SCALE_BITS 12                      // Normalized frequencies of a block add up to 2^12
+#define RANS_TABLE_SIZE (1 << RANS_SCALE_BITS)
+#define RANS_BLOCK_FREQ_SIZE (256 * 4 + 255 + 1) // 4 digits per frequency + 255 ';' + 1 byte NULL
+#define RANS_NUM_SYMBOLS 256
+
+/*
+    Entropy coder used instead of Shannon-Fano when the .cod file is flagged (See header.h): each block of the .cod file holds its symbols'
+    frequencies normalized to RANS_TABLE_SIZE ("f0;f1;...;f255") and module C codes the block with two interleaved rANS states
+    (32 bits, renormalized a byte at a time). The coded block starts with both final states (Little endian) followed by the bytes
+    the decoder reads in order: symbol i is decoded by state i % 2, each one with a single lookup in the table of slots.
+*/
+typedef struct {
+    uint16_t freq[RANS_NUM_SYMBOLS];    // Normalized frequency of each symbol
+    uint16_t start[RANS_NUM_SYMBOLS];   // Sum of the frequencies of the symbols before it
+    uint8_t symbol[RANS_TABLE_SIZE];    // Symbol of each slot
+} RansTable;
+
+
+/**
+\brief Writes a block's normalized frequencies as in a block of the .cod file
+ @param freq Normalized frequency of each symbol
+ @param block_freq Where to write them (At least RANS_BLOCK_FREQ_SIZE bytes)
+*/
+void rans_write_freq(const uint16_t freq[RANS_NUM_SYMBOLS], char * block_freq);
+
+
+/**
+\brief Reads a block's normalized frequencies (As written by rans_write_freq) and builds its table
+ @param block_freq Frequencies separated by ';'
+ @param table Where to build the table
+ @returns Error status (_FILE_UNRECOGNIZABLE unless they add up to RANS_TABLE_SIZE)
+*/
+_modules_error rans_read_table(const char * block_freq, RansTable * table);
+
+
+/**
+\brief Codes a block with rANS
+ @param table Table of the block (Every symbol of the block must have a frequency)
+ @param input Block's content
+ @param size Block's size
+ @param output Where to write the coded block
+ @param room Bytes available in output
+ @param output_size Where to save the coded block's size (0 if it doesn't fit in room)
+ @returns Error status
+*/
+_modules_error rans_encode(const RansTable * table, const uint8_t * input, unsigned long size, uint8_t * output, unsigned long room, unsigned long * output_size);
+
+
+/**
+\brief Decodes a block coded with rANS
+ @param table Table of the block
+ @param input Coded block
+ @param input_size Coded block's size
+ @param output Where to write the decoded block
+ @param size Number of symbols of the block
+ @returns Error status
+*/
+_modules_error rans_decode(const RansTable * table, const uint8_t * input, unsigned long input_size, uint8_t * output, unsigned long size);
+
+#endif //UTILS_RANS_H
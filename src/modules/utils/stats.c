@@ -0,0 +1,255 @@
+#include <math.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "stats.h"
+#include "errors.h"
+#include "multithread.h"
+
+#if defined(__unix__) || defined(__APPLE__) || defined(__MACH__)
+#include <sys/resource.h>
+#define HAS_RUSAGE
+#endif
+
+STATS_MODE STATS = STATS_TEXT;
+
+/*
+    Everything recorded about a module's execution
+*/
+typedef struct Stage {
+    char module[4];
+    const char * description;
+    char * path;
+    double wall_time;
+    double cpu_time;
+    double busy_time;
+    unsigned long long num_blocks;
+    unsigned long * input_sizes;
+    unsigned long * output_sizes;
+    double * entropies;
+    struct Stage * next;
+} Stage;
+
+// Stages are shared by every thread running modules (multithread_lock) but each one times its own
+static Stage * STAGES = NULL, ** LAST_STAGE = &STAGES;
+static _Thread_local double START_WALL_TIME;
+static _Thread_local clock_t START_CPU_TIME;
+
+
+void stats_stage_start(void)
+{
+    START_WALL_TIME = clock_wall_ms();
+    START_CPU_TIME = clock();
+    multithread_busy_time(); // Resets the counter
+}
+
+
+/**
+\brief Allocates a copy of an array
+ @returns The copy or NULL if there was no array or no memory
+*/
+static void * copy_array(const void * const array, const size_t size)
+{
+    void * copy;
+
+    if (!array)
+        return NULL;
+
+    copy = malloc(size);
+    if (copy)
+        memcpy(copy, array, size);
+
+    return copy;
+}
+
+
+_modules_error stats_add_stage(const char * const module, const char * const description, const unsigned long long num_blocks, const unsigned long * const input_sizes, const unsigned long * const output_sizes, const double * const entropies, const char * const path)
+{
+    Stage * stage = calloc(1, sizeof(Stage));
+
+    if (!stage)
+        return _LACK_OF_MEMORY;
+
+    strncpy(stage->module, module, sizeof(stage->module) - 1);
+    stage->description = description;
+    stage->num_blocks = num_blocks;
+    stage->wall_time = clock_wall_ms() - START_WALL_TIME;
+    stage->cpu_time = (double) (clock() - START_CPU_TIME) * 1000.0 / CLOCKS_PER_SEC;
+    stage->busy_time = multithread_busy_time();
+    stage->path = copy_array(path, path ? strlen(path) + 1 : 0);
+    stage->input_sizes = copy_array(input_sizes, num_blocks * sizeof(unsigned long));
+    stage->output_sizes = copy_array(output_sizes, num_blocks * sizeof(unsigned long));
+    stage->entropies = copy_array(entropies, num_blocks * sizeof(double));
+
+    if ((path && !stage->path) || (input_sizes && !stage->input_sizes) || (output_sizes && !stage->output_sizes) || (entropies && !stage->entropies)) {
+        free(stage->path);
+        free(stage->input_sizes);
+        free(stage->output_sizes);
+        free(stage->entropies);
+        free(stage);
+        return _LACK_OF_MEMORY;
+    }
+
+    multithread_lock();
+    *LAST_STAGE = stage;
+    LAST_STAGE = &stage->next;
+    multithread_unlock();
+
+    return _SUCCESS;
+}
+
+
+double stats_entropy(const unsigned long freq[NUM_SYMBOLS_STATS])
+{
+    unsigned long long total = 0;
+    double entropy = 0, p;
+
+    for (int i = 0; i < NUM_SYMBOLS_STATS; ++i)
+        total += freq[i];
+
+    if (!total)
+        return 0;
+
+    for (int i = 0; i < NUM_SYMBOLS_STATS; ++i) {
+        if (freq[i]) {
+            p = (double) freq[i] / total;
+            entropy -= p * log2(p);
+        }
+    }
+
+    return entropy;
+}
+
+
+double stats_block_entropy(const uint8_t * const block, const unsigned long size)
+{
+    unsigned long freq[NUM_SYMBOLS_STATS] = {0};
+
+    for (unsigned long i = 0; i < size; ++i)
+        ++freq[block[i]];
+
+    return stats_entropy(freq);
+}
+
+
+/**
+\brief Prints a string as a JSON string (escaping quotes, backslashes and control characters)
+*/
+static void print_json_string(FILE * const fd, const char * str)
+{
+    fputc('"', fd);
+
+    for ( ; str && *str; ++str) {
+        if (*str == '"' || *str == '\\')
+            fprintf(fd, "\\%c", *str);
+        else if ((unsigned char) *str < 0x20)
+            fprintf(fd, "\\u%04x", *str);
+        else
+            fputc(*str, fd);
+    }
+
+    fputc('"', fd);
+}
+
+
+/**
+\brief Peak resident memory of the whole process
+ @returns KiB or -1 if unknown
+*/
+static long peak_memory(void)
+{
+#ifdef HAS_RUSAGE
+    struct rusage usage;
+
+    if (!getrusage(RUSAGE_SELF, &usage))
+    #ifdef __APPLE__
+        return usage.ru_maxrss / 1024; // Bytes on macOS
+    #else
+        return usage.ru_maxrss;
+    #endif
+#endif
+
+    return -1;
+}
+
+
+void stats_print_json(FILE * const fd)
+{
+    Stage * stage, * next;
+    unsigned long long input, output;
+    const int cores = multithread_num_cores();
+    const long memory = peak_memory();
+
+    fprintf(fd, "{\n  \"cores\": %d,\n  \"peak_memory_kib\": ", cores);
+    if (memory >= 0)
+        fprintf(fd, "%ld,\n", memory);
+    else
+        fputs("null,\n", fd);
+
+    fputs("  \"stages\": [", fd);
+
+    for (stage = STAGES; stage; stage = next) {
+
+        input = output = 0;
+        for (unsigned long long i = 0; i < stage->num_blocks; ++i) {
+            input += stage->input_sizes ? stage->input_sizes[i] : 0;
+            output += stage->output_sizes ? stage->output_sizes[i] : 0;
+        }
+
+        fprintf(fd, "%s\n    {\n      \"module\": ", stage == STAGES ? "" : ",");
+        print_json_string(fd, stage->module);
+        fputs(",\n      \"description\": ", fd);
+        print_json_string(fd, stage->description);
+        fputs(",\n      \"output_file\": ", fd);
+        print_json_string(fd, stage->path);
+        fprintf(
+            fd,
+            ",\n"
+            "      \"wall_ms\": %.3f,\n"
+            "      \"cpu_ms\": %.3f,\n"
+            "      \"workers_busy_ms\": %.3f,\n"
+            "      \"thread_utilization\": %.4f,\n"
+            "      \"num_blocks\": %llu,\n"
+            "      \"input_bytes\": %llu,\n"
+            "      \"output_bytes\": %llu,\n",
+            stage->wall_time, stage->cpu_time, stage->busy_time,
+            stage->wall_time > 0 ? stage->busy_time / (stage->wall_time * cores) : 0,
+            stage->num_blocks, input, output
+        );
+
+        if (input && stage->input_sizes && stage->output_sizes)
+            fprintf(fd, "      \"ratio\": %.6f,\n", (double) output / input);
+        else
+            fputs("      \"ratio\": null,\n", fd);
+
+        fputs("      \"blocks\": [", fd);
+        for (unsigned long long i = 0; i < stage->num_blocks; ++i) {
+            fprintf(fd, "%s\n        {\"index\": %llu", i ? "," : "", i);
+            if (stage->input_sizes)
+                fprintf(fd, ", \"input\": %lu", stage->input_sizes[i]);
+            if (stage->output_sizes)
+                fprintf(fd, ", \"output\": %lu", stage->output_sizes[i]);
+            if (stage->input_sizes && stage->output_sizes && stage->input_sizes[i])
+                fprintf(fd, ", \"ratio\": %.6f", (double) stage->output_sizes[i] / stage->input_sizes[i]);
+            if (stage->entropies)
+                fprintf(fd, ", \"entropy\": %.6f", stage->entropies[i]);
+            fputc('}', fd);
+        }
+        fputs(stage->num_blocks ? "\n      ]\n    }" : "]\n    }", fd);
+
+        next = stage->next;
+        free(stage->path);
+        free(stage->input_sizes);
+        free(stage->output_sizes);
+        free(stage->entropies);
+        free(stage);
+    }
+
+    fputs(STAGES ? "\n  ]\n}\n" : "]\n}\n", fd);
+
+    STAGES = NULL;
+    LAST_STAGE = &STAGES;
+}
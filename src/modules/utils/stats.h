@@ -0,0 +1,63 @@
+#ifndef UTILS_STATS_H
+#define UTILS_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "errors.h"
+
+#define NUM_SYMBOLS_STATS 256
+
+/*
+    How each module reports its results
+*/
+typedef enum {
+    STATS_TEXT,  // Default: Human-readable summary with every block
+    STATS_BRIEF, // Human-readable summary without the per-block lines
+    STATS_JSON,  // Single JSON document printed once every module finishes
+    STATS_NONE   // Nothing at all
+} STATS_MODE;
+
+extern STATS_MODE STATS;
+
+/**
+\brief Marks the beginning of a module's execution (wall time, CPU time and workers' busy time)
+*/
+void stats_stage_start(void);
+
+/**
+\brief Records a finished module for the JSON report. Arrays are copied.
+ @param module Module's letter
+ @param description What the module did
+ @param num_blocks Number of blocks
+ @param input_sizes Size of each block before the module (NULL if unknown)
+ @param output_sizes Size of each block after the module (NULL if unknown)
+ @param entropies Shannon's entropy (bits/symbol) of each block (NULL if unknown)
+ @param path Generated file's path
+ @returns Error status
+*/
+_modules_error stats_add_stage(const char * module, const char * description, unsigned long long num_blocks, const unsigned long * input_sizes, const unsigned long * output_sizes, const double * entropies, const char * path);
+
+/**
+\brief Shannon's entropy of a frequencies' table
+ @param freq Frequency of each symbol
+ @returns Entropy in bits per symbol
+*/
+double stats_entropy(const unsigned long freq[NUM_SYMBOLS_STATS]);
+
+/**
+\brief Shannon's entropy of a block of bytes
+ @param block Block's content
+ @param size Block's size
+ @returns Entropy in bits per symbol
+*/
+double stats_block_entropy(const uint8_t * block, unsigned long size);
+
+/**
+\brief Prints every recorded module as a JSON document and frees them
+ @param fd Stream where to print
+*/
+void stats_print_json(FILE * fd);
+
+#endif //UTILS_STATS_H
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "trace.h"
+#include "errors.h"
+#include "multithread.h"
+
+#define EVENTS_PER_CHUNK 1024
+
+bool TRACE = false;
+
+typedef struct {
+    const char * name;
+    double start;
+    double duration;
+} Event;
+
+typedef struct Chunk {
+    Event events[EVENTS_PER_CHUNK];
+    int length;
+    struct Chunk * next;
+} Chunk;
+
+/*
+    Every thread appends to its own buffer so recording doesn't need any lock.
+    Buffers are only read by trace_close once every thread has been joined.
+*/
+typedef struct Thread {
+    int tid;
+    Chunk * first;
+    Chunk * last;
+    struct Thread * next;
+} Thread;
+
+static _Thread_local Thread * LOCAL = NULL;
+static _Atomic(Thread *) THREADS_LIST = NULL;
+static atomic_int NEXT_TID = 0;
+static double ORIGIN;
+static char * PATH = NULL;
+
+
+/**
+\brief Creates the calling thread's buffer and publishes it
+ @returns The buffer or NULL if there's no memory
+*/
+static Thread * register_thread(void)
+{
+    Thread * thread = calloc(1, sizeof(Thread));
+
+    if (!thread)
+        return NULL;
+
+    thread->tid = atomic_fetch_add(&NEXT_TID, 1);
+    thread->next = atomic_load(&THREADS_LIST);
+    while (!atomic_compare_exchange_weak(&THREADS_LIST, &thread->next, thread));
+
+    return LOCAL = thread;
+}
+
+
+_modules_error trace_open(const char * const path)
+{
+    size_t length = strlen(path);
+
+    PATH = malloc(length + 1);
+    if (!PATH)
+        return _LACK_OF_MEMORY;
+    memcpy(PATH, path, length + 1);
+
+    ORIGIN = clock_wall_ms();
+
+    // Main thread gets tid 0
+    if (!register_thread()) {
+        free(PATH);
+        return _LACK_OF_MEMORY;
+    }
+
+    TRACE = true;
+    return _SUCCESS;
+}
+
+
+void trace_record(const char * const name, const double start)
+{
+    Thread * thread = LOCAL ? LOCAL : register_thread();
+    Chunk * chunk;
+
+    if (!thread)
+        return;
+
+    chunk = thread->last;
+    if (!chunk || chunk->length == EVENTS_PER_CHUNK) {
+        chunk = malloc(sizeof(Chunk));
+        if (!chunk)
+            return; // Tracing is best-effort
+
+        chunk->length = 0;
+        chunk->next = NULL;
+        if (thread->last)
+            thread->last->next = chunk;
+        else
+            thread->first = chunk;
+        thread->last = chunk;
+    }
+
+    chunk->events[chunk->length++] = (Event) {
+        .name = name,
+        .start = start,
+        .duration = clock_wall_ms() - start
+    };
+}
+
+
+_modules_error trace_close(void)
+{
+    _modules_error error = _SUCCESS;
+    Thread * thread, * next_thread;
+    Chunk * chunk, * next_chunk;
+    bool first = true;
+    FILE * fd;
+
+    if (!TRACE)
+        return _SUCCESS;
+
+    TRACE = false;
+
+    fd = fopen(PATH, "wb");
+    if (fd)
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", fd);
+    else
+        error = _FILE_INACCESSIBLE;
+
+    for (thread = atomic_load(&THREADS_LIST); thread; thread = next_thread) {
+
+        if (fd) {
+            fprintf(
+                fd, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                first ? "" : ",", thread->tid, thread->tid ? "worker" : "main", thread->tid
+            );
+            first = false;
+        }
+
+        for (chunk = thread->first; chunk; chunk = next_chunk) {
+
+            for (int i = 0; fd && i < chunk->length; ++i) {
+                // Chrome expects microseconds
+                fprintf(
+                    fd, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    chunk->events[i].name, thread->tid,
+                    (chunk->events[i].start - ORIGIN) * 1000.0, chunk->events[i].duration * 1000.0
+                );
+            }
+
+            next_chunk = chunk->next;
+            free(chunk);
+        }
+
+        next_thread = thread->next;
+        free(thread);
+    }
+
+    if (fd) {
+        fputs("\n]}\n", fd);
+        if (ferror(fd))
+            error = _FILE_STREAM_FAILED;
+        fclose(fd);
+    }
+
+    atomic_store(&THREADS_LIST, NULL);
+    LOCAL = NULL;
+    free(PATH);
+    PATH = NULL;
+
+    return error;
+}
@@ -0,0 +1,43 @@
+#ifndef UTILS_TRACE_H
+#define UTILS_TRACE_H
+
+#include <stdbool.h>
+
+#include "errors.h"
+#include "multithread.h"
+
+extern bool TRACE;
+
+/*
+    Spans are only timed when tracing is enabled so disabled tracing costs a single branch:
+
+        double span = TRACE_BEGIN();
+        ...
+        TRACE_END("encode", span);
+*/
+#define TRACE_BEGIN() (TRACE ? clock_wall_ms() : 0)
+#define TRACE_END(name, start) do { if (TRACE) trace_record(name, start); } while (0)
+
+
+/**
+\brief Enables tracing. Must be called by the main thread before any other thread is created
+ @param path Path of the Chrome trace-event file written by trace_close
+ @returns Error status
+*/
+_modules_error trace_open(const char * path);
+
+/**
+\brief Records a span which started at `start` and ends now in the calling thread's buffer
+ @param name Span's name (must be a string literal or outlive tracing)
+ @param start Value returned by TRACE_BEGIN
+*/
+void trace_record(const char * name, double start);
+
+/**
+\brief Writes every recorded span in Chrome trace-event format and disables tracing
+ Warning: Every traced thread must have been joined
+ @returns Error status
+*/
+_modules_error trace_close(void);
+
+#endif //UTILS_TRACE_H
@@ -7,6 +7,8 @@
  ***********************************************/
 
 
+#include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,7 +18,13 @@
 #include "modules/t.h"
 #include "modules/c.h"
 #include "modules/d.h"
+#include "modules/a.h"
+#include "modules/p.h"
 #include "modules/utils/file.h"
+#include "modules/utils/perf.h"
+#include "modules/utils/stats.h"
+#include "modules/utils/trace.h"
+#include "modules/utils/bufpool.h"
 #include "modules/utils/errors.h"
 #include "modules/utils/extensions.h"
 #include "modules/utils/multithread.h"
@@ -25,29 +33,53 @@
     Every option parsed from user's input
 */
 typedef struct {
-    unsigned long block_size;
+    unsigned long block_size; // 0 -> Chosen for each file (-b auto)
+    bool block_size_auto;
+    unsigned long restart_interval; // Symbols between module C's restart points (0 -> None)
     bool module_f;
     bool module_t;
     bool module_c;
     bool module_d;
     bool f_force_rle;
     bool f_force_freq;
+    bool f_adaptive;
+    bool f_order1; // Module F also counts the frequencies of each context so module T builds codes for each one
+    bool f_bwt; // Module F transforms each block with Burrows-Wheeler and move-to-front before RLE
+    bool t_ans; // Module T normalizes the frequencies for rANS instead of building Shannon-Fano's codes
     bool d_shaf;
     bool d_rle;
+    char * archive;
+    bool archive_extract;
 } Options;
 
 
+/*
+    Every file of a batch and which one should be picked next by a driver thread
+*/
+typedef struct {
+    Options options;
+    char ** files;
+    size_t num_files;
+    size_t next;
+    bool failed;
+} Batch;
+
+
 /**
 \brief Parses the arguments provided by the user into a Options' struct
  @param argc Number of arguments provided by the user
  @param argv Array of arguments provided by the user
- @param file Pointer to a string for pointing to the file's path provided by the user
+ @param files Array (with at least `argc` elements) for pointing to the files' paths provided by the user
+ @param num_files Pointer to the number of files provided by the user
+ @param dirs Array (with at least `argc` elements) for pointing to the directories provided by the user with `-r`
+ @param num_dirs Pointer to the number of directories provided by the user
+ @param trace Pointer to a string for pointing to the trace's path provided by the user
  @returns Error status
 */
-static bool parse(const int argc, char * const argv[], Options * const options, char ** const file)
+static bool parse(const int argc, char * const argv[], Options * const options, char ** const files, size_t * const num_files, char ** const dirs, size_t * const num_dirs, char ** const trace)
 {
     char opt;
-    char * key, * value;
+    char * key, * value, * end;
 
     for (int i = 1; i < argc; ++i) { // argv[0] == "./shafa"
         key = argv[i];
@@ -55,12 +87,76 @@ static bool parse(const int argc, char * const argv[], Options * const options,
         if (strcmp(key, "--no-multithread") == 0)
             NO_MULTITHREAD = true;
 
-        else if (key[0] != '-') {
-            if (*file) // There is a path to file already as an argument
+        else if (strcmp(key, "--perf-counters") == 0) {
+            if (!perf_enable()) {
+                fputs("Hardware performance counters are only available on Linux\n", stderr);
+                return false;
+            }
+        }
+
+        else if (strcmp(key, "--trace") == 0) {
+            if (++i >= argc || *trace)
                 return false;
 
-            *file = key;
+            *trace = argv[i];
         }
+
+        else if (strncmp(key, "--stats=", 8) == 0) {
+            value = key + 8;
+
+            if (strcmp(value, "text") == 0)
+                STATS = STATS_TEXT;
+            else if (strcmp(value, "brief") == 0)
+                STATS = STATS_BRIEF;
+            else if (strcmp(value, "json") == 0)
+                STATS = STATS_JSON;
+            else if (strcmp(value, "none") == 0)
+                STATS = STATS_NONE;
+            else
+                return false;
+        }
+
+        else if (strcmp(key, "--ans") == 0)
+            options->t_ans = true;
+
+        else if (strcmp(key, "--order1") == 0)
+            options->f_order1 = true;
+
+        else if (strcmp(key, "--bwt") == 0)
+            options->f_bwt = true;
+
+        else if (strcmp(key, "--restarts") == 0) {
+            if (++i >= argc || !isdigit((unsigned char) *argv[i]))
+                return false;
+
+            errno = 0;
+            options->restart_interval = strtoul(argv[i], &end, 10); // KiB
+
+            // At least one restart point can fit in the largest block
+            if (*end || errno || !options->restart_interval || options->restart_interval >= MAX_BLOCK_SIZE / _1KiB)
+                return false;
+
+            options->restart_interval *= _1KiB;
+        }
+
+        else if (strcmp(key, "-r") == 0) {
+            if (++i >= argc)
+                return false;
+
+            dirs[(*num_dirs)++] = argv[i];
+        }
+
+        else if (strcmp(key, "-a") == 0 || strcmp(key, "-x") == 0) {
+            if (++i >= argc || options->archive)
+                return false;
+
+            options->archive = argv[i];
+            options->archive_extract = key[1] == 'x';
+        }
+
+        else if (key[0] != '-')
+            files[(*num_files)++] = key;
+
         else {
 
             if (++i >= argc)
@@ -68,7 +164,7 @@ static bool parse(const int argc, char * const argv[], Options * const options,
 
             value = argv[i];
 
-            if (strlen(key) != 2 || strlen(value) != 1)
+            if (strlen(key) != 2 || (strlen(value) != 1 && key[1] != 'b'))
                 return false;
         
             opt = *value;
@@ -92,7 +188,25 @@ static bool parse(const int argc, char * const argv[], Options * const options,
                             return 0;
                     }
                     break;
-                case 'b': // K|m|M
+                case 'b': // K|m|M|auto|<bytes>
+                    if (strcmp(value, "auto") == 0) {
+                        options->block_size_auto = true;
+                        break;
+                    }
+
+                    if (isdigit((unsigned char) opt)) {
+                        errno = 0;
+                        options->block_size = strtoul(value, &end, 10);
+
+                        // Same limits as fsize's
+                        if (*end || errno || options->block_size < MIN_BLOCK_SIZE || options->block_size > MAX_BLOCK_SIZE)
+                            return false;
+                        break;
+                    }
+
+                    if (strlen(value) != 1)
+                        return false;
+
                     switch (opt) {
                         case 'K':
                             options->block_size = _640KiB;
@@ -107,11 +221,13 @@ static bool parse(const int argc, char * const argv[], Options * const options,
                             return 0;
                     }
                     break;
-                case 'c': // r -> rle force    |    f -> freq force
+                case 'c': // r -> rle force    |    f -> freq force    |    a -> rle chosen per block
                     if (opt == 'r')
                         options->f_force_rle = true;
                     else if (opt == 'f')
                         options->f_force_freq = true;
+                    else if (opt == 'a')
+                        options->f_adaptive = true;
                     else
                         return false;
                     break;
@@ -152,9 +268,20 @@ _modules_error execute_modules(Options options, char ** const ptr_file) // bette
     _modules_error error;
     char * tmp_file;
     bool file_rle_shaf = false, decompressed = false;
+    const bool pipelined = options.module_f && options.module_t && options.module_c; // Each block goes through modules F, T and C at once
     
-    if (options.module_f) {
-        error = freq_rle_compress(ptr_file, options.f_force_rle, options.f_force_freq, options.block_size); // Returns true if file was RLE compressed
+    if (pipelined) {
+        stats_stage_start();
+        error = pipeline_compress(ptr_file, options.f_force_rle, options.f_force_freq, options.f_adaptive, options.block_size, options.restart_interval, options.t_ans, options.f_order1, options.f_bwt);
+
+        if (error) {
+            fputs("Modules f, t & c: Something went wrong while compressing...\n", stderr);
+            return error;
+        }
+    }
+    else if (options.module_f) {
+        stats_stage_start();
+        error = freq_rle_compress(ptr_file, options.f_force_rle, options.f_force_freq, options.f_adaptive, options.f_order1, options.f_bwt, options.block_size); // Returns true if file was RLE compressed
 
         if (error) {
             fputs("Module f: Something went wrong while compressing with RLE or creating frequencies' table...\n", stderr);
@@ -162,7 +289,7 @@ _modules_error execute_modules(Options options, char ** const ptr_file) // bette
         }
     }
 
-    if (options.module_t) {
+    if (options.module_t && !pipelined) {
 
         if (!options.module_f) {
             if (check_ext(*ptr_file, FREQ_EXT)) {
@@ -180,7 +307,8 @@ _modules_error execute_modules(Options options, char ** const ptr_file) // bette
             }
         }
 
-        error = get_shafa_codes(*ptr_file); // If file doesn't end in .rle then its considered an uncompressed one
+        stats_stage_start();
+        error = get_shafa_codes(*ptr_file, options.t_ans); // If file doesn't end in .rle then its considered an uncompressed one
 
         if (error) {
             fputs("Module t: Something went wrong...\n", stderr);
@@ -188,14 +316,15 @@ _modules_error execute_modules(Options options, char ** const ptr_file) // bette
         }
     }
 
-    if (options.module_c) {
+    if (options.module_c && !pipelined) {
 
         if (options.module_f && !options.module_t) { // Conflict
             fputs("Module c: Can't execute module 'c' after 'f' without 't'...\n", stderr);
             return _OUTSIDE_MODULE;
         }
 
-        error = shafa_compress(ptr_file); // If file doesn't end in .rle then its considered an uncompressed one
+        stats_stage_start();
+        error = shafa_compress(ptr_file, options.restart_interval); // If file doesn't end in .rle then its considered an uncompressed one
 
         if (error) {
             fputs("Module c: Something went wrong...\n", stderr);
@@ -229,6 +358,7 @@ _modules_error execute_modules(Options options, char ** const ptr_file) // bette
                     }
                 }
 
+                stats_stage_start();
                 error = shafa_decompress(ptr_file, (options.d_rle || !options.d_shaf) && (file_rle_shaf || check_ext(*ptr_file, RLE_EXT SHAFA_EXT))); // RLE => Trigger: NULL | -m d
 
                 if (error) {
@@ -247,6 +377,7 @@ _modules_error execute_modules(Options options, char ** const ptr_file) // bette
                 return _OUTSIDE_MODULE;
             }
 
+            stats_stage_start();
             error = rle_decompress(ptr_file);
 
             if (error) {
@@ -259,53 +390,262 @@ _modules_error execute_modules(Options options, char ** const ptr_file) // bette
 }
 
 
+/**
+\brief Executes the modules over a single file choosing them by its extension when the user didn't
+ @param options A struct to the Options parsed from the user's input
+ @param path File's path
+ @param batch Whether it is one of many files (Errors are prefixed with the file's path)
+ @returns Error status
+*/
+static _modules_error process_file(Options options, const char * const path, const bool batch)
+{
+    _modules_error error;
+    char * file;
+
+    // Have to otherwise it will raise error if some modules tries to free it in order to change the pointer to the new file's path
+    file = add_ext(path, ""); // does the same as `strdup` from <string.h> which is not supported in c17
+
+    if (!file)
+        return _LACK_OF_MEMORY;
+
+    if (!options.module_f && !options.module_t && !options.module_c && !options.module_d) {
+        if (check_ext(file, SHAFA_EXT)) // if user wants to decompress a RLE only then they must specify `-m d` which will be equivalent to `-m d -d r`
+            options.module_d = 1;
+        else
+            options.module_f = options.module_t = options.module_c = 1;
+    }
+
+    // Can't do the same for `options.d_shaf` and `options.d_rle` since we would lost information
+    // about the user forcing Shannon Fano's decompression in case they passed a `.rle` file
+    // which should raise a custom error
+
+    // Only module F splits the file into blocks
+    if (!options.block_size && options.module_f)
+        options.block_size = auto_block_size(file);
+
+    error = execute_modules(options, &file);
+    free(file);
+
+    if (error && batch) {
+        multithread_lock();
+        if (error != _OUTSIDE_MODULE)
+            fprintf(stderr, "%s: %s", path, error_msg(error));
+        else
+            fprintf(stderr, "%s: Skipped\n", path);
+        multithread_unlock();
+    }
+
+    return error;
+}
+
+
+/**
+\brief Driver thread of a batch: keeps taking the next file until there are none left
+ @param _batch Batch shared by every driver
+*/
+static void batch_driver(void * const _batch)
+{
+    Batch * const batch = (Batch *) _batch;
+    size_t index;
+
+    for (;;) {
+        multithread_lock();
+        index = batch->next++;
+        multithread_unlock();
+
+        if (index >= batch->num_files)
+            break;
+
+        if (process_file(batch->options, batch->files[index], true)) {
+            multithread_lock();
+            batch->failed = true;
+            multithread_unlock();
+        }
+    }
+}
+
+
+/*
+    Pair used to sort a batch by size
+*/
+typedef struct {
+    char * path;
+    long long size;
+} SizedFile;
+
+
+/**
+\brief Comparator of SizedFile's for qsort (Largest first)
+*/
+static int cmp_size_desc(const void * const a, const void * const b)
+{
+    const long long size_a = ((const SizedFile *) a)->size, size_b = ((const SizedFile *) b)->size;
+
+    return (size_a < size_b) - (size_a > size_b);
+}
+
+
+/**
+\brief Sorts files by size (Largest first) so the longest ones don't start last
+ @param files Files' paths
+ @param num_files Number of files
+ @returns Error status
+*/
+static _modules_error sort_by_size(char ** const files, const size_t num_files)
+{
+    SizedFile * sized = malloc(num_files * sizeof(SizedFile));
+
+    if (!sized)
+        return _LACK_OF_MEMORY;
+
+    for (size_t i = 0; i < num_files; ++i) {
+        sized[i].path = files[i];
+        sized[i].size = file_size(files[i]);
+    }
+
+    qsort(sized, num_files, sizeof(SizedFile), cmp_size_desc);
+
+    for (size_t i = 0; i < num_files; ++i)
+        files[i] = sized[i].path;
+
+    free(sized);
+
+    return _SUCCESS;
+}
+
+
+/**
+\brief Compresses/decompresses many files at once. Every file feeds the same workers so small
+        files don't leave cores idle: the largest ones start first and a driver thread per core
+        keeps picking the next file while the previous one still has blocks in the workers
+ @param options A struct to the Options parsed from the user's input
+ @param files Files' paths
+ @param num_files Number of files
+ @returns Error status (_OUTSIDE_MODULE if any file failed since each one was already reported)
+*/
+static _modules_error process_batch(const Options options, char ** const files, const size_t num_files)
+{
+    _modules_error error;
+    Batch batch = {.options = options, .files = files, .num_files = num_files};
+    int num_drivers = multithread_num_cores();
+
+    error = sort_by_size(files, num_files);
+    if (error)
+        return error;
+
+    if ((size_t) num_drivers > num_files)
+        num_drivers = (int) num_files;
+
+    error = multithread_spawn(num_drivers, batch_driver, &batch);
+
+    if (!error && batch.failed)
+        error = _OUTSIDE_MODULE;
+
+    return error;
+}
+
+
 int main (const int argc, char * const argv[])
 {
     Options options = {0}; // Reference C99 Standard 6.7.8.21
-    char * file = NULL;
-    int error;
+    char ** files, ** dirs, ** listed = NULL, ** tmp_files, * trace = NULL;
+    size_t num_files = 0, num_dirs = 0, num_listed = 0;
+    int error = _SUCCESS;
 
     if (argc <= 1) {
         fputs("No file input\n", stderr);
         return 1;
     }
 
-    if (!parse(argc, argv, &options, &file)) {
-        fputs("Wrong Options' syntax\n", stderr);
+    files = malloc(argc * sizeof(char *));
+    dirs = malloc(argc * sizeof(char *));
+
+    if (!files || !dirs) {
+        free(files);
+        free(dirs);
+        fputs("Not enough memory\n", stderr);
         return 1;
     }
 
-    if (!file) {
-        fputs("No file input\n", stderr);
+    if (!parse(argc, argv, &options, files, &num_files, dirs, &num_dirs, &trace)) {
+        free(files);
+        free(dirs);
+        fputs("Wrong Options' syntax\n", stderr);
         return 1;
     }
 
-    // Have to otherwise it will raise error if some modules tries to free it in order to change the pointer to the new file's path
-    file = add_ext(file, ""); // does the same as `strdup` from <string.h> which is not supported in c17
+    // Directories' files are listed after the ones given explicitly
+    for (size_t i = 0; i < num_dirs && !error; ++i) {
+        error = list_files(dirs[i], &listed, &num_listed);
+        if (error == _FILE_INACCESSIBLE)
+            fprintf(stderr, "%s: ", dirs[i]);
+    }
 
-    if (!file) {
-        fputs("Not enough memory\n", stderr);
-        return 1;
+    free(dirs);
+
+    if (!error && num_listed) {
+        tmp_files = realloc(files, (num_files + num_listed) * sizeof(char *));
+        if (tmp_files) {
+            files = tmp_files;
+            memcpy(files + num_files, listed, num_listed * sizeof(char *));
+            num_files += num_listed;
+        }
+        else
+            error = _LACK_OF_MEMORY;
     }
 
+    if (!error && !num_files && !options.archive_extract) {
+        fputs("No file input\n", stderr);
+        error = _OUTSIDE_MODULE;
+    }
 
+    if (options.block_size_auto)
+        options.block_size = 0;
+    else if (!options.block_size)
+        options.block_size = _64KiB;
 
-    if (!options.module_f && !options.module_t && !options.module_c && !options.module_d) {
-        if (check_ext(file, SHAFA_EXT)) // if user wants to decompress a RLE only then they must specify `-m d` which will be equivalent to `-m d -d r`
-            options.module_d = 1;
+    if (!error && trace && trace_open(trace))
+        error = _LACK_OF_MEMORY;
+
+    if (!error && options.archive) {
+        if (options.archive_extract)
+            error = archive_extract(options.archive, files, num_files);
+        else {
+            // The archive itself may be inside a listed directory
+            for (size_t i = 0; i < num_files; ++i)
+                if (!strcmp(files[i], options.archive))
+                    files[i--] = files[--num_files];
+
+            error = sort_by_size(files, num_files);
+            if (!error)
+                error = archive_create(options.archive, files, num_files, options.block_size, options.f_force_rle);
+        }
+    }
+    else if (!error) {
+        if (num_files == 1 && !num_dirs)
+            error = process_file(options, files[0], false);
         else
-            options.module_f = options.module_t = options.module_c = 1;
+            error = process_batch(options, files, num_files);
     }
 
-    // Can't do the same for `options.d_shaf` and `options.d_rle` since we would lost information
-    // about the user forcing Shannon Fano's decompression in case they passed a `.rle` file
-    // which should raise a custom error
-    
-    if (!options.block_size)
-        options.block_size = _64KiB;
-        
-    error = execute_modules(options, &file);
-    free(file);
+    multithread_shutdown();
+    bufpool_trim();
+
+    for (size_t i = 0; i < num_listed; ++i)
+        free(listed[i]);
+    free(listed);
+    free(files);
+
+    if (trace && trace_close()) {
+        fputs("Trace couldn't be written\n", stderr);
+        error = error ? error : _OUTSIDE_MODULE;
+    }
+
+    if (STATS == STATS_JSON)
+        stats_print_json(stdout);
+
+    if (PERF_COUNTERS)
+        perf_report(stderr);
 
     if (error) {
         if (error != _OUTSIDE_MODULE)